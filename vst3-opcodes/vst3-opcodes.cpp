@@ -24,9 +24,28 @@
 
 // This one must come first to avoid conflict with Csound #defines.
 #include <thread>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <limits>
+#include <sstream>
+#include <unordered_map>
 
 #include <OpcodeBaseAC.hpp>
 
+#if !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define VST3_HAS_MXCSR 1
+#endif
+
 #include "pluginterfaces/gui/iplugview.h"
 #include "pluginterfaces/gui/iplugviewcontentscalesupport.h"
 #include "pluginterfaces/vst/ivstaudioprocessor.h"
@@ -88,6 +107,36 @@ class vst3_plugin_t;
 
 typedef csound::heap_object_manager_t<vst3_host_t> vst3hosts;
 
+/**
+ * Returns a standard speaker arrangement for a number of channels: mono,
+ * stereo, 5.1, or 2nd to 7th order ambisonics, or else the first that many
+ * speakers.
+ */
+static inline Steinberg::Vst::SpeakerArrangement speaker_arrangement(Steinberg::int32 channels) {
+    switch (channels) {
+    case 1:
+        return Steinberg::Vst::SpeakerArr::kMono;
+    case 2:
+        return Steinberg::Vst::SpeakerArr::kStereo;
+    case 6:
+        return Steinberg::Vst::SpeakerArr::k51;
+    case 9:
+        return Steinberg::Vst::SpeakerArr::kAmbi2cdOrderACN;
+    case 16:
+        return Steinberg::Vst::SpeakerArr::kAmbi3rdOrderACN;
+    case 25:
+        return Steinberg::Vst::SpeakerArr::kAmbi4thOrderACN;
+    case 36:
+        return Steinberg::Vst::SpeakerArr::kAmbi5thOrderACN;
+    case 49:
+        return Steinberg::Vst::SpeakerArr::kAmbi6thOrderACN;
+    case 64:
+        return Steinberg::Vst::SpeakerArr::kAmbi7thOrderACN;
+    default:
+        return channels >= 64 ? ~Steinberg::Vst::SpeakerArrangement(0) : (Steinberg::Vst::SpeakerArrangement(1) << channels) - 1;
+    }
+}
+
 static inline bool configureBusArrangementsFromPlugin(Steinberg::Vst::IComponent* component,
         Steinberg::Vst::IAudioProcessor* processor) {
     if (!component || !processor) return false;
@@ -154,1518 +203,7122 @@ enum
     kMaxMidiChannels = 16
 };
 
-using Controllers = std::vector<int32>;
-using Channels = std::array<Controllers, kMaxMidiChannels>;
-using Busses = std::array<Channels, kMaxMidiMappingBusses>;
-using MidiCCMapping = Busses;
-
-static inline MidiCCMapping initMidiCtrlerAssignment(Steinberg::Vst::IComponent* component, Steinberg::Vst::IMidiMapping* midiMapping) {
-    MidiCCMapping midiCCMapping {};
-    if (!midiMapping || !component) {
-        return midiCCMapping;
-    }
-    int32 busses = std::min<int32>(component->getBusCount(Steinberg::Vst::kEvent, Steinberg::Vst::kInput), kMaxMidiMappingBusses);
-    if (midiCCMapping[0][0].empty()) {
-        for (int32 b = 0; b < busses; b++) {
-            for (int32 i = 0; i < kMaxMidiChannels; i++) {
-                midiCCMapping[b][i].resize(Steinberg::Vst::kCountCtrlNumber);
-            }
+/**
+ * The MIDI controller assignments of a plugin, flattened into one contiguous
+ * table of parameter IDs indexed by [bus][channel][controller]. Controller
+ * numbers include the VST3 pseudo-controllers for channel aftertouch, pitch
+ * bend, and program change. The table is filled once, at i-time, so that
+ * translating a controller at k-rate costs one indexed load.
+ */
+struct midi_cc_mapping_t {
+    void initialize(Steinberg::Vst::IComponent* component, Steinberg::Vst::IMidiMapping* midi_mapping) {
+        bus_count = 0;
+        parameter_ids.clear();
+        if (!midi_mapping || !component) {
+            initialized = true;
+            return;
         }
-    }
-    Steinberg::Vst::ParamID paramID;
-    for (int32 b = 0; b < busses; b++) {
-        for (int16 ch = 0; ch < kMaxMidiChannels; ch++) {
-            for (int32 i = 0; i < Steinberg::Vst::kCountCtrlNumber; i++) {
-                paramID = Steinberg::Vst::kNoParamId;
-                if (midiMapping->getMidiControllerAssignment(b, ch,(Steinberg::Vst::CtrlNumber)i, paramID) ==
-                        Steinberg::kResultTrue) {
-                    midiCCMapping[b][ch][i] = paramID;
-                } else {
-                    midiCCMapping[b][ch][i] = Steinberg::Vst::kNoParamId;
+        bus_count = std::min<int32>(component->getBusCount(Steinberg::Vst::kEvent, Steinberg::Vst::kInput), kMaxMidiMappingBusses);
+        parameter_ids.assign(size_t(bus_count) * kMaxMidiChannels * Steinberg::Vst::kCountCtrlNumber, Steinberg::Vst::kNoParamId);
+        for (int32 bus = 0; bus < bus_count; bus++) {
+            for (int16 channel = 0; channel < kMaxMidiChannels; channel++) {
+                for (int32 controller = 0; controller < Steinberg::Vst::kCountCtrlNumber; controller++) {
+                    Steinberg::Vst::ParamID parameter_id = Steinberg::Vst::kNoParamId;
+                    if (midi_mapping->getMidiControllerAssignment(bus, channel, (Steinberg::Vst::CtrlNumber)controller, parameter_id) == Steinberg::kResultTrue) {
+                        parameter_ids[index(bus, channel, controller)] = parameter_id;
+                    }
                 }
             }
         }
+        initialized = true;
     }
-    return midiCCMapping;
-}
-
-#if EDITOR_IMPLEMENTED
-
-struct CsoundWindowController : public Steinberg::Vst::EditorHost::IWindowController, public Steinberg::IPlugFrame
-{
-public:
-    CsoundWindowController (const Steinberg::IPtr<Steinberg::IPlugView>& plugView_) : plugView(plugView_) {}
-    ~CsoundWindowController () noexcept override {}
-    void onShow (Steinberg::Vst::EditorHost::IWindow& w) override {
-        SMTG_DBPRT1 ("onShow called (%p)\n", (void*)&w);
-        window = &w;
-        if (!plugView) {
-            return;
-        }
-        auto platformWindow = window->getNativePlatformWindow ();
-        if (plugView->isPlatformTypeSupported (platformWindow.type) != Steinberg::kResultTrue) {
-            Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, std::string ("PlugView does not support platform type:") +
-                    platformWindow.type);
-        }
-        plugView->setFrame (this);
-        if (plugView->attached (platformWindow.ptr, platformWindow.type) != Steinberg::kResultTrue) {
-            Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, "Attaching PlugView failed");
-        }
+    void invalidate() {
+        initialized = false;
     }
-    void onClose (Steinberg::Vst::EditorHost::IWindow& w) override {
-        SMTG_DBPRT1 ("onClose called (%p)\n", (void*)&w);
-        closePlugView ();
-        // TODO maybe quit only when the last window is closed
-        ///Steinberg::Vst::EditorHost::IPlatform::instance ().quit ();
+    bool is_initialized() const {
+        return initialized;
     }
-    void onResize (Steinberg::Vst::EditorHost::IWindow& w, Steinberg::Vst::EditorHost::Size newSize) override {
-        SMTG_DBPRT1 ("onResize called (%p)\n", (void*)&w);
-        if (plugView) {
-            Steinberg::ViewRect r {};
-            r.right = newSize.width;
-            r.bottom = newSize.height;
-            Steinberg::ViewRect r2 {};
-            if (plugView->getSize (&r2) == Steinberg::kResultTrue && std::memcmp(&r, &r2, sizeof(Steinberg::ViewRect)) != 0) {
-                plugView->onSize (&r);
-            }
-        }
+    bool is_port_in_range(int32 bus, int32 channel) const {
+        return bus >= 0 && bus < bus_count && channel >= 0 && channel < kMaxMidiChannels;
     }
-    Steinberg::Vst::EditorHost::Size constrainSize (Steinberg::Vst::EditorHost::IWindow& w, Steinberg::Vst::EditorHost::Size requestedSize) override {
-        SMTG_DBPRT1 ("constrainSize called (%p)\n", (void*)&w);
-        Steinberg::ViewRect r {};
-        r.right = requestedSize.width;
-        r.bottom = requestedSize.height;
-        if (plugView && plugView->checkSizeConstraint (&r) != Steinberg::kResultTrue)
-        {
-            plugView->getSize (&r);
+    Steinberg::Vst::ParamID parameter_id(int32 bus, int32 channel, int32 controller) const {
+        if (!is_port_in_range(bus, channel) || controller < 0 || controller >= Steinberg::Vst::kCountCtrlNumber) {
+            return Steinberg::Vst::kNoParamId;
         }
-        requestedSize.width = r.right - r.left;
-        requestedSize.height = r.bottom - r.top;
-        return requestedSize;
+        return parameter_ids[index(bus, channel, controller)];
     }
-    void onContentScaleFactorChanged (Steinberg::Vst::EditorHost::IWindow& window, float newScaleFactor) override {
-        SMTG_DBPRT1 ("onContentScaleFactorChanged called (%p)\n", (void*)&window);
-        Steinberg::FUnknownPtr<Steinberg::IPlugViewContentScaleSupport> css (plugView);
-        if (css) {
-            css->setContentScaleFactor (newScaleFactor);
-        }
+    static size_t index(int32 bus, int32 channel, int32 controller) {
+        return (size_t(bus) * kMaxMidiChannels + channel) * Steinberg::Vst::kCountCtrlNumber + controller;
     }
-    // IPlugFrame
-    Steinberg::tresult resizeView (Steinberg::IPlugView* view, Steinberg::ViewRect* newSize) override {
-        SMTG_DBPRT1 ("resizeView called (%p)\n", (void*)view);
-        if (newSize == nullptr || view == nullptr || view != plugView) {
-            return Steinberg::kInvalidArgument;
-        }
-        if (!window) {
-            return Steinberg::kInternalError;
-        }
-        if (resizeViewRecursionGard) {
-            return Steinberg::kResultFalse;
+    std::vector<Steinberg::Vst::ParamID> parameter_ids;
+    int32 bus_count = 0;
+    bool initialized = false;
+};
+
+/**
+ * One parameter change translated from a MIDI channel message, pending until
+ * the next process call.
+ */
+struct midi_parameter_change_t {
+    Steinberg::Vst::ParamID id;
+    Steinberg::int32 sample_offset;
+    Steinberg::Vst::ParamValue value;
+};
+
+/**
+ * Translates an event output by a plugin into the parts of a MIDI channel
+ * message, plus the event's sample offset and note ID (-1 if none). Note
+ * events keep their tuning as a fractional MIDI key, as for vst3note.
+ * Returns false for events that have no MIDI equivalent.
+ */
+static inline bool event_to_midi(const Steinberg::Vst::Event &event, MYFLT *fields) {
+    MYFLT &status = fields[0];
+    MYFLT &channel = fields[1];
+    MYFLT &data1 = fields[2];
+    MYFLT &data2 = fields[3];
+    fields[4] = event.sampleOffset;
+    fields[5] = -1;
+    switch (event.type) {
+    case Steinberg::Vst::Event::kNoteOnEvent:
+        status = 0x90;
+        channel = event.noteOn.channel;
+        data1 = event.noteOn.pitch + event.noteOn.tuning / MYFLT(100);
+        data2 = event.noteOn.velocity * MYFLT(127);
+        fields[5] = event.noteOn.noteId;
+        return true;
+    case Steinberg::Vst::Event::kNoteOffEvent:
+        status = 0x80;
+        channel = event.noteOff.channel;
+        data1 = event.noteOff.pitch + event.noteOff.tuning / MYFLT(100);
+        data2 = event.noteOff.velocity * MYFLT(127);
+        fields[5] = event.noteOff.noteId;
+        return true;
+    case Steinberg::Vst::Event::kPolyPressureEvent:
+        status = 0xA0;
+        channel = event.polyPressure.channel;
+        data1 = event.polyPressure.pitch;
+        data2 = event.polyPressure.pressure * MYFLT(127);
+        fields[5] = event.polyPressure.noteId;
+        return true;
+    case Steinberg::Vst::Event::kLegacyMIDICCOutEvent:
+        channel = event.midiCCOut.channel;
+        data1 = event.midiCCOut.value;
+        data2 = event.midiCCOut.value2;
+        if (event.midiCCOut.controlNumber < 128) {
+            status = 0xB0;
+            data1 = event.midiCCOut.controlNumber;
+            data2 = event.midiCCOut.value;
+        } else if (event.midiCCOut.controlNumber == Steinberg::Vst::kAfterTouch) {
+            status = 0xD0;
+        } else if (event.midiCCOut.controlNumber == Steinberg::Vst::kPitchBend) {
+            status = 0xE0;
+        } else if (event.midiCCOut.controlNumber == Steinberg::Vst::kCtrlProgramChange) {
+            status = 0xC0;
+        } else if (event.midiCCOut.controlNumber == Steinberg::Vst::kCtrlPolyPressure) {
+            status = 0xA0;
+        } else {
+            return false;
         }
-        Steinberg::ViewRect r;
-        if (plugView->getSize (&r) != Steinberg::kResultTrue) {
-            return Steinberg::kInternalError;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/**
+ * A fixed-size table of the notes sounding on one plugin, indexed both by
+ * note ID and by (channel, pitch), with O(1) insertion, lookup, and removal.
+ * Note IDs are assigned by the table, and encode the slot that holds the
+ * note, so that finding a note by ID is one indexed load. Notes on the same
+ * key are chained, most recent first.
+ */
+struct active_notes_t {
+    static constexpr Steinberg::int32 kCapacity = 1024;
+    static constexpr Steinberg::int32 kKeys = 16 * 128;
+    struct note_t {
+        Steinberg::int32 note_id;
+        Steinberg::int16 channel;
+        Steinberg::int16 pitch;
+        float tuning;
+        Steinberg::int32 previous;
+        Steinberg::int32 next;
+    };
+    active_notes_t() {
+        clear();
+    }
+    void clear() {
+        for (Steinberg::int32 slot = 0; slot < kCapacity; ++slot) {
+            notes[slot].note_id = -1;
+            free_slots[slot] = kCapacity - 1 - slot;
         }
-        if (std::memcmp(&r, newSize, sizeof(Steinberg::ViewRect)) == 0) {
-            return Steinberg::kResultTrue;
+        free_count = kCapacity;
+        key_heads.fill(-1);
+    }
+    /**
+     * Adds a note and returns its new note ID, or -1 if the table is full.
+     */
+    Steinberg::int32 add(Steinberg::int16 channel, Steinberg::int16 pitch, float tuning) {
+        if (free_count == 0) {
+            return -1;
         }
-        resizeViewRecursionGard = true;
-        Steinberg::Vst::EditorHost::Size size {newSize->right - newSize->left, newSize->bottom - newSize->top};
-        window->resize (size);
-        resizeViewRecursionGard = false;
-        if (plugView->getSize (&r) != Steinberg::kResultTrue) {
-            return Steinberg::kInternalError;
+        Steinberg::int32 slot = free_slots[--free_count];
+        serial = (serial + 1) % (INT32_MAX / kCapacity);
+        auto &note = notes[slot];
+        note.note_id = serial * kCapacity + slot;
+        note.channel = channel;
+        note.pitch = pitch;
+        note.tuning = tuning;
+        auto &head = key_heads[key(channel, pitch)];
+        note.previous = -1;
+        note.next = head;
+        if (head != -1) {
+            notes[head].previous = slot;
         }
-        if (std::memcmp(&r, newSize, sizeof(Steinberg::ViewRect)) != 0) {
-            plugView->onSize (newSize);
+        head = slot;
+        return note.note_id;
+    }
+    /**
+     * Returns the note with this ID, or nullptr if it is not sounding.
+     */
+    const note_t *find(Steinberg::int32 note_id) const {
+        if (note_id < 0) {
+            return nullptr;
         }
-        return Steinberg::kResultTrue;
+        const auto &note = notes[note_id % kCapacity];
+        return note.note_id == note_id ? &note : nullptr;
     }
-    void closePlugView () {
-        if (plugView) {
-            plugView->setFrame (nullptr);
-            if (plugView->removed () != Steinberg::kResultTrue) {
-                Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, "Removing PlugView failed");
-            }
-            plugView = nullptr;
+    /**
+     * Returns the ID of the most recent note sounding on this key, or -1.
+     */
+    Steinberg::int32 find(Steinberg::int16 channel, Steinberg::int16 pitch) const {
+        if (channel < 0 || channel >= 16 || pitch < 0 || pitch >= 128) {
+            return -1;
         }
-        window = nullptr;
+        auto slot = key_heads[key(channel, pitch)];
+        return slot == -1 ? -1 : notes[slot].note_id;
     }
-    Steinberg::tresult queryInterface (const Steinberg::TUID _iid, void** obj) override {
-        if (Steinberg::FUnknownPrivate::iidEqual (_iid, Steinberg::IPlugFrame::iid) ||
-                Steinberg::FUnknownPrivate::iidEqual (_iid, Steinberg::FUnknown::iid)) {
-            *obj = this;
-            addRef ();
-            return Steinberg::kResultTrue;
+    /**
+     * Removes the note with this ID; returns false if it is not sounding.
+     */
+    bool remove(Steinberg::int32 note_id) {
+        if (find(note_id) == nullptr) {
+            return false;
         }
-        if (window) {
-            return window->queryInterface (_iid, obj);
+        Steinberg::int32 slot = note_id % kCapacity;
+        auto &note = notes[slot];
+        if (note.previous != -1) {
+            notes[note.previous].next = note.next;
+        } else {
+            key_heads[key(note.channel, note.pitch)] = note.next;
         }
-        return Steinberg::kNoInterface;
+        if (note.next != -1) {
+            notes[note.next].previous = note.previous;
+        }
+        note.note_id = -1;
+        free_slots[free_count++] = slot;
+        return true;
     }
-    uint32 addRef () override {
-        return 1000;
+    Steinberg::int32 size() const {
+        return kCapacity - free_count;
     }
-    uint32 release () override {
-        return 1000;
+    static Steinberg::int32 key(Steinberg::int16 channel, Steinberg::int16 pitch) {
+        return (channel & 0xF) * 128 + (pitch & 0x7F);
     }
-    Steinberg::IPtr<Steinberg::IPlugView> plugView;
-    Steinberg::Vst::EditorHost::IWindow* window {nullptr};
-    bool resizeViewRecursionGard {false};
+    std::array<note_t, kCapacity> notes;
+    std::array<Steinberg::int32, kCapacity> free_slots;
+    Steinberg::int32 free_count;
+    std::array<Steinberg::int32, kKeys> key_heads;
+    Steinberg::int32 serial = 0;
 };
 
-//~ class App : public Steinberg::VST3::Hosting::IApplication
-//~ {
-//~ public:
-//~ ~App () noexcept override {
-//~ }
-//~ void init (const std::vector<std::string>& args) override {
-//~ }
-//~ void terminate () override {
-//~ }
-//~ private:
-//~ enum OpenFlags
-//~ {
-//~ kSetComponentHandler = 1 << 0,
-//~ kSecondWindow = 1 << 1,
-//~ };
-//~ void openEditor (const std::string& path, VST3::Optional<VST3::UID> effectID, uint32 flags) {
-//~ }
-//~ void createViewAndShow (IEditController* controller) {
-//~ }
-//~ Steinberg::VST3::Hosting::Module::Ptr module {nullptr};
-//~ Steinberg::IPtr<Steinberg::Vst::PlugProvider> plugProvider {nullptr};
-//~ Vst::HostApplication pluginContext;
-//~ std::shared_ptr<WindowController> windowController;
-//~ };
-
-//~ static Steinberg::Vst::EditorHost::AppInit gInit (std::make_unique<App> ());
-
-#endif
-
-// This currently is a dummy implementation.
-
-class ComponentHandler : public Steinberg::Vst::IComponentHandler
-{
+/**
+ * Maps a whole file read-only into memory, so that large files can be read
+ * without copying, and only the pages actually touched are read from disk.
+ */
+class memory_mapped_file_t {
 public:
-    Steinberg::tresult PLUGIN_API beginEdit (Steinberg::Vst::ParamID id) override {
-        SMTG_DBPRT1 ("beginEdit called (%d)\n", id);
-        return Steinberg::kNotImplemented;
-    }
-    Steinberg::tresult PLUGIN_API performEdit (Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue valueNormalized) override {
-        SMTG_DBPRT2 ("performEdit called (%d, %f)\n", id, valueNormalized);
-        return Steinberg::kNotImplemented;
-    }
-    Steinberg::tresult PLUGIN_API endEdit (Steinberg::Vst::ParamID id) override {
-        SMTG_DBPRT1 ("endEdit called (%d)\n", id);
-        return Steinberg::kNotImplemented;
+    memory_mapped_file_t() {}
+    memory_mapped_file_t(memory_mapped_file_t const&) = delete;
+    void operator=(memory_mapped_file_t const&) = delete;
+    ~memory_mapped_file_t() {
+        close();
     }
-    Steinberg::tresult PLUGIN_API restartComponent (Steinberg::int32 flags) override {
-        SMTG_DBPRT1 ("restartComponent called (%d)\n", flags);
-        return Steinberg::kNotImplemented;
+    bool open(const std::string &filepath) {
+        close();
+#if defined(_WIN32)
+        file = CreateFileA(filepath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE) {
+            return false;
+        }
+        LARGE_INTEGER file_size;
+        if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        size_ = static_cast<size_t>(file_size.QuadPart);
+        mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (mapping == nullptr) {
+            close();
+            return false;
+        }
+        data_ = static_cast<const uint8_t *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+#else
+        file = ::open(filepath.c_str(), O_RDONLY);
+        if (file == -1) {
+            return false;
+        }
+        struct stat file_status;
+        if (fstat(file, &file_status) != 0 || file_status.st_size == 0) {
+            close();
+            return false;
+        }
+        size_ = static_cast<size_t>(file_status.st_size);
+        void *address = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, file, 0);
+        data_ = address == MAP_FAILED ? nullptr : static_cast<const uint8_t *>(address);
+#endif
+        if (data_ == nullptr) {
+            close();
+            return false;
+        }
+        return true;
     }
-private:
-    Steinberg::tresult PLUGIN_API queryInterface (const Steinberg::TUID /*_iid*/, void** /*obj*/) override {
-        return Steinberg::kNoInterface;
+    void close() {
+#if defined(_WIN32)
+        if (data_) {
+            UnmapViewOfFile(data_);
+        }
+        if (mapping) {
+            CloseHandle(mapping);
+        }
+        if (file != INVALID_HANDLE_VALUE) {
+            CloseHandle(file);
+        }
+        mapping = nullptr;
+        file = INVALID_HANDLE_VALUE;
+#else
+        if (data_) {
+            munmap(const_cast<uint8_t *>(data_), size_);
+        }
+        if (file != -1) {
+            ::close(file);
+        }
+        file = -1;
+#endif
+        data_ = nullptr;
+        size_ = 0;
     }
-    Steinberg::uint32 PLUGIN_API addRef () override {
-        return 1000;
+    const uint8_t *data() const {
+        return data_;
     }
-    Steinberg::uint32 PLUGIN_API release () override {
-        return 1000;
+    size_t size() const {
+        return size_;
     }
+private:
+#if defined(_WIN32)
+    HANDLE file = INVALID_HANDLE_VALUE;
+    HANDLE mapping = nullptr;
+#else
+    int file = -1;
+#endif
+    const uint8_t *data_ = nullptr;
+    size_t size_ = 0;
 };
 
 /**
- * This class manages one instance of one plugin and all of its
- * communications with Csound, including audio input and output,
- * MIDI input and output, and parameter input and output.
+ * One page-aligned block of anonymous memory, from which a plugin's buffers
+ * are taken in order at cache line boundaries, so that its per-block working
+ * set is contiguous. Optionally, the memory is taken from huge pages (falling
+ * back to normal pages if there are none), locked so that it is never paged
+ * out, and prefaulted so that the first blocks do not fault.
  */
-struct vst3_plugin_t  {
-    vst3_plugin_t() {};
-    virtual ~vst3_plugin_t() {
-#if DEBUGGING
-        std::fprintf(stderr, "vst3_plugin_t::~vst3_plugin_t.\n");
-#endif
+class buffer_arena_t {
+public:
+    static constexpr size_t kCacheLine = 64;
+    buffer_arena_t() {}
+    buffer_arena_t(buffer_arena_t const&) = delete;
+    void operator=(buffer_arena_t const&) = delete;
+    ~buffer_arena_t() {
+        free();
     }
-    void preprocess(int64_t continousFrames) {
-#if PROCESS_TRACING
-        csound->Message(csound, "vst3_plugin_t::preprocess: hostProcessData.numSamples: %d.\n", hostProcessData.numSamples);
-#endif
-        hostProcessData.numSamples = blockSize;
-        processContext.continousTimeSamples = continousFrames;
-        paramTransferrer.transferChangesTo(inputParameterChanges);
-#if PARAMETER_TRACING
-        // Making sure the parameter changes made it down to the bottom of
-        // the stack, and will get to the processor...
-        auto input_parameter_count = hostProcessData.inputParameterChanges->getParameterCount();
-        for (auto parameter_index = 0; parameter_index < input_parameter_count; ++parameter_index) {
-            auto queue_for_parameter = hostProcessData.inputParameterChanges->getParameterData(parameter_index);
-            auto parameter_id = queue_for_parameter->getParameterId();
-            auto parameter_point_count = queue_for_parameter->getPointCount();
-            for (auto point_index = 0; point_index < parameter_point_count; ++point_index) {
-                int sample_offset;
-                double parameter_value;
-                queue_for_parameter->getPoint(point_index, sample_offset, parameter_value);
-                csound->Message(csound, "vst3_plugin_t::preprocess: parameter id: %-16d sample offset: %-16d parameter_value: %9.4f\n",
-                                parameter_id,
-                                sample_offset,
-                                parameter_value);
-                // Pass on to EditController.
-                controller->setParamNormalized(parameter_id, parameter_value);
+    static size_t round_up(size_t size, size_t alignment) {
+        return (size + alignment - 1) / alignment * alignment;
+    }
+    /**
+     * Replaces any previous memory with at least size bytes of zeros.
+     */
+    bool allocate(size_t size) {
+        free();
+        if (size == 0) {
+            return true;
+        }
+#if defined(_WIN32)
+        SYSTEM_INFO system_info;
+        GetSystemInfo(&system_info);
+        size_t page_size = system_info.dwPageSize;
+        if (huge_pages) {
+            // Requires the "Lock pages in memory" privilege; large pages
+            // are always locked.
+            size_t large_page_size = GetLargePageMinimum();
+            if (large_page_size > 0) {
+                size_ = round_up(size, large_page_size);
+                data_ = static_cast<uint8_t *>(VirtualAlloc(nullptr, size_, MEM_RESERVE | MEM_COMMIT | MEM_LARGE_PAGES, PAGE_READWRITE));
+                on_huge_pages_ = locked_ = data_ != nullptr;
+            }
+        }
+        if (data_ == nullptr) {
+            size_ = round_up(size, page_size);
+            data_ = static_cast<uint8_t *>(VirtualAlloc(nullptr, size_, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE));
+        }
+        if (data_ == nullptr) {
+            size_ = 0;
+            return false;
+        }
+        if (lock_memory && !locked_) {
+            locked_ = VirtualLock(data_, size_) != 0;
+        }
+#else
+        size_t page_size = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#if defined(MAP_HUGETLB)
+        if (huge_pages) {
+            size_ = round_up(size, kHugePageSize);
+            void *address = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+            if (address != MAP_FAILED) {
+                data_ = static_cast<uint8_t *>(address);
+                on_huge_pages_ = true;
             }
         }
 #endif
-    }
-    void postprocess() {
-        inputEventList.clear();
-        outputEventList.clear();
-        inputParameterChanges.clearQueue();
-        outputParameterChanges.clearQueue();
-    }
-    bool process(int64_t continuous_frames) {
-#if PROCESS_TRACING
-        csound->Message(csound, "vst3_plugin_t::process: time in frames: %ld.\n", continuous_frames);
+        if (data_ == nullptr) {
+            size_ = round_up(size, page_size);
+            void *address = mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+            if (address == MAP_FAILED) {
+                size_ = 0;
+                return false;
+            }
+            data_ = static_cast<uint8_t *>(address);
+#if defined(MADV_HUGEPAGE)
+            // Transparent huge pages, if the system allows them.
+            if (huge_pages) {
+                madvise(data_, size_, MADV_HUGEPAGE);
+            }
 #endif
-        if (!processor || !isProcessing) {
-            csound->Message(csound, "vst3_plugin_t::process: no processor or not processing!\n");
-            return false;
         }
-        preprocess(continuous_frames);
-        auto result = processor->process(hostProcessData);
-        if (result != Steinberg::kResultOk) {
-            csound->Message(csound, "vst3_plugin_t::process: returned not OK!\n");
-            return false;
+        if (lock_memory) {
+            locked_ = mlock(data_, size_) == 0;
+        }
+#endif
+        if (prefault) {
+            // Writing each page makes the system map it now.
+            for (size_t offset = 0; offset < size_; offset += page_size) {
+                static_cast<volatile uint8_t *>(data_)[offset] = 0;
+            }
         }
-        postprocess();
         return true;
     }
-    bool setSamplerate(double value) {
-        if (sampleRate == value) {
-            return true;
-        }
-        sampleRate = value;
-        processContext.sampleRate = sampleRate;
-        if (blockSize == 0) {
-            return true;
+    void free() {
+        if (data_) {
+#if defined(_WIN32)
+            if (locked_ && !on_huge_pages_) {
+                VirtualUnlock(data_, size_);
+            }
+            VirtualFree(data_, 0, MEM_RELEASE);
+#else
+            if (locked_) {
+                munlock(data_, size_);
+            }
+            munmap(data_, size_);
+#endif
         }
-        return update_process_setup();
+        data_ = nullptr;
+        size_ = 0;
+        used_ = 0;
+        locked_ = false;
+        on_huge_pages_ = false;
     }
     /**
-     * Here the host (this) creates buffers for hostProcessData.
+     * Returns the next size bytes, starting on a cache line, or nullptr if
+     * the arena is full.
      */
-    bool create_audio_buffers(Steinberg::int32 value) {
-        blockSize = value;
-        if (sampleRate == 0) {
-            return true;
+    void *take(size_t size) {
+        size_t offset = round_up(used_, kCacheLine);
+        if (data_ == nullptr || offset + size > size_) {
+            return nullptr;
         }
-        if (processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue) {
-            plugin_sample_size = Steinberg::Vst::kSample64;
-        } else {
-            plugin_sample_size = Steinberg::Vst::kSample32;
+        used_ = offset + size;
+        return data_ + offset;
+    }
+    size_t size() const {
+        return size_;
+    }
+    bool locked() const {
+        return locked_;
+    }
+    bool on_huge_pages() const {
+        return on_huge_pages_;
+    }
+    // Options, which apply to the next allocation.
+    bool lock_memory = false;
+    bool prefault = false;
+    bool huge_pages = false;
+private:
+    static constexpr size_t kHugePageSize = 2 * 1024 * 1024;
+    uint8_t *data_ = nullptr;
+    size_t size_ = 0;
+    size_t used_ = 0;
+    bool locked_ = false;
+    bool on_huge_pages_ = false;
+};
+
+/**
+ * One MIDI channel message from a Standard MIDI File, with its time in
+ * seconds from the start of the file.
+ */
+struct smf_event_t {
+    double time;
+    uint8_t status;
+    uint8_t data1;
+    uint8_t data2;
+};
+
+/**
+ * Reads the channel messages of a Standard MIDI File (format 0 or 1) in time
+ * order, one at a time, directly from a memory-mapped file. Tracks are
+ * merged as they are read, and the tempo map is applied as it is reached,
+ * so nothing is parsed ahead of the current event.
+ */
+class smf_reader_t {
+public:
+    bool open(const std::string &filepath) {
+        if (!file.open(filepath)) {
+            return false;
         }
-        // This is what actually allocates the audio buffers.
-        // HostProcessData looks up the Component's BusInfos and creates
-        // buffers accordingly. The hostProcessData number of inputs and
-        // outputs must already have been assigned.
-        hostProcessData.numInputs = 1;
-        hostProcessData.numOutputs = 1;
-        auto result = hostProcessData.prepare(*component, blockSize, plugin_sample_size);
-        /// result = update_process_setup();
-        csound->Message(csound, "vst3_plugin::create_audio_buffers: plugin_sample_size: %s\n", plugin_sample_size ? "64 bits" : "32 bits");
-        csound->Message(csound, "vst3_plugin::create_audio_buffers: sampleRate:         %9.3f\n", sampleRate);
-        csound->Message(csound, "vst3_plugin::create_audio_buffers: blockSize:          %9d\n", blockSize);
-        csound->Message(csound, "vst3_plugin::create_audio_buffers: input busses:       %9d\n", hostProcessData.numInputs);
-        csound->Message(csound, "vst3_plugin::create_audio_buffers: output busses:      %9d\n", hostProcessData.numOutputs);
-        return result;
+        const uint8_t *position = file.data();
+        const uint8_t *end = position + file.size();
+        if (file.size() < 14 || std::memcmp(position, "MThd", 4) != 0) {
+            return false;
+        }
+        uint32_t header_size = read_uint32(position + 4);
+        uint16_t track_count = read_uint16(position + 10);
+        division = read_uint16(position + 12);
+        if (division == 0) {
+            return false;
+        }
+        position += 8 + header_size;
+        tracks.clear();
+        while (position + 8 <= end && tracks.size() < track_count) {
+            uint32_t chunk_size = read_uint32(position + 4);
+            const uint8_t *chunk_data = position + 8;
+            const uint8_t *chunk_end = chunk_data + std::min<size_t>(chunk_size, end - chunk_data);
+            if (std::memcmp(position, "MTrk", 4) == 0) {
+                track_t track;
+                track.position = chunk_data;
+                track.end = chunk_end;
+                read_delta(track);
+                tracks.push_back(track);
+            }
+            position = chunk_end;
+        }
+        tempo = 500000;
+        tick = 0;
+        seconds = 0;
+        return !tracks.empty();
     }
-    // It is assumed that "values" may be in musical units and ranges, and
-    // such must be normalized.  Note that `id` is `id`, and not an index.
-    // Note also that many parameters one might think are not normalized,
-    // _are_ normalized (legacy code).
-    void setParameter(Steinberg::int32 id, double value, Steinberg::int32 sampleOffset) {
-        double normalized_value = controller->plainParamToNormalized(id, value);
-#if PARAMETER_TRACING
-        csound->Message(csound, "vst3_plugin_t::setParameter: id: %9d  value: %9.4f normalized: %9.4f offset: %d\n",
-                        id,
-                        value,
-                        normalized_value,
-                        sampleOffset);
-#endif
-        // Handle program changes.
-        // The controller is queried and its parameters are sent to the processor.
-        Steinberg::Vst::ParameterInfo parameter_info;
-        controller->getParameterInfo(id, parameter_info);
-#if PARAMETER_TRACING
-        csound->Message(csound, "vst3_plugin_t::setParameter: getParameterInfo: id: %9d  flags: %d program change? %d\n",
-                        parameter_info.id, parameter_info.flags, (parameter_info.flags & parameter_info.kIsProgramChange));
-#endif
-        if (id == program_change_id) {
-            auto controller_parameter_count = controller->getParameterCount();
-            for (auto controller_parameter = 0; controller_parameter < controller_parameter_count; ++controller_parameter) {
-                auto result = controller->getParameterInfo(controller_parameter, parameter_info);
-                // This all happens between process calls.
-                if (!(parameter_info.flags & parameter_info.kIsProgramChange)) {
-                    auto id = parameter_info.id;
-                    auto normalized_value = controller->getParamNormalized(id);
-                    paramTransferrer.addChange(id, normalized_value, 0);
-#if PARAMETER_TRACING
-                    csound->Message(csound, "vst3_plugin_t::setParameter: preset change from controller: id: %9d  normalized value: %9.4f\n",
-                                    id, normalized_value);
-#endif
+    /**
+     * Reads the next channel message; returns false at the end of the file.
+     */
+    bool next(smf_event_t &event) {
+        for (;;) {
+            track_t *track = nullptr;
+            for (auto &candidate : tracks) {
+                if (!candidate.done && (track == nullptr || candidate.tick < track->tick)) {
+                    track = &candidate;
                 }
             }
-#if PARAMETER_TRACING
-            csound->Message(csound, "vst3_plugin_t::setParameter: handling program change...\n");
-#endif
-            Steinberg::FUnknownPtr<Steinberg::Vst::IEditControllerHostEditing> host_controller(controller);
-            if (host_controller) {
-#if PARAMETER_TRACING
-                csound->Message(csound, "vst3_plugin_t::setParameter: got IEditControllerHostEditing.\n");
-#endif
-                host_controller->beginEditFromHost(id);
+            if (track == nullptr) {
+                return false;
             }
-            component->setActive(false);
-            processor->setProcessing(false);
-            controller->setParamNormalized(id, normalized_value);
-#if PARAMETER_TRACING
-            csound->Message(csound, "vst3_plugin_t::setParameter: IEditController::setParamNormalized: id: %9d normalized_value: %9.4f.\n", id, normalized_value);
-#endif
-            if (host_controller) {
-                host_controller->endEditFromHost(id);
+            advance_time(track->tick);
+            if (read_event(*track, event)) {
+                event.time = seconds;
+                read_delta(*track);
+                return true;
             }
-            processor->setProcessing(true);
-            component->setActive(true);
+            read_delta(*track);
         }
-        paramTransferrer.addChange(id, normalized_value, sampleOffset);
-#if PARAMETER_TRACING
-        csound->Message(csound, "vst3_plugin_t::setParameter: ParameterChangeTransfer::addChange: id: %9d normalized_value: %9.4f sample offset: %9d.\n", id, normalized_value, sampleOffset);
-#endif
     }
-    bool initialize(CSOUND *csound_, const VST3::Hosting::ClassInfo &classInfo_, Steinberg::Vst::PlugProvider *provider_) {
-        csound = csound_;
-        provider = provider_;
-        classInfo = classInfo_;
-        component_class_id = Steinberg::FUID{ classInfo.ID().data() };
-        processor_class_id = component_class_id;
-        component = provider->getComponent();
-        controller = provider->getController();
-        Steinberg::TUID controllerClassTUID;
-        if (component->getControllerClassId(controllerClassTUID) != Steinberg::kResultOk) {
-            csound->Message(csound, "vst3_plugin_t::initialize: This component does not export an edit controller class ID!\n");
-        }
-        controller_class_id = Steinberg::FUID{ controllerClassTUID };
-#if EDITOR_IMPLEMENTED
-        if (controller) {
-            controller->setComponentHandler(component_handler());
-        }
-#endif
-        if (controller) {
-            controller->setComponentHandler(component_handler());
+private:
+    struct track_t {
+        const uint8_t *position = nullptr;
+        const uint8_t *end = nullptr;
+        uint64_t tick = 0;
+        uint8_t running_status = 0;
+        bool done = false;
+    };
+    static uint32_t read_uint32(const uint8_t *data) {
+        return (uint32_t(data[0]) << 24) | (uint32_t(data[1]) << 16) | (uint32_t(data[2]) << 8) | uint32_t(data[3]);
+    }
+    static uint16_t read_uint16(const uint8_t *data) {
+        return uint16_t((data[0] << 8) | data[1]);
+    }
+    static bool read_variable_length(track_t &track, uint32_t &value) {
+        value = 0;
+        for (int i = 0; i < 4; ++i) {
+            if (track.position >= track.end) {
+                return false;
+            }
+            uint8_t byte = *track.position++;
+            value = (value << 7) | (byte & 0x7F);
+            if ((byte & 0x80) == 0) {
+                return true;
+            }
         }
-        processor = component.get();
-        Steinberg::FUnknownPtr<Steinberg::Vst::IMidiMapping> midiMapping(controller);
-        initProcessData();
-        paramTransferrer.setMaxParameters(1000);
-        // midiCCMapping = initMidiCtrlerAssignment(component, midiMapping);
-        information(false);
-        csound->Message(csound, "vst3_plugin_t::initialize completed.\n");
-        return true;
+        return false;
     }
-    void terminate() {
-        if (!processor) {
+    void read_delta(track_t &track) {
+        uint32_t delta;
+        if (track.done || !read_variable_length(track, delta)) {
+            track.done = true;
             return;
         }
-        processor->setProcessing(false);
-        component->setActive(false);
-    }
-    void initProcessData() {
-        hostProcessData.inputEvents = &inputEventList;
-        hostProcessData.outputEvents = &outputEventList;
-        hostProcessData.inputParameterChanges = &inputParameterChanges;
-        hostProcessData.outputParameterChanges = &outputParameterChanges;
-        hostProcessData.processContext = &processContext;
-        initProcessContext();
+        track.tick += delta;
     }
-    void initProcessContext() {
-        processContext = {};
-        // Csound's default tempo is one beat per second.
-        processContext.tempo = 60;
+    void advance_time(uint64_t new_tick) {
+        if (division & 0x8000) {
+            // SMPTE time: frames per second times ticks per frame.
+            double ticks_per_second = -int8_t(division >> 8) * double(division & 0xFF);
+            seconds = new_tick / ticks_per_second;
+        } else {
+            seconds += (new_tick - tick) * (tempo / (division * 1000000.));
+        }
+        tick = new_tick;
     }
-    bool update_process_setup() {
-        if (!processor) {
-            csound->Message(csound, "vst3_plugin_t::update_process_setup: null IProcessor.\n");
+    // Returns true only for channel messages; applies tempo changes.
+    bool read_event(track_t &track, smf_event_t &event) {
+        if (track.position >= track.end) {
+            track.done = true;
             return false;
         }
-        if (isProcessing) {
-            if (processor->setProcessing(false) != Steinberg::kResultOk) {
-                csound->Message(csound, "vst3_plugin_t::update_process_setup: Could not stop processing.\n");
+        uint8_t status = *track.position;
+        if (status & 0x80) {
+            track.position++;
+        } else {
+            status = track.running_status;
+        }
+        if (status == 0xFF) {
+            if (track.position >= track.end) {
+                track.done = true;
                 return false;
             }
-            if (component->setActive(false) != Steinberg::kResultOk) {
-                csound->Message(csound, "vst3_plugin_t::setActive: Could not deactivate component.\n");
+            uint8_t type = *track.position++;
+            uint32_t length;
+            if (!read_variable_length(track, length) || length > size_t(track.end - track.position)) {
+                track.done = true;
                 return false;
             }
+            if (type == 0x51 && length == 3) {
+                tempo = (uint32_t(track.position[0]) << 16) | (uint32_t(track.position[1]) << 8) | uint32_t(track.position[2]);
+            } else if (type == 0x2F) {
+                track.done = true;
+            }
+            track.position += length;
+            return false;
         }
-        Steinberg::Vst::ProcessSetup setup;
-        csound->Message(csound, "vst3_plugin_t::update_process_setup: canProcessSampleSize.\n");
-        if (processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue) {
-            plugin_sample_size = Steinberg::Vst::kSample64;
-            csound->Message(csound, "vst3_plugin_t::update_process_setup: processing 64 bit samples.\n");
-            setup.symbolicSampleSize = Steinberg::Vst::kSample64;
-        } else {
-            plugin_sample_size = Steinberg::Vst::kSample32;
-            csound->Message(csound, "vst3_plugin_t::update_process_setup: processing 32 bit samples.\n");
-            setup.symbolicSampleSize = Steinberg::Vst::kSample32;
+        if (status == 0xF0 || status == 0xF7) {
+            uint32_t length;
+            if (!read_variable_length(track, length) || length > size_t(track.end - track.position)) {
+                track.done = true;
+                return false;
+            }
+            track.position += length;
+            return false;
         }
-
-        // Request the VST3 plugin to adapt to the opcode's inputs and outputs. If that doesn't work,
-        // reset the bus arrangements according to what the plugin actually has implemented, and Csound
-        // will adapt to that.
-
-        int32 numInputs = csound->GetNchnls_i(csound);
-        int32 numOutputs = csound->GetNchnls(csound);
-        std::vector<Steinberg::Vst::SpeakerArrangement> inputArrangements(csound->GetNchnls_i(csound), 0x7FFFFFFF); /// Steinberg::Vst::kSpeakerArrUserDefined);
-        std::vector<Steinberg::Vst::SpeakerArrangement> outputArrangements(csound->GetNchnls(csound), 0x7FFFFFFF); /// Steinberg::Vst::kSpeakerArrUserDefined);
-        auto result = processor->setBusArrangements(
-                          inputArrangements.data(), static_cast<int32>(inputArrangements.size()),
-                          outputArrangements.data(), static_cast<int32>(outputArrangements.size()));
-        if (result == Steinberg::kResultOk) {
-            csound->Message(csound, "setBusArrangements succeeded.\n");
-        } else {
-            csound->Message(csound, "Warning: setBusArrangements returned %d.\n", result);
-            result = configureBusArrangementsFromPlugin(component, processor);
-            csound->Message(csound, "Setting bus arrangements from plugin returned %d.\n", result);
+        if ((status & 0x80) == 0) {
+            // Data byte with no running status.
+            track.done = true;
+            return false;
         }
-        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kInput, 0, false);
-        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kOutput, 0, false);
-        result = component->activateBus(Steinberg::Vst::kAudio, Steinberg::Vst::kInput, 0, false);
-        result = component->activateBus(Steinberg::Vst::kAudio, Steinberg::Vst::kOutput, 0, false);
-        setup.processMode = Steinberg::Vst::kRealtime;
-        setup.maxSamplesPerBlock = blockSize;
-        setup.sampleRate = sampleRate;
-        if (processor->setupProcessing(setup) != Steinberg::kResultOk) {
-            csound->Message(csound, "vst3_plugin_t::update_process_setup: setupProcessing returned not OK.\n");
-            return false;
-        }
-        csound->Message(csound, "vst3_plugin_t::update_process_setup: activateBus.\n");
-        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kInput, 0, true);
-        csound->Message(csound, "activateBus(kEvent, kInput, 0)  returned %d\n", result);
-        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kOutput, 0, true);
-        csound->Message(csound, "activateBus(kEvent, kOutput, 0) returned %d\n", result);
-        result = component->activateBus(Steinberg::Vst::kAudio, Steinberg::Vst::kInput, 0, true);
-        csound->Message(csound, "activateBus(kAudio, kInput, 0)  returned %d\n", result);
-        result = component->activateBus(Steinberg::Vst::kAudio, Steinberg::Vst::kOutput, 0, true);
-        csound->Message(csound, "activateBus(kAudio, kOutput, 0) returned %d\n", result);
-        if (component->setActive(true) != Steinberg::kResultOk) {
-            csound->Message(csound, "vst3_plugin_t::update_process_setup: setActive returned not OK.\n");
+        track.running_status = status;
+        int data_count = ((status & 0xE0) == 0xC0) ? 1 : 2;
+        if (track.end - track.position < data_count) {
+            track.done = true;
             return false;
         }
-        result = processor->setProcessing(true);
-        csound->Message(csound, "vst3_plugin_t::update_process_setup: setProcessing returned %d.\n", result);
-        if (result == Steinberg::kResultOk) {
-            isProcessing = true;
-        } else {
-            isProcessing = false;
-        }
-        return isProcessing;
+        event.status = status;
+        event.data1 = track.position[0] & 0x7F;
+        event.data2 = data_count == 2 ? (track.position[1] & 0x7F) : 0;
+        track.position += data_count;
+        return true;
     }
-    bool isPortInRange(int32 port, int32 channel) const {
-        return port < kMaxMidiMappingBusses && !midiCCMapping[port][channel].empty();
+    memory_mapped_file_t file;
+    std::vector<track_t> tracks;
+    uint16_t division = 0;
+    uint32_t tempo = 500000;
+    uint64_t tick = 0;
+    double seconds = 0;
+};
+
+/**
+ * A bounded, lock-free queue that any number of threads may push to and pop
+ * from (Dmitry Vyukov's algorithm). Capacity must be a power of 2. Neither
+ * push nor pop ever waits; push returns false if the queue is full, and pop
+ * returns false if it is empty.
+ */
+template<typename T, size_t kCapacity>
+class bounded_queue_t {
+    static_assert((kCapacity & (kCapacity - 1)) == 0, "Capacity must be a power of 2.");
+    static constexpr size_t kMask = kCapacity - 1;
+public:
+    bounded_queue_t() {
+        for (size_t index = 0; index < kCapacity; ++index) {
+            cells[index].sequence.store(index, std::memory_order_relaxed);
+        }
     }
-#if EDITOR_IMPLEMENTED
-    bool processVstEvent(const Steinberg::Vst::IMidiClient::Event& event, int32 port) {
-        auto vstEvent = Steinberg::Vst::midiToEvent(event.type, event.channel, event.data0, event.data1);
-        if (vstEvent) {
-            vstEvent->busIndex = port;
-            if (inputEventList.addEvent(*vstEvent) != Steinberg::kResultOk) {
-                assert(false && "Event was not added to EventList!");
+    bool push(const T &data) {
+        cell_t *cell;
+        size_t position = enqueue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[position & kMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = intptr_t(sequence) - intptr_t(position);
+            if (difference == 0) {
+                if (enqueue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = enqueue_position.load(std::memory_order_relaxed);
             }
-            return true;
         }
-        return false;
+        cell->data = data;
+        cell->sequence.store(position + 1, std::memory_order_release);
+        return true;
     }
-    bool processParamChange(const Steinberg::Vst::IMidiClient::Event& event, int32 port) {
-        auto paramMapping = [port, this](int32 channel, Steinberg::Vst::MidiData data1) -> Steinberg::Vst::ParamID {
-            if (!isPortInRange(port, channel)) {
-                return Steinberg::Vst::kNoParamId;
-            }
-            return midiCCMapping[port][channel][data1];
-        };
-        auto paramChange =
-            Steinberg::Vst::midiToParameter(event.type, event.channel, event.data0, event.data1, paramMapping);
-        if (paramChange) {
-            int32 index = 0;
-            Steinberg::Vst::IParamValueQueue* queue =
-                inputParameterChanges.addParameterData((*paramChange).first, index);
-            if (queue) {
-                if (queue->addPoint(event.timestamp,(*paramChange).second, index) != Steinberg::kResultOk) {
-                    assert(false && "Parameter point was not added to ParamValueQueue!");
+    bool pop(T &data) {
+        cell_t *cell;
+        size_t position = dequeue_position.load(std::memory_order_relaxed);
+        for (;;) {
+            cell = &cells[position & kMask];
+            size_t sequence = cell->sequence.load(std::memory_order_acquire);
+            intptr_t difference = intptr_t(sequence) - intptr_t(position + 1);
+            if (difference == 0) {
+                if (dequeue_position.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) {
+                    break;
                 }
+            } else if (difference < 0) {
+                return false;
+            } else {
+                position = dequeue_position.load(std::memory_order_relaxed);
             }
-            return true;
         }
-        return false;
+        data = cell->data;
+        cell->sequence.store(position + kMask + 1, std::memory_order_release);
+        return true;
     }
-#endif
-    void information(bool print) {
-        Steinberg::TUID controllerClassTUID;
-        if (controller_class_id.isValid() == false) {
-            csound->Message(csound, "vst3_plugin_t: The edit controller class has no valid UID!\n");
+private:
+    struct cell_t {
+        std::atomic<size_t> sequence;
+        T data;
+    };
+    std::array<cell_t, kCapacity> cells;
+    alignas(64) std::atomic<size_t> enqueue_position{0};
+    alignas(64) std::atomic<size_t> dequeue_position{0};
+};
+
+struct controller_refresh_t;
+struct preset_save_request_t;
+
+/**
+ * A job posted to the worker from the performance thread. It is a fixed
+ * record rather than a closure, so that posting it neither allocates nor
+ * frees; see run_worker_job.
+ */
+struct worker_job_t {
+    enum kind_t {
+        kNone,
+        kSavePreset,
+        kRestart,
+        kReset,
+        kFreeRefresh
+    };
+    kind_t kind = kNone;
+    vst3_plugin_t *plugin = nullptr;
+    preset_save_request_t *save_request = nullptr;
+    controller_refresh_t *refresh = nullptr;
+    int32_t flags = 0;
+    // The order in which the job was posted; see vst3_worker_t::run.
+    uint64_t ticket = 0;
+};
+
+static void run_worker_job(const worker_job_t &job);
+
+/**
+ * One background thread that runs jobs in the order they were posted, so
+ * that slow work -- file i/o, parsing, plugin state changes -- is kept off
+ * Csound's performance thread. The thread is started by the first job.
+ * Jobs still queued when the worker is stopped are run before it exits.
+ * Jobs from the performance thread go through a preallocated mailbox, and
+ * other jobs through a queue of closures.
+ */
+class vst3_worker_t {
+public:
+    vst3_worker_t() {}
+    vst3_worker_t(vst3_worker_t const&) = delete;
+    void operator=(vst3_worker_t const&) = delete;
+    ~vst3_worker_t() {
+        stop();
+    }
+    void post(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            jobs.push_back({tickets.fetch_add(1, std::memory_order_acq_rel), std::move(job)});
+            start();
         }
-        // Class information.
-        if (print == true) {
-            char buffer[0x200];
-            component_class_id.toRegistryString(buffer);
-            csound->Message(csound, "vst3_plugin_t: class:      component class id:  %s\n", buffer);
-            // Same as Component class ID.
-            csound->Message(csound, "               class:      processor class id:  %s\n", buffer);
-            controller_class_id.toRegistryString(buffer);
-            csound->Message(csound, "               class:      controller class id: %s\n", buffer);
-            csound->Message(csound, "               class:      cardinality:         %i\n", classInfo.cardinality());
-            csound->Message(csound, "               class:      category:            %s\n", classInfo.category().c_str());
-            csound->Message(csound, "               class:      name:                %s\n", classInfo.name().c_str());
-            csound->Message(csound, "               class:      vendor:              %s\n", classInfo.vendor().c_str());
-            csound->Message(csound, "               class:      version:             %s\n", classInfo.version().c_str());
-            csound->Message(csound, "               class:      sdkVersion:          %s\n", classInfo.sdkVersion().c_str());
-            csound->Message(csound, "               class:      subCategoriesString: %s\n", classInfo.subCategoriesString().c_str());
-            csound->Message(csound, "               class:      classFlags:          %i\n", classInfo.classFlags());
-            csound->Message(csound, "               can process 32 bit samples: %s\n", processor->canProcessSampleSize(Steinberg::Vst::kSample32) == Steinberg::kResultTrue ? "yes" : "no");
-            csound->Message(csound, "               can process 64 bit samples: %s\n", processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue ? "yes" : "no");
-            csound->Message(csound, "               Csound samples: %d bits\n", int((sizeof(MYFLT) * 8)));
-            // Input and output busses.
-            // There is no ID in a BusInfo.
-            int32 n = component->getBusCount( Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kInput);
-            for (int32 i = 0; i < n; i++) {
-                Steinberg::Vst::BusInfo busInfo = {};
-                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kInput, i, busInfo);
-                auto name = VST3::StringConvert::convert(busInfo.name);
-                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
-                                i,
-                                busInfo.direction == 0 ? "Input " : "Output",
-                                busInfo.mediaType == 0 ? "Audio" : "Event",
-                                busInfo.channelCount,
-                                busInfo.busType == 0 ? "Main" : "Aux ",
-                                busInfo.flags,
-                                name.data());
-            }
-            n = component->getBusCount( Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kInput);
-            for (int32 i = 0; i < n; i++) {
-                Steinberg::Vst::BusInfo busInfo = {};
-                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kInput, i, busInfo);
-                auto name = VST3::StringConvert::convert(busInfo.name);
-                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
-                                i,
-                                busInfo.direction == 0 ? "Input " : "Output",
-                                busInfo.mediaType == 0 ? "Audio" : "Event",
-                                busInfo.channelCount,
-                                busInfo.busType == 0 ? "Main" : "Aux ",
-                                busInfo.flags,
-                                name.data());
-            }
-            n = component->getBusCount( Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kOutput);
-            for (int32 i = 0; i < n; i++) {
-                Steinberg::Vst::BusInfo busInfo = {};
-                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kOutput, i, busInfo);
-                auto name = VST3::StringConvert::convert(busInfo.name);
-                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
-                                i,
-                                busInfo.direction == 0 ? "Input " : "Output",
-                                busInfo.mediaType == 0 ? "Audio" : "Event",
-                                busInfo.channelCount,
-                                busInfo.busType == 0 ? "Main" : "Aux ",
-                                busInfo.flags,
-                                name.data());
-            }
-            n = component->getBusCount( Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kOutput);
-            for (int32 i = 0; i < n; i++) {
-                Steinberg::Vst::BusInfo busInfo = {};
-                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kOutput, i, busInfo);
-                auto name = VST3::StringConvert::convert(busInfo.name);
-                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
-                                i,
-                                busInfo.direction == 0 ? "Input " : "Output",
-                                busInfo.mediaType == 0 ? "Audio" : "Event",
-                                busInfo.channelCount,
-                                busInfo.busType == 0 ? "Main" : "Aux ",
-                                busInfo.flags,
-                                name.data());
-            }
+        condition.notify_one();
+    }
+    /**
+     * Like post, but neither waits nor allocates, and so may be called from
+     * the audio thread; returns false if the job was not posted, e.g. if
+     * the mailbox is full.
+     */
+    bool try_post(worker_job_t job) {
+        if (!started.load(std::memory_order_acquire)) {
+            return false;
         }
-        // Parameters.
-        if (controller) {
-            int32 n = controller->getParameterCount();
-            Steinberg::Vst::ParameterInfo parameterInfo;
-            if (print == true)
-            {
-                csound->Message(csound, "               parameter count:   %4d\n", n);
-                for (int i = 0; i < n; ++i) {
-                    controller->getParameterInfo(i, parameterInfo);
-                    Steinberg::String title(parameterInfo.title);
-                    title.toMultiByte(Steinberg::kCP_Utf8);
-                    Steinberg::String units(parameterInfo.units);
-                    units.toMultiByte(Steinberg::kCP_Utf8);
-                    double value = controller->getParamNormalized(parameterInfo.id);
-                    int32 step_count = parameterInfo.stepCount;
-                    if (((parameterInfo.flags & Steinberg::Vst::ParameterInfo::kIsProgramChange) == Steinberg::Vst::ParameterInfo::kIsProgramChange)) {
-                        program_change_id = parameterInfo.id;
-                    }
-                    if (print == true) csound->Message(csound, "               parameter:  index: %4d: id: %12d name: %-64s units: %-16s step count: %-4d default: %9.4f value: %9.4f %s\n",
-                                                           i,
-                                                           parameterInfo.id,
-                                                           title.text8(),
-                                                           units.text8(),
-                                                           step_count,
-                                                           parameterInfo.defaultNormalizedValue,
-                                                           value,
-                                                           ((parameterInfo.flags & Steinberg::Vst::ParameterInfo::kIsProgramChange) == Steinberg::Vst::ParameterInfo::kIsProgramChange) ? "program change" : "");
-                }
-            }
+        job.ticket = tickets.fetch_add(1, std::memory_order_acq_rel);
+        if (!mailbox.push(job)) {
+            return false;
         }
-        if (print == true) {
-            // Units, program lists, and programs, in a flat list.
-            Steinberg::FUnknownPtr<Steinberg::Vst::IUnitInfo> i_unit_info(controller);
-            if (i_unit_info) {
-                auto unit_count = i_unit_info->getUnitCount();
-                for (auto unit_index = 0; unit_index < unit_count; ++unit_index) {
-                    Steinberg::Vst::UnitInfo unit_info;
-                    i_unit_info->getUnitInfo(unit_index, unit_info);
-                    auto program_list_count = i_unit_info->getProgramListCount();
-                    for (auto program_list_index = 0; program_list_index < program_list_count; ++program_list_index) {
-                        Steinberg::Vst::ProgramListInfo program_list_info;
-                        if (i_unit_info->getProgramListInfo(program_list_index, program_list_info) == Steinberg::kResultOk) {
-                            for (auto program_index = 0; program_index < program_list_info.programCount; ++program_index) {
-                                Steinberg::Vst::TChar program_name[256];
-                                i_unit_info->getProgramName(unit_info.programListId, program_index, program_name);
-                                csound->Message(csound, "               unit:       id: %7d (parent id: %4d) name: %-32s program list: id: %12d (index: %4d) program: id: %4d name: %s\n",
-                                                unit_info.id,
-                                                unit_info.parentUnitId,
-                                                VST3::StringConvert::convert(unit_info.name).c_str(),
-                                                unit_info.programListId,
-                                                program_list_index,
-                                                program_index,
-                                                VST3::StringConvert::convert(program_name).data());
-                            }
-                        }
-                    }
-                }
-            }
+        // If the lock is busy, the worker may miss this wakeup, and then
+        // finds the job when its wait times out.
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if (lock.owns_lock()) {
+            lock.unlock();
+            condition.notify_one();
         }
+        return true;
     }
-    void setTempo(double new_tempo) {
-        processContext.tempo = new_tempo;
+    /**
+     * Starts the thread, so that try_post can be used.
+     */
+    void ensure_started() {
+        std::lock_guard<std::mutex> lock(mutex);
+        start();
     }
-#if EDITOR_IMPLEMENTED
-    void showPluginEditorWindow() {
-        auto view = owned(controller->createView(Steinberg::Vst::ViewType::kEditor));
-        if (!view) {
-            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: controller does not provide its own editor!\n");
-            \
-            return;
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+            started.store(false, std::memory_order_release);
         }
-        Steinberg::ViewRect plugViewSize {};
-        auto result = view->getSize(&plugViewSize);
-        if (result != Steinberg::kResultTrue) {
-            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: could not get editor view size.\n");
-            \
+        condition.notify_one();
+        if (thread.joinable()) {
+            thread.join();
         }
-        auto viewRect = Steinberg::Vst::EditorHost::ViewRectToRect(plugViewSize);
-#if 1
-        auto windowController = std::make_shared<CsoundWindowController>(view);
-        auto window = Steinberg::Vst::EditorHost::IPlatform::instance().createWindow("Editor",
-                      viewRect.size, view->canResize() == Steinberg::kResultTrue, windowController);
-        if (result != Steinberg::kResultTrue) {
-            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: could not create window for plugin editor.\n");
-            \
+    }
+private:
+    // Must be called with the mutex held.
+    void start() {
+        if (!thread.joinable() && !stopping) {
+            thread = std::thread(&vst3_worker_t::run, this);
+            started.store(true, std::memory_order_release);
         }
-        if (window) {
-            window->show();
+    }
+    /**
+     * Runs the jobs from both queues in the order of their tickets. A job
+     * taken from the mailbox is held until every closure posted before it
+     * has run.
+     */
+    void run() {
+        worker_job_t held;
+        bool holding = false;
+        std::unique_lock<std::mutex> lock(mutex);
+        for (;;) {
+            if (!holding) {
+                holding = mailbox.pop(held);
+            }
+            if (!jobs.empty() && (!holding || jobs.front().first < held.ticket)) {
+                auto job = std::move(jobs.front().second);
+                jobs.pop_front();
+                lock.unlock();
+                job();
+                lock.lock();
+            } else if (holding) {
+                holding = false;
+                lock.unlock();
+                run_worker_job(held);
+                lock.lock();
+            } else if (stopping) {
+                return;
+            } else {
+                condition.wait_for(lock, std::chrono::milliseconds(10));
+            }
         }
-#endif
     }
-    static ComponentHandler *component_handler() {
-        static ComponentHandler component_handler_;
-        return &component_handler_;
+    std::mutex mutex;
+    std::condition_variable condition;
+    std::deque<std::pair<uint64_t, std::function<void()>>> jobs;
+    bounded_queue_t<worker_job_t, 256> mailbox;
+    std::atomic<uint64_t> tickets{0};
+    std::atomic<bool> started{false};
+    std::thread thread;
+    bool stopping = false;
+};
+
+/**
+ * The contents of preset files, kept in memory and keyed by pathname, so
+ * that loading a preset again costs one file status check. A cached preset
+ * is read again from disk if the file's modification time or size changes.
+ * May be called from any thread.
+ */
+class preset_cache_t {
+public:
+    typedef std::shared_ptr<const std::vector<char>> blob_t;
+    blob_t get(const std::string &filepath) {
+        std::error_code ec;
+        const std::filesystem::path file{filepath};
+        if (!std::filesystem::is_regular_file(file, ec)) {
+            return nullptr;
+        }
+        auto modified = std::filesystem::last_write_time(file, ec);
+        auto size = std::filesystem::file_size(file, ec);
+        if (ec) {
+            return nullptr;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            auto it = entries.find(filepath);
+            if (it != entries.end() && it->second.modified == modified && it->second.size == size) {
+                return it->second.blob;
+            }
+        }
+        std::ifstream input(filepath, std::ios::binary);
+        if (!input) {
+            return nullptr;
+        }
+        auto data = std::make_shared<std::vector<char>>(size);
+        if (!input.read(data->data(), size)) {
+            return nullptr;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        entries[filepath] = entry_t{modified, size, data};
+        return data;
     }
-#endif
-    static ComponentHandler *component_handler() {
-        static ComponentHandler component_handler_;
-        return &component_handler_;
+    void clear() {
+        std::lock_guard<std::mutex> lock(mutex);
+        entries.clear();
     }
-    // Returns true on success; false on any failure.
-    inline bool load_preset(const std::string &filepath) {
-        const std::filesystem::path& file{filepath};
-        csound->Message(csound, "Loading preset from file: \"%s\"...\n", file.string().c_str());
-        if (!component) {
-            csound->Message(csound, "Error: IComponent is null.\n");
-            return false;
+private:
+    struct entry_t {
+        std::filesystem::file_time_type modified;
+        uintmax_t size;
+        blob_t blob;
+    };
+    std::mutex mutex;
+    std::map<std::string, entry_t> entries;
+};
+
+/**
+ * MemoryStreams kept for reuse, so that once they have grown to the size of
+ * a plugin's state, capturing that state does not allocate. A stream is
+ * rewound, never truncated, for reuse, so the size of what was written is
+ * its cursor position, not its size. May be used from any thread.
+ */
+class memory_stream_pool_t {
+public:
+    std::shared_ptr<Steinberg::MemoryStream> acquire() {
+        std::shared_ptr<Steinberg::MemoryStream> stream;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!streams.empty()) {
+                stream = std::move(streams.back());
+                streams.pop_back();
+            }
         }
-        std::error_code ec;
-        if (!std::filesystem::exists(file, ec) || !std::filesystem::is_regular_file(file, ec)) {
-            csound->Message(csound, "Error: Preset path does not exist or is not a regular file.\n");
-            return false;
+        if (!stream) {
+            stream = std::make_shared<Steinberg::MemoryStream>();
         }
-        // Open file as an IBStream (binary mode on Windows matters).
-#if SMTG_OS_WINDOWS
-        const char* mode = "rb";
-#else
-        // On POSIX, "b" has no effect but is harmless if you prefer "rb".
-        const char* mode = "r";
+        stream->seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+        return stream;
+    }
+    void release(std::shared_ptr<Steinberg::MemoryStream> stream) {
+        std::lock_guard<std::mutex> lock(mutex);
+        streams.push_back(std::move(stream));
+    }
+private:
+    std::mutex mutex;
+    std::vector<std::shared_ptr<Steinberg::MemoryStream>> streams;
+};
+
+/**
+ * The state of a plugin held in memory: the component and controller state
+ * streams, and the plugin's parameter list when captured with the
+ * normalized value of each parameter.
+ */
+struct state_snapshot_t {
+    std::shared_ptr<Steinberg::MemoryStream> component_state;
+    Steinberg::int64 component_state_size = 0;
+    std::shared_ptr<Steinberg::MemoryStream> controller_state;
+    Steinberg::int64 controller_state_size = 0;
+    std::vector<Steinberg::Vst::ParamID> parameter_ids;
+    std::vector<Steinberg::Vst::ParamValue> parameter_values;
+};
+
+/**
+ * While in scope, the calling thread's floating-point unit flushes
+ * denormals to zero (FTZ and DAZ in the MXCSR on x86, FZ in the FPCR on
+ * ARM), so that decaying tails do not fall onto slow paths; the previous
+ * mode is restored afterwards. Does nothing if not enabled, or on other
+ * processors.
+ */
+class denormal_guard_t {
+public:
+    explicit denormal_guard_t(bool enabled) : enabled_(enabled) {
+        if (!enabled_) {
+            return;
+        }
+#if defined(VST3_HAS_MXCSR)
+        saved_ = _mm_getcsr();
+        // FTZ is bit 15, DAZ is bit 6.
+        _mm_setcsr(saved_ | 0x8040);
+#elif defined(__aarch64__)
+        uint64_t fpcr;
+        __asm__ __volatile__("mrs %0, fpcr" : "=r"(fpcr));
+        saved_ = fpcr;
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr | (uint64_t(1) << 24)));
+#elif defined(__arm__) && defined(__ARM_FP)
+        uint32_t fpscr;
+        __asm__ __volatile__("vmrs %0, fpscr" : "=r"(fpscr));
+        saved_ = fpscr;
+        __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr | (uint32_t(1) << 24)));
 #endif
-        Steinberg::IPtr<Steinberg::IBStream> stream { Steinberg::Vst::FileStream::open(file.string().c_str(), mode) };
-        if (!stream) {
-            csound->Message(csound, "Error: Could not open preset file.\n");
-            return false;
+    }
+    denormal_guard_t(denormal_guard_t const&) = delete;
+    void operator=(denormal_guard_t const&) = delete;
+    ~denormal_guard_t() {
+        if (!enabled_) {
+            return;
         }
-        // Fast path: let PresetFile dispatch state to component/controller.
-        Steinberg::FUID component_class_id { classInfo.ID().data() };
-        std::vector<Steinberg::FUID> otherClassIDs; // collects other IDs embedded in the preset, if any
-        if (Steinberg::Vst::PresetFile::loadPreset(stream, component_class_id, component, controller, &otherClassIDs)) {
-            csound->Message(csound, "Loaded preset file.\n");
-            return true;
-        } else {
-            csound->Message(csound, "Warning: Could not read preset file, trying to read chunk list.\n");
+#if defined(VST3_HAS_MXCSR)
+        _mm_setcsr(static_cast<unsigned int>(saved_));
+#elif defined(__aarch64__)
+        uint64_t fpcr = saved_;
+        __asm__ __volatile__("msr fpcr, %0" : : "r"(fpcr));
+#elif defined(__arm__) && defined(__ARM_FP)
+        uint32_t fpscr = static_cast<uint32_t>(saved_);
+        __asm__ __volatile__("vmsr fpscr, %0" : : "r"(fpscr));
+#endif
+    }
+private:
+    bool enabled_;
+    uint64_t saved_ = 0;
+};
+
+/**
+ * Counts the denormal and the non-finite (NaN or infinite) samples in a
+ * buffer, without branching.
+ */
+template<typename SAMPLE>
+static inline void count_abnormal_samples(const SAMPLE *samples, Steinberg::int32 frames, uint64_t &denormals, uint64_t &non_finite) {
+    for (Steinberg::int32 frame = 0; frame < frames; ++frame) {
+        SAMPLE magnitude = std::abs(samples[frame]);
+        denormals += (magnitude < std::numeric_limits<SAMPLE>::min()) & (magnitude != 0);
+        non_finite += !(magnitude <= std::numeric_limits<SAMPLE>::max());
+    }
+}
+
+/**
+ * Replaces the non-finite samples in a buffer with zeros, without
+ * branching.
+ */
+template<typename SAMPLE>
+static inline void silence_non_finite_samples(SAMPLE *samples, Steinberg::int32 frames) {
+    for (Steinberg::int32 frame = 0; frame < frames; ++frame) {
+        samples[frame] = std::abs(samples[frame]) <= std::numeric_limits<SAMPLE>::max() ? samples[frame] : SAMPLE(0);
+    }
+}
+
+/**
+ * Counters about a plugin, read by name with vst3stats. They may be written
+ * on any thread that processes the plugin, so they are relaxed atomics.
+ */
+struct plugin_stats_t {
+    enum statistic_t {
+        kWarmupBlocks,
+        kWarmupMicroseconds,
+        kDenormals,
+        kNonFinite,
+        kFaults,
+        kResets,
+        kStatisticCount
+    };
+    /**
+     * Returns the statistic with the name, or kStatisticCount if there is
+     * none.
+     */
+    static statistic_t find(const char *name) {
+        static const char *names[kStatisticCount] = {
+            "warmup_blocks",
+            "warmup_microseconds",
+            "denormals",
+            "non_finite",
+            "faults",
+            "resets",
+        };
+        for (int statistic = 0; statistic < kStatisticCount; ++statistic) {
+            if (std::strcmp(name, names[statistic]) == 0) {
+                return statistic_t(statistic);
+            }
         }
-        // Fallback path: parse and apply chunks manually for stubborn files.
-        Steinberg::Vst::PresetFile pf(stream);
-        if (!pf.readChunkList()) {
-            csound->Message(csound, "Error: Could not read preset chunk list.\n");
-            return false;
+        return kStatisticCount;
+    }
+    void add(statistic_t statistic, uint64_t amount) {
+        counters[statistic].fetch_add(amount, std::memory_order_relaxed);
+    }
+    void set(statistic_t statistic, uint64_t value) {
+        counters[statistic].store(value, std::memory_order_relaxed);
+    }
+    uint64_t get(statistic_t statistic) const {
+        return counters[statistic].load(std::memory_order_relaxed);
+    }
+    std::atomic<uint64_t> counters[kStatisticCount] = {};
+};
+
+/**
+ * Delays each of a plugin's output channels by the same number of samples,
+ * which may change from block to block, using rings that are allocated at
+ * i-time.
+ */
+struct delay_lines_t {
+    static constexpr size_t kCapacity = size_t(1) << 16;
+    static constexpr size_t kMask = kCapacity - 1;
+    void allocate(size_t channels) {
+        while (rings.size() < channels) {
+            rings.emplace_back(kCapacity, MYFLT(0));
         }
-        // Ensure the preset targets the same processor class (defensive).
-        const Steinberg::FUID& presetCID = pf.getClassID();
-        if (presetCID != component_class_id) {
-           csound->Message(csound, "Error: Preset class ID does not match this plugin's processor.\n");
-           return false;
+    }
+    size_t channels() const {
+        return rings.size();
+    }
+    /**
+     * Delays one channel's block in place; all channels must be processed
+     * before advance is called.
+     */
+    void process(size_t channel, MYFLT *buffer, Steinberg::int32 frames, size_t delay) {
+        delay = std::min(delay, kCapacity - frames);
+        auto ring = rings[channel].data();
+        for (Steinberg::int32 frame = 0; frame < frames; ++frame) {
+            ring[(write_position + frame) & kMask] = buffer[frame];
+            buffer[frame] = ring[(write_position + frame - delay) & kMask];
         }
-        bool ok = pf.restoreComponentState(component);
-        if (!ok) {
-            csound->Message(csound, "Failed to restore component state.\n");
-            return false;
+    }
+    void advance(Steinberg::int32 frames) {
+        write_position = (write_position + frames) & kMask;
+    }
+    std::vector<std::vector<MYFLT>> rings;
+    size_t write_position = 0;
+};
+
+/**
+ * Half-band lowpass FIR filters for 2x oversampling, in polyphase form: all
+ * even taps but the center tap are zero, so the upsampler computes only the
+ * odd-tap branch for its even outputs and copies a delayed input for its
+ * odd outputs, and the decimator computes only its retained outputs. The
+ * filter has 4 * kHalfLength - 1 taps and a Blackman window, for about 74 dB
+ * of stopband attenuation. The inner loops are simple enough for the
+ * compiler to vectorize.
+ */
+struct halfband_t {
+    static constexpr int kHalfLength = 16;
+    static constexpr int kBranchLength = 2 * kHalfLength;
+    // The delay of the center tap, in samples at the higher rate.
+    static constexpr int kDelay = 2 * kHalfLength - 1;
+    static constexpr double kPi = 3.14159265358979323846;
+    /**
+     * Returns the odd taps, in causal order.
+     */
+    static const std::array<double, kBranchLength> &coefficients() {
+        static const std::array<double, kBranchLength> taps = [] {
+            std::array<double, kBranchLength> result;
+            const double length = 4 * kHalfLength;
+            double sum = 0;
+            for (int index = 0; index < kBranchLength; ++index) {
+                double n = 2 * index - kDelay;
+                double sinc = std::sin(kPi * n / 2.) / (kPi * n);
+                double window = 0.42 + 0.5 * std::cos(2. * kPi * n / length) + 0.08 * std::cos(4. * kPi * n / length);
+                result[index] = sinc * window;
+                sum += result[index];
+            }
+            // The odd taps sum to 1/2, as does the center tap, for unity gain.
+            for (auto &tap : result) {
+                tap *= 0.5 / sum;
+            }
+            return result;
+        }();
+        return taps;
+    }
+};
+
+/**
+ * Doubles the rate of one channel.
+ */
+struct upsampler_2x_t {
+    static constexpr int kHistory = halfband_t::kBranchLength - 1;
+    std::vector<double> buffer;
+    void allocate(Steinberg::int32 frames) {
+        buffer.assign(kHistory + frames, 0.);
+    }
+    /**
+     * Reads frames samples and writes 2 * frames samples.
+     */
+    void process(const double *input, double *output, Steinberg::int32 frames) {
+        const auto &taps = halfband_t::coefficients();
+        std::copy_n(input, frames, buffer.data() + kHistory);
+        const double *history = buffer.data();
+        for (Steinberg::int32 frame = 0; frame < frames; ++frame) {
+            double sum = 0;
+            for (int tap = 0; tap < halfband_t::kBranchLength; ++tap) {
+                sum += taps[tap] * history[frame + kHistory - tap];
+            }
+            output[2 * frame] = 2. * sum;
+            output[2 * frame + 1] = history[frame + kHistory - (halfband_t::kHalfLength - 1)];
         }
-        if (controller) {
-            // Apply controller state if present; not all presets have one.
-            (void)pf.seekToControllerState(); // safe to call; restoreControllerState will handle absence
-            ok = pf.restoreControllerState(controller) && ok;
-            if (!ok) {
-                csound->Message(csound, "Error: Failed to restore controller state.\n");
+        std::copy(buffer.end() - kHistory, buffer.end(), buffer.begin());
+    }
+};
+
+/**
+ * Halves the rate of one channel.
+ */
+struct downsampler_2x_t {
+    static constexpr int kHistory = 2 * halfband_t::kDelay;
+    std::vector<double> buffer;
+    void allocate(Steinberg::int32 frames) {
+        buffer.assign(kHistory + 2 * frames, 0.);
+    }
+    /**
+     * Reads 2 * frames samples and writes frames samples.
+     */
+    void process(const double *input, double *output, Steinberg::int32 frames) {
+        const auto &taps = halfband_t::coefficients();
+        std::copy_n(input, 2 * frames, buffer.data() + kHistory);
+        const double *history = buffer.data() + kHistory;
+        for (Steinberg::int32 frame = 0; frame < frames; ++frame) {
+            const double *newest = history + 2 * frame;
+            double sum = 0.5 * newest[-halfband_t::kDelay];
+            for (int tap = 0; tap < halfband_t::kBranchLength; ++tap) {
+                sum += taps[tap] * newest[-2 * tap];
             }
+            output[frame] = sum;
         }
-        csound->Message(csound, "Loaded preset file.\n");
-        return true;
+        std::copy(buffer.end() - kHistory, buffer.end(), buffer.begin());
     }
-    CSOUND* csound = nullptr;
-    Steinberg::IPtr<Steinberg::Vst::PlugProvider> provider;
-    VST3::Hosting::ClassInfo classInfo;
-    Steinberg::IPtr<Steinberg::Vst::IComponent> component;
-    Steinberg::FUID component_class_id;
-    Steinberg::FUnknownPtr<Steinberg::Vst::IAudioProcessor> processor;
-    Steinberg::FUID processor_class_id;
-    Steinberg::IPtr<Steinberg::Vst::IEditController> controller;
-    Steinberg::FUID controller_class_id;
-    Steinberg::Vst::HostProcessData hostProcessData;
-    Steinberg::Vst::ProcessContext processContext;
-    Steinberg::Vst::EventList inputEventList;
-    Steinberg::Vst::EventList outputEventList;
-    Steinberg::Vst::ParameterChanges inputParameterChanges;
-    Steinberg::Vst::ParameterChanges outputParameterChanges;
-    Steinberg::Vst::ParameterChangeTransfer paramTransferrer;
-    //std::shared_ptr<Steinberg::Vst::EditorHost::WindowController> windowController;
-    MidiCCMapping midiCCMapping;
-    bool isProcessing = false;
-    double sampleRate = 0;
-    int32 blockSize = 0;
-    int32 plugin_sample_size;
-    // Records the id of the parameter used for program changes.
-    int32 program_change_id = -1;
-    // Incremented for every MIDI Note On message created,
-    // and paired with the corresponding Note Off message,
-    // for the lifetime of this plugin instance.
-    int note_id = 0;
-    std::string name;
 };
 
 /**
- * Singleton class for managing all persistent VST3 state:
- * (1) There is one and only one vst3_host_t instance in a process.
- * (2) There are zero or more vst3_plugin_t instances for each CSOUND
- *     instance, and these plugins are deleted when csoundModuleDestroy
- *     is called.
+ * Converts a plugin's channels between Csound's rate and 2, 4, or 8 times
+ * that rate, with cascaded half-band stages. Buffers are allocated
+ * beforehand, so that nothing is allocated in the performance thread.
  */
-class vst3_host_t : public Steinberg::Vst::HostApplication {
-    int host_handle;
+struct oversampler_t {
+    int factor = 1;
+    int stage_count = 0;
+    Steinberg::int32 frame_count = 0;
+    // [channel][stage]
+    std::vector<std::vector<upsampler_2x_t>> upsamplers;
+    std::vector<std::vector<downsampler_2x_t>> downsamplers;
+    std::vector<double> scratch[2];
+    /**
+     * Allocates for the given numbers of input and output channels, and
+     * blocks of frames at Csound's rate.
+     */
+    void allocate(int factor_, Steinberg::int32 input_channels, Steinberg::int32 output_channels, Steinberg::int32 frames) {
+        factor = factor_;
+        frame_count = frames;
+        stage_count = 0;
+        while ((1 << stage_count) < factor) {
+            ++stage_count;
+        }
+        upsamplers.assign(input_channels, std::vector<upsampler_2x_t>(stage_count));
+        downsamplers.assign(output_channels, std::vector<downsampler_2x_t>(stage_count));
+        for (auto &stages : upsamplers) {
+            for (int stage = 0; stage < stage_count; ++stage) {
+                stages[stage].allocate(frames << stage);
+            }
+        }
+        for (auto &stages : downsamplers) {
+            for (int stage = 0; stage < stage_count; ++stage) {
+                stages[stage].allocate(frames << stage);
+            }
+        }
+        scratch[0].assign(size_t(frames) * factor, 0.);
+        scratch[1].assign(size_t(frames) * factor, 0.);
+    }
+    /**
+     * Returns the delay of upsampling and downsampling, in samples at
+     * Csound's rate.
+     */
+    Steinberg::uint32 latency() const {
+        double delay = 0;
+        for (int stage = 1; stage <= stage_count; ++stage) {
+            delay += 2. * halfband_t::kDelay / (1 << stage);
+        }
+        return static_cast<Steinberg::uint32>(std::lround(delay));
+    }
+    template<typename SAMPLE>
+    void upsample(size_t channel, const MYFLT *input, SAMPLE *output) {
+        auto &stages = upsamplers[channel];
+        std::copy_n(input, frame_count, scratch[0].data());
+        int from = 0;
+        for (int stage = 0; stage < stage_count; ++stage) {
+            stages[stage].process(scratch[from].data(), scratch[1 - from].data(), frame_count << stage);
+            from = 1 - from;
+        }
+        std::copy_n(scratch[from].data(), size_t(frame_count) * factor, output);
+    }
+    template<typename SAMPLE>
+    void downsample(size_t channel, const SAMPLE *input, MYFLT *output, bool accumulate) {
+        auto &stages = downsamplers[channel];
+        std::copy_n(input, size_t(frame_count) * factor, scratch[0].data());
+        int from = 0;
+        for (int stage = stage_count - 1; stage >= 0; --stage) {
+            stages[stage].process(scratch[from].data(), scratch[1 - from].data(), frame_count << stage);
+            from = 1 - from;
+        }
+        const double *result = scratch[from].data();
+        if (accumulate) {
+            for (Steinberg::int32 frame = 0; frame < frame_count; ++frame) {
+                output[frame] += result[frame];
+            }
+        } else {
+            std::copy_n(result, frame_count, output);
+        }
+    }
+};
+
+/**
+ * Converts the sample rate of a number of channels by any ratio, with a
+ * windowed sinc kernel. Input is written, and output read, in blocks of any
+ * size, as long as enough input has been written; in between, samples wait
+ * in linear buffers that are allocated beforehand, so that the kernel reads
+ * contiguous samples. The kernel is tabulated in kPhases phases of kTaps
+ * taps each, and interpolated between adjacent phases; the dot products are
+ * simple enough for the compiler to vectorize.
+ */
+class sinc_resampler_t {
 public:
-    vst3_host_t() {
-    };
-    vst3_host_t(vst3_host_t const&) = delete;
-    void operator=(vst3_host_t const&) = delete;
-    ~vst3_host_t() noexcept override {
-        std::fprintf(stderr, "vst3_host_t::~vst3_host_t.\n");
+    static constexpr int kHalfTaps = 16;
+    static constexpr int kTaps = 2 * kHalfTaps;
+    static constexpr int kPhases = 128;
+    static constexpr double kPi = 3.14159265358979323846;
+    /**
+     * Allocates for the channels, and for up to capacity input frames to wait
+     * at once; must not be called in the performance thread.
+     */
+    void allocate(size_t channels, double input_rate, double output_rate, size_t capacity_) {
+        step = input_rate / output_rate;
+        capacity = capacity_ + kTaps;
+        buffers.assign(channels, std::vector<double>(capacity, 0.));
+        // The first output is centered on the first input, after silence.
+        filled = kHalfTaps - 1;
+        position = kHalfTaps - 1;
+        // When downsampling, the cutoff is lowered to the output's Nyquist.
+        double cutoff = 0.95 * std::min(1., 1. / step);
+        kernel.resize((kPhases + 1) * kTaps);
+        for (int phase = 0; phase <= kPhases; ++phase) {
+            double fraction = double(phase) / kPhases;
+            double *row = kernel.data() + phase * kTaps;
+            double sum = 0;
+            for (int tap = 0; tap < kTaps; ++tap) {
+                double x = tap - (kHalfTaps - 1) - fraction;
+                double u = x / kHalfTaps;
+                double window = std::fabs(u) < 1. ? 0.42 + 0.5 * std::cos(kPi * u) + 0.08 * std::cos(2. * kPi * u) : 0.;
+                double sinc = x == 0 ? 1. : std::sin(kPi * cutoff * x) / (kPi * cutoff * x);
+                row[tap] = sinc * window;
+                sum += row[tap];
+            }
+            for (int tap = 0; tap < kTaps; ++tap) {
+                row[tap] /= sum;
+            }
+        }
     }
     /**
-     * Loads a VST3 Module and obtains all plugins in it.
+     * Appends frames to one channel; null input appends silence. Every
+     * channel must be written before commit.
      */
-    MYFLT load_module(CSOUND *csound, const std::string& module_pathname, const std::string &plugin_name, bool verbose) {
-        size_t handle = 0;
-        if (verbose == true) {
-            csound->Message(csound, "vst3_host_t::load_module: loading: \"%s\"\n", module_pathname.c_str());
+    template<typename SAMPLE>
+    void write(size_t channel, const SAMPLE *input, size_t frames) {
+        frames = std::min(frames, capacity - filled);
+        auto buffer = buffers[channel].data() + filled;
+        if (input) {
+            std::copy_n(input, frames, buffer);
+        } else {
+            std::fill_n(buffer, frames, 0.);
         }
-        std::string error;
-        auto module = VST3::Hosting::Module::create(module_pathname, error);
-        if (!module) {
-            std::string reason = "Could not create Module for file:";
-            reason += module_pathname;
-            reason += "\nError: ";
-            reason += error;
-            csound->Message(csound, "vst3_host_t::load_module: error: %s\n", reason.c_str());
-            return -1;
+    }
+    void commit(size_t frames) {
+        filled += std::min(frames, capacity - filled);
+    }
+    /**
+     * Returns the number of output frames that can be read.
+     */
+    size_t available() const {
+        double limit = double(filled) - kHalfTaps - position;
+        return limit > 0 ? static_cast<size_t>(std::ceil(limit / step)) : 0;
+    }
+    /**
+     * Computes the next frames of one channel; every channel must be read
+     * before advance.
+     */
+    template<typename SAMPLE>
+    void read(size_t channel, SAMPLE *output, size_t frames) const {
+        const double *buffer = buffers[channel].data();
+        double time = position;
+        for (size_t frame = 0; frame < frames; ++frame, time += step) {
+            auto index = static_cast<size_t>(time);
+            double phase = (time - index) * kPhases;
+            auto phase_index = static_cast<int>(phase);
+            double weight = phase - phase_index;
+            const double *samples = buffer + index - (kHalfTaps - 1);
+            const double *row = kernel.data() + phase_index * kTaps;
+            double sum_0 = 0;
+            double sum_1 = 0;
+            for (int tap = 0; tap < kTaps; ++tap) {
+                sum_0 += row[tap] * samples[tap];
+                sum_1 += row[tap + kTaps] * samples[tap];
+            }
+            output[frame] = SAMPLE(sum_0 + weight * (sum_1 - sum_0));
         }
-        modules_for_pathnames[module_pathname] = module;
-        auto factory = module->getFactory();
-        int count = 0;
-        // Loop over all class infos from the module, but create only the requested plugin.
-        // This gives the user a list of all plugins available from the module.
-        VST3::Hosting::ClassInfo classInfo_;
-        for (auto& classInfo : factory.classInfos()) {
-            count = count + 1;
-            if (verbose == true) {
-                csound->Message(csound, "vst3_host_t::load_module: found module classinfo: %d\n", count);
-                csound->Message(csound, "                          module classinfo id:    %s\n", classInfo.ID().toString().c_str());
-                csound->Message(csound, "                          cardinality:            %i\n", classInfo.cardinality());
-                csound->Message(csound, "                          category:               %s\n", classInfo.category().c_str());
-                csound->Message(csound, "                          name:                   %s\n", classInfo.name().c_str());
-                csound->Message(csound, "                          vendor:                 %s\n", classInfo.vendor().c_str());
-                csound->Message(csound, "                          version:                %s\n", classInfo.version().c_str());
-                csound->Message(csound, "                          sdkVersion:             %s\n", classInfo.sdkVersion().c_str());
-                csound->Message(csound, "                          subCategoriesString:    %s\n", classInfo.subCategoriesString().c_str());
-                csound->Message(csound, "                          classFlags:             %i\n\n", classInfo.classFlags());
+    }
+    void advance(size_t frames) {
+        position += frames * step;
+        auto drop = static_cast<ptrdiff_t>(position) - (kHalfTaps - 1);
+        if (drop <= 0) {
+            return;
+        }
+        drop = std::min<ptrdiff_t>(drop, filled);
+        for (auto &buffer : buffers) {
+            std::copy(buffer.begin() + drop, buffer.begin() + filled, buffer.begin());
+        }
+        filled -= drop;
+        position -= drop;
+    }
+private:
+    double step = 1;
+    double position = 0;
+    size_t capacity = 0;
+    size_t filled = 0;
+    std::vector<std::vector<double>> buffers;
+    std::vector<double> kernel;
+};
+
+/**
+ * Runs a plugin at a sample rate other than Csound's: input is resampled to
+ * the plugin's rate and collected until there is a whole plugin block, and
+ * the plugin's output is resampled back to Csound's rate. The output side
+ * starts with enough silence that it never runs dry, which is the bridge's
+ * latency.
+ */
+struct resampling_bridge_t {
+    // If 0, the bridge is not used.
+    double plugin_sample_rate = 0;
+    double host_sample_rate = 0;
+    Steinberg::int32 host_block_size = 0;
+    Steinberg::int32 plugin_block_size = 0;
+    Steinberg::uint32 latency = 0;
+    sinc_resampler_t input;
+    sinc_resampler_t output;
+    std::vector<MYFLT> scratch;
+    /**
+     * Must not be called in the performance thread.
+     */
+    void allocate(size_t input_channels, size_t output_channels, Steinberg::int32 plugin_block_size_) {
+        plugin_block_size = plugin_block_size_;
+        scratch.assign(host_block_size, MYFLT(0));
+        double ratio = plugin_sample_rate / host_sample_rate;
+        size_t input_capacity = 2 * (host_block_size + plugin_block_size) + sinc_resampler_t::kTaps;
+        auto priming = static_cast<size_t>(std::ceil(host_block_size * ratio)) + plugin_block_size + 2 * sinc_resampler_t::kTaps;
+        size_t output_capacity = 2 * (priming + plugin_block_size) + sinc_resampler_t::kTaps;
+        input.allocate(input_channels, host_sample_rate, plugin_sample_rate, input_capacity);
+        output.allocate(output_channels, plugin_sample_rate, host_sample_rate, output_capacity);
+        for (size_t channel = 0; channel < output_channels; ++channel) {
+            output.write<double>(channel, nullptr, priming);
+        }
+        output.commit(priming);
+        // The output is delayed by the priming.
+        latency = static_cast<Steinberg::uint32>(std::lround(priming / ratio));
+    }
+};
+
+/**
+ * Interpolates between the normalized parameter values of two snapshots.
+ * The values are kept in contiguous arrays, and the interpolation and the
+ * quantization of stepped parameters are done in one branch-free loop, so
+ * that the compiler can vectorize it.
+ */
+struct parameter_morph_t {
+    void initialize(const std::vector<Steinberg::Vst::ParamID> &ids_,
+                    const std::vector<Steinberg::Vst::ParamValue> &from_,
+                    const std::vector<Steinberg::Vst::ParamValue> &to_,
+                    const std::vector<Steinberg::int32> &step_counts) {
+        ids = ids_;
+        from = from_;
+        to = to_;
+        steps.resize(step_counts.size());
+        inverse_steps.resize(step_counts.size());
+        for (size_t index = 0; index < step_counts.size(); ++index) {
+            steps[index] = step_counts[index];
+            inverse_steps[index] = step_counts[index] > 0 ? 1. / step_counts[index] : 0.;
+        }
+        values.assign(from.size(), 0.);
+        // No value has been sent yet.
+        sent.assign(from.size(), -1.);
+    }
+    /**
+     * Computes the values at a position from 0 (from) to 1 (to). Stepped
+     * parameters are rounded to the nearest step.
+     */
+    void interpolate(double position) {
+        position = std::min(std::max(position, 0.), 1.);
+        const size_t count = values.size();
+        const double *a = from.data();
+        const double *b = to.data();
+        const double *s = steps.data();
+        const double *r = inverse_steps.data();
+        double *v = values.data();
+        for (size_t index = 0; index < count; ++index) {
+            double value = a[index] + (b[index] - a[index]) * position;
+            double quantized = std::floor(value * s[index] + 0.5) * r[index];
+            v[index] = s[index] > 0. ? quantized : value;
+        }
+    }
+    std::vector<Steinberg::Vst::ParamID> ids;
+    std::vector<double> from;
+    std::vector<double> to;
+    std::vector<double> steps;
+    std::vector<double> inverse_steps;
+    std::vector<double> values;
+    // The values most recently sent to the plugin.
+    std::vector<double> sent;
+};
+
+/**
+ * Reads an unsigned little-endian integer of 1 to 8 bytes.
+ */
+static inline uint64_t read_le(const uint8_t *data, int bytes) {
+    uint64_t value = 0;
+    for (int i = bytes - 1; i >= 0; --i) {
+        value = (value << 8) | data[i];
+    }
+    return value;
+}
+
+/**
+ * Writes an unsigned little-endian integer of 1 to 8 bytes.
+ */
+static inline void write_le(std::ostream &stream, uint64_t value, int bytes) {
+    for (int i = 0; i < bytes; ++i) {
+        stream.put(static_cast<char>((value >> (8 * i)) & 0xFF));
+    }
+}
+
+/**
+ * Writes a string as a uint32 size followed by its bytes.
+ */
+static inline void write_string(std::ostream &stream, const std::string &value) {
+    write_le(stream, value.size(), 4);
+    stream.write(value.data(), value.size());
+}
+
+/**
+ * Reads little-endian integers, strings, and blocks of bytes from memory,
+ * checking bounds. After any read past the end, ok is false and every read
+ * returns 0, empty, or null.
+ */
+struct byte_reader_t {
+    byte_reader_t(const uint8_t *data, size_t size) : position(data), end(data + size) {}
+    uint64_t read(int bytes) {
+        if (!ok || end - position < bytes) {
+            ok = false;
+            return 0;
+        }
+        auto value = read_le(position, bytes);
+        position += bytes;
+        return value;
+    }
+    double read_double() {
+        uint64_t bits = read(8);
+        double value;
+        std::memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+    const char *read_bytes(uint64_t size) {
+        if (!ok || static_cast<uint64_t>(end - position) < size) {
+            ok = false;
+            return nullptr;
+        }
+        auto bytes = reinterpret_cast<const char *>(position);
+        position += size;
+        return bytes;
+    }
+    std::string read_string() {
+        auto size = read(4);
+        auto bytes = read_bytes(size);
+        return bytes ? std::string(bytes, size) : std::string();
+    }
+    /**
+     * Reads a count of records of at least record_size bytes each, and
+     * fails if there are not that many bytes left, so that a corrupt count
+     * can never be used to size an allocation.
+     */
+    uint64_t read_count(int bytes, uint64_t record_size) {
+        auto count = read(bytes);
+        if (ok && count > static_cast<uint64_t>(end - position) / record_size) {
+            ok = false;
+            return 0;
+        }
+        return count;
+    }
+    const uint8_t *position;
+    const uint8_t *end;
+    bool ok = true;
+};
+
+static inline void write_double(std::ostream &stream, double value) {
+    uint64_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    write_le(stream, bits, 8);
+}
+
+/**
+ * Writes the data to a temporary file beside the target, flushes it to
+ * disk, and then renames it onto the target, so that the target is never
+ * left partly written. Returns false and sets error on failure.
+ */
+static inline bool write_file_atomically(const std::string &filepath, const char *data, size_t size, std::string &error) {
+    auto temporary_filepath = filepath + ".tmp";
+#if defined(_WIN32)
+    {
+        std::ofstream output(temporary_filepath, std::ios::binary | std::ios::trunc);
+        if (!output) {
+            error = "could not open for writing: " + temporary_filepath;
+            return false;
+        }
+        output.write(data, size);
+        if (!output.flush()) {
+            error = "could not write: " + temporary_filepath;
+            return false;
+        }
+    }
+#else
+    int file = ::open(temporary_filepath.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (file == -1) {
+        error = "could not open for writing: " + temporary_filepath;
+        return false;
+    }
+    size_t written = 0;
+    while (written < size) {
+        auto result = ::write(file, data + written, size - written);
+        if (result <= 0) {
+            break;
+        }
+        written += static_cast<size_t>(result);
+    }
+    bool ok = written == size && ::fsync(file) == 0;
+    ok = ::close(file) == 0 && ok;
+    if (!ok) {
+        error = "could not write: " + temporary_filepath;
+        std::remove(temporary_filepath.c_str());
+        return false;
+    }
+#endif
+    std::error_code ec;
+    std::filesystem::rename(temporary_filepath, filepath, ec);
+    if (ec) {
+        error = "could not rename to " + filepath + ": " + ec.message();
+        std::filesystem::remove(temporary_filepath, ec);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Many preset files in one memory-mapped file, so that any preset can be
+ * recalled by index or by name without opening another file. Each preset
+ * is stored exactly as in its .vstpreset file, with its name, which is
+ * the stem of that file. The layout, with all integers little-endian, is:
+ *
+ *     char[8]     "VST3BANK"
+ *     uint32      version (1)
+ *     uint32      preset count
+ *     count x     uint64 name offset, uint64 name size,
+ *                 uint64 data offset, uint64 data size
+ *     the names and the data, at those offsets from the start of the file.
+ */
+class preset_bank_t {
+public:
+    struct preset_t {
+        std::string name;
+        const char *data;
+        size_t size;
+    };
+    static constexpr const char *kMagic = "VST3BANK";
+    static constexpr uint32_t kVersion = 1;
+    static constexpr size_t kHeaderSize = 16;
+    static constexpr size_t kIndexEntrySize = 32;
+    bool open(const std::string &filepath) {
+        presets.clear();
+        indexes_for_names.clear();
+        if (!file.open(filepath)) {
+            return false;
+        }
+        auto data = file.data();
+        auto size = file.size();
+        if (size < kHeaderSize || std::memcmp(data, kMagic, 8) != 0 || read_le(data + 8, 4) != kVersion) {
+            return false;
+        }
+        uint64_t count = read_le(data + 12, 4);
+        if (count > (size - kHeaderSize) / kIndexEntrySize) {
+            return false;
+        }
+        presets.reserve(count);
+        for (uint64_t i = 0; i < count; ++i) {
+            auto entry = data + kHeaderSize + i * kIndexEntrySize;
+            uint64_t name_offset = read_le(entry, 8);
+            uint64_t name_size = read_le(entry + 8, 8);
+            uint64_t data_offset = read_le(entry + 16, 8);
+            uint64_t data_size = read_le(entry + 24, 8);
+            if (name_offset > size || name_size > size - name_offset ||
+                data_offset > size || data_size > size - data_offset) {
+                presets.clear();
+                return false;
+            }
+            preset_t preset;
+            preset.name.assign(reinterpret_cast<const char *>(data + name_offset), name_size);
+            preset.data = reinterpret_cast<const char *>(data + data_offset);
+            preset.size = data_size;
+            indexes_for_names.emplace(preset.name, presets.size());
+            presets.push_back(std::move(preset));
+        }
+        return true;
+    }
+    size_t size() const {
+        return presets.size();
+    }
+    const preset_t *find(size_t index) const {
+        return index < presets.size() ? &presets[index] : nullptr;
+    }
+    const preset_t *find(const std::string &name) const {
+        auto it = indexes_for_names.find(name);
+        return it == indexes_for_names.end() ? nullptr : &presets[it->second];
+    }
+    /**
+     * Writes a bank holding every .vstpreset file in the directory, in
+     * order of name. The bank is written to a temporary file that is then
+     * renamed, so an existing bank is never left half-written. Returns the
+     * number of presets, or -1 on failure.
+     */
+    static int build(const std::string &directory, const std::string &bank_filepath, std::string &error) {
+        std::error_code ec;
+        std::vector<std::filesystem::path> preset_filepaths;
+        for (auto &entry : std::filesystem::directory_iterator(directory, ec)) {
+            // An entry that cannot be examined, e.g. a broken link, is skipped.
+            std::error_code entry_ec;
+            if (entry.is_regular_file(entry_ec) && !entry_ec && entry.path().extension() == ".vstpreset") {
+                preset_filepaths.push_back(entry.path());
+            }
+        }
+        if (ec) {
+            error = "could not read directory: " + ec.message();
+            return -1;
+        }
+        std::sort(preset_filepaths.begin(), preset_filepaths.end());
+        std::vector<std::string> names;
+        std::vector<std::vector<char>> blobs;
+        for (auto &preset_filepath : preset_filepaths) {
+            std::ifstream input(preset_filepath, std::ios::binary);
+            std::vector<char> blob((std::istreambuf_iterator<char>(input)), std::istreambuf_iterator<char>());
+            if (!input.good() && !input.eof()) {
+                error = "could not read preset: " + preset_filepath.string();
+                return -1;
+            }
+            names.push_back(preset_filepath.stem().string());
+            blobs.push_back(std::move(blob));
+        }
+        std::ostringstream output(std::ios::binary);
+        output.write(kMagic, 8);
+        write_le(output, kVersion, 4);
+        write_le(output, names.size(), 4);
+        uint64_t offset = kHeaderSize + names.size() * kIndexEntrySize;
+        for (size_t i = 0; i < names.size(); ++i) {
+            write_le(output, offset, 8);
+            write_le(output, names[i].size(), 8);
+            offset += names[i].size();
+            write_le(output, offset, 8);
+            write_le(output, blobs[i].size(), 8);
+            offset += blobs[i].size();
+        }
+        for (size_t i = 0; i < names.size(); ++i) {
+            output.write(names[i].data(), names[i].size());
+            output.write(blobs[i].data(), blobs[i].size());
+        }
+        auto contents = output.str();
+        if (!write_file_atomically(bank_filepath, contents.data(), contents.size(), error)) {
+            return -1;
+        }
+        return static_cast<int>(names.size());
+    }
+private:
+    memory_mapped_file_t file;
+    std::vector<preset_t> presets;
+    std::unordered_map<std::string, size_t> indexes_for_names;
+};
+
+#if EDITOR_IMPLEMENTED
+
+struct CsoundWindowController : public Steinberg::Vst::EditorHost::IWindowController, public Steinberg::IPlugFrame
+{
+public:
+    CsoundWindowController (const Steinberg::IPtr<Steinberg::IPlugView>& plugView_) : plugView(plugView_) {}
+    ~CsoundWindowController () noexcept override {}
+    void onShow (Steinberg::Vst::EditorHost::IWindow& w) override {
+        SMTG_DBPRT1 ("onShow called (%p)\n", (void*)&w);
+        window = &w;
+        if (!plugView) {
+            return;
+        }
+        auto platformWindow = window->getNativePlatformWindow ();
+        if (plugView->isPlatformTypeSupported (platformWindow.type) != Steinberg::kResultTrue) {
+            Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, std::string ("PlugView does not support platform type:") +
+                    platformWindow.type);
+        }
+        plugView->setFrame (this);
+        if (plugView->attached (platformWindow.ptr, platformWindow.type) != Steinberg::kResultTrue) {
+            Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, "Attaching PlugView failed");
+        }
+    }
+    void onClose (Steinberg::Vst::EditorHost::IWindow& w) override {
+        SMTG_DBPRT1 ("onClose called (%p)\n", (void*)&w);
+        closePlugView ();
+        // TODO maybe quit only when the last window is closed
+        ///Steinberg::Vst::EditorHost::IPlatform::instance ().quit ();
+    }
+    void onResize (Steinberg::Vst::EditorHost::IWindow& w, Steinberg::Vst::EditorHost::Size newSize) override {
+        SMTG_DBPRT1 ("onResize called (%p)\n", (void*)&w);
+        if (plugView) {
+            Steinberg::ViewRect r {};
+            r.right = newSize.width;
+            r.bottom = newSize.height;
+            Steinberg::ViewRect r2 {};
+            if (plugView->getSize (&r2) == Steinberg::kResultTrue && std::memcmp(&r, &r2, sizeof(Steinberg::ViewRect)) != 0) {
+                plugView->onSize (&r);
+            }
+        }
+    }
+    Steinberg::Vst::EditorHost::Size constrainSize (Steinberg::Vst::EditorHost::IWindow& w, Steinberg::Vst::EditorHost::Size requestedSize) override {
+        SMTG_DBPRT1 ("constrainSize called (%p)\n", (void*)&w);
+        Steinberg::ViewRect r {};
+        r.right = requestedSize.width;
+        r.bottom = requestedSize.height;
+        if (plugView && plugView->checkSizeConstraint (&r) != Steinberg::kResultTrue)
+        {
+            plugView->getSize (&r);
+        }
+        requestedSize.width = r.right - r.left;
+        requestedSize.height = r.bottom - r.top;
+        return requestedSize;
+    }
+    void onContentScaleFactorChanged (Steinberg::Vst::EditorHost::IWindow& window, float newScaleFactor) override {
+        SMTG_DBPRT1 ("onContentScaleFactorChanged called (%p)\n", (void*)&window);
+        Steinberg::FUnknownPtr<Steinberg::IPlugViewContentScaleSupport> css (plugView);
+        if (css) {
+            css->setContentScaleFactor (newScaleFactor);
+        }
+    }
+    // IPlugFrame
+    Steinberg::tresult resizeView (Steinberg::IPlugView* view, Steinberg::ViewRect* newSize) override {
+        SMTG_DBPRT1 ("resizeView called (%p)\n", (void*)view);
+        if (newSize == nullptr || view == nullptr || view != plugView) {
+            return Steinberg::kInvalidArgument;
+        }
+        if (!window) {
+            return Steinberg::kInternalError;
+        }
+        if (resizeViewRecursionGard) {
+            return Steinberg::kResultFalse;
+        }
+        Steinberg::ViewRect r;
+        if (plugView->getSize (&r) != Steinberg::kResultTrue) {
+            return Steinberg::kInternalError;
+        }
+        if (std::memcmp(&r, newSize, sizeof(Steinberg::ViewRect)) == 0) {
+            return Steinberg::kResultTrue;
+        }
+        resizeViewRecursionGard = true;
+        Steinberg::Vst::EditorHost::Size size {newSize->right - newSize->left, newSize->bottom - newSize->top};
+        window->resize (size);
+        resizeViewRecursionGard = false;
+        if (plugView->getSize (&r) != Steinberg::kResultTrue) {
+            return Steinberg::kInternalError;
+        }
+        if (std::memcmp(&r, newSize, sizeof(Steinberg::ViewRect)) != 0) {
+            plugView->onSize (newSize);
+        }
+        return Steinberg::kResultTrue;
+    }
+    void closePlugView () {
+        if (plugView) {
+            plugView->setFrame (nullptr);
+            if (plugView->removed () != Steinberg::kResultTrue) {
+                Steinberg::Vst::EditorHost::IPlatform::instance ().kill (-1, "Removing PlugView failed");
+            }
+            plugView = nullptr;
+        }
+        window = nullptr;
+    }
+    Steinberg::tresult queryInterface (const Steinberg::TUID _iid, void** obj) override {
+        if (Steinberg::FUnknownPrivate::iidEqual (_iid, Steinberg::IPlugFrame::iid) ||
+                Steinberg::FUnknownPrivate::iidEqual (_iid, Steinberg::FUnknown::iid)) {
+            *obj = this;
+            addRef ();
+            return Steinberg::kResultTrue;
+        }
+        if (window) {
+            return window->queryInterface (_iid, obj);
+        }
+        return Steinberg::kNoInterface;
+    }
+    uint32 addRef () override {
+        return 1000;
+    }
+    uint32 release () override {
+        return 1000;
+    }
+    Steinberg::IPtr<Steinberg::IPlugView> plugView;
+    Steinberg::Vst::EditorHost::IWindow* window {nullptr};
+    bool resizeViewRecursionGard {false};
+};
+
+//~ class App : public Steinberg::VST3::Hosting::IApplication
+//~ {
+//~ public:
+//~ ~App () noexcept override {
+//~ }
+//~ void init (const std::vector<std::string>& args) override {
+//~ }
+//~ void terminate () override {
+//~ }
+//~ private:
+//~ enum OpenFlags
+//~ {
+//~ kSetComponentHandler = 1 << 0,
+//~ kSecondWindow = 1 << 1,
+//~ };
+//~ void openEditor (const std::string& path, VST3::Optional<VST3::UID> effectID, uint32 flags) {
+//~ }
+//~ void createViewAndShow (IEditController* controller) {
+//~ }
+//~ Steinberg::VST3::Hosting::Module::Ptr module {nullptr};
+//~ Steinberg::IPtr<Steinberg::Vst::PlugProvider> plugProvider {nullptr};
+//~ Vst::HostApplication pluginContext;
+//~ std::shared_ptr<WindowController> windowController;
+//~ };
+
+//~ static Steinberg::Vst::EditorHost::AppInit gInit (std::make_unique<App> ());
+
+#endif
+
+/**
+ * A parameter value set by the plugin's controller, e.g. from its editor.
+ */
+struct parameter_edit_t {
+    Steinberg::Vst::ParamID id;
+    Steinberg::Vst::ParamValue value;
+};
+
+/**
+ * Receives calls from the plugin's controller, which may come from any
+ * thread. Nothing is done here: edits and restart requests are recorded
+ * without locking, for the plugin to handle on the right thread.
+ */
+class ComponentHandler : public Steinberg::Vst::IComponentHandler
+{
+public:
+    Steinberg::tresult PLUGIN_API beginEdit (Steinberg::Vst::ParamID id) override {
+        SMTG_DBPRT1 ("beginEdit called (%d)\n", id);
+        return Steinberg::kResultOk;
+    }
+    /**
+     * Queues the edit to be sent to the processor in the next block.
+     */
+    Steinberg::tresult PLUGIN_API performEdit (Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue valueNormalized) override {
+        SMTG_DBPRT2 ("performEdit called (%d, %f)\n", id, valueNormalized);
+        return edits.push(parameter_edit_t{id, valueNormalized}) ? Steinberg::kResultOk : Steinberg::kResultFalse;
+    }
+    Steinberg::tresult PLUGIN_API endEdit (Steinberg::Vst::ParamID id) override {
+        SMTG_DBPRT1 ("endEdit called (%d)\n", id);
+        return Steinberg::kResultOk;
+    }
+    /**
+     * Records the flags, which are handled later on Csound's performance
+     * thread; see take_restart_flags. Plugins may call this from any thread.
+     */
+    Steinberg::tresult PLUGIN_API restartComponent (Steinberg::int32 flags) override {
+        SMTG_DBPRT1 ("restartComponent called (%d)\n", flags);
+        restart_flags.fetch_or(flags, std::memory_order_acq_rel);
+        return Steinberg::kResultOk;
+    }
+    /**
+     * Returns and clears those of the recorded restart flags that are in
+     * the mask.
+     */
+    Steinberg::int32 take_restart_flags(Steinberg::int32 mask) {
+        if ((restart_flags.load(std::memory_order_acquire) & mask) == 0) {
+            return 0;
+        }
+        return restart_flags.fetch_and(~mask, std::memory_order_acq_rel) & mask;
+    }
+    bounded_queue_t<parameter_edit_t, 1024> edits;
+private:
+    std::atomic<Steinberg::int32> restart_flags{0};
+    Steinberg::tresult PLUGIN_API queryInterface (const Steinberg::TUID /*_iid*/, void** /*obj*/) override {
+        return Steinberg::kNoInterface;
+    }
+    Steinberg::uint32 PLUGIN_API addRef () override {
+        return 1000;
+    }
+    Steinberg::uint32 PLUGIN_API release () override {
+        return 1000;
+    }
+};
+
+/**
+ * Controller information read again on the worker thread after the plugin
+ * has changed it, to be taken up by the performance thread.
+ */
+struct controller_refresh_t {
+    bool has_midi_cc_mapping = false;
+    midi_cc_mapping_t midi_cc_mapping;
+    bool has_parameter_list = false;
+    std::vector<Steinberg::Vst::ParamID> parameter_ids;
+    std::vector<Steinberg::int32> parameter_step_counts;
+};
+
+/**
+ * A preset save that can be requested repeatedly from the performance
+ * thread without allocating: the file path is resolved at i-time, and the
+ * state is serialized and written on the worker thread. The plugin owns
+ * these, so that they outlive any job that uses them.
+ */
+struct preset_save_request_t {
+    std::string filepath;
+    uint64_t serial = 0;
+    // True from the request until the worker has finished the save.
+    std::atomic<bool> pending{false};
+};
+
+/**
+ * This class manages one instance of one plugin and all of its
+ * communications with Csound, including audio input and output,
+ * MIDI input and output, and parameter input and output.
+ */
+struct vst3_plugin_t  {
+    vst3_plugin_t() {};
+    virtual ~vst3_plugin_t() {
+#if DEBUGGING
+        std::fprintf(stderr, "vst3_plugin_t::~vst3_plugin_t.\n");
+#endif
+        // The component handler is destroyed before the controller.
+        if (controller) {
+            controller->setComponentHandler(nullptr);
+        }
+        delete pending_refresh.load();
+        delete retired_refresh;
+    }
+    void preprocess(int64_t continousFrames) {
+#if PROCESS_TRACING
+        csound->Message(csound, "vst3_plugin_t::preprocess: hostProcessData.numSamples: %d.\n", hostProcessData.numSamples);
+#endif
+        hostProcessData.numSamples = blockSize;
+        processContext.continousTimeSamples = static_cast<int64_t>(continousFrames * time_scale);
+        // Events are queued with offsets at Csound's rate.
+        if (time_scale != 1.) {
+            auto event_count = inputEventList.getEventCount();
+            for (Steinberg::int32 event_index = 0; event_index < event_count; ++event_index) {
+                auto event = inputEventList.getEventByIndex(event_index);
+                if (event) {
+                    event->sampleOffset = scale_offset(event->sampleOffset);
+                }
+            }
+        }
+        // The plugin sets the flags of any output channels it leaves silent.
+        for (Steinberg::int32 bus = 0; bus < hostProcessData.numOutputs; ++bus) {
+            hostProcessData.outputs[bus].silenceFlags = 0;
+        }
+        parameter_edit_t edit;
+        while (component_handler_.edits.pop(edit)) {
+            paramTransferrer.addChange(edit.id, edit.value, 0);
+        }
+        paramTransferrer.transferChangesTo(inputParameterChanges);
+        parameter_changes_pending = false;
+        transfer_midi_parameter_changes();
+#if PARAMETER_TRACING
+        // Making sure the parameter changes made it down to the bottom of
+        // the stack, and will get to the processor...
+        auto input_parameter_count = hostProcessData.inputParameterChanges->getParameterCount();
+        for (auto parameter_index = 0; parameter_index < input_parameter_count; ++parameter_index) {
+            auto queue_for_parameter = hostProcessData.inputParameterChanges->getParameterData(parameter_index);
+            auto parameter_id = queue_for_parameter->getParameterId();
+            auto parameter_point_count = queue_for_parameter->getPointCount();
+            for (auto point_index = 0; point_index < parameter_point_count; ++point_index) {
+                int sample_offset;
+                double parameter_value;
+                queue_for_parameter->getPoint(point_index, sample_offset, parameter_value);
+                csound->Message(csound, "vst3_plugin_t::preprocess: parameter id: %-16d sample offset: %-16d parameter_value: %9.4f\n",
+                                parameter_id,
+                                sample_offset,
+                                parameter_value);
+                // Pass on to EditController.
+                controller->setParamNormalized(parameter_id, parameter_value);
+            }
+        }
+#endif
+    }
+    void postprocess() {
+        capture_output_events();
+        if (!defer_event_routing && !accumulating_output_events) {
+            route_output_events();
+        }
+        inputEventList.clear();
+        outputEventList.clear();
+        inputParameterChanges.clearQueue();
+        outputParameterChanges.clearQueue();
+    }
+    /**
+     * The caller must hold the state_mutex; see try_lock_state.
+     */
+    bool process(int64_t continuous_frames) {
+#if PROCESS_TRACING
+        csound->Message(csound, "vst3_plugin_t::process: time in frames: %ld.\n", continuous_frames);
+#endif
+        if (!processor || !isProcessing) {
+            csound->Message(csound, "vst3_plugin_t::process: no processor or not processing!\n");
+            return false;
+        }
+        preprocess(continuous_frames);
+        Steinberg::tresult result;
+        {
+            denormal_guard_t denormal_guard(flush_denormals);
+            result = processor->process(hostProcessData);
+        }
+        if (result != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::process: returned not OK!\n");
+            return false;
+        }
+        postprocess();
+        if (muting_state_loads.load(std::memory_order_acquire) > 0) {
+            silence_outputs();
+        }
+        return true;
+    }
+    /**
+     * Activates or deactivates the main audio busses or, if all_busses is
+     * set, every audio bus, e.g. sidechain inputs and auxiliary outputs.
+     */
+    void activate_audio_busses(bool state) {
+        for (auto direction : {Steinberg::Vst::kInput, Steinberg::Vst::kOutput}) {
+            auto bus_count = all_busses ? component->getBusCount(Steinberg::Vst::kAudio, direction) : 1;
+            for (Steinberg::int32 bus = 0; bus < bus_count; ++bus) {
+                auto result = component->activateBus(Steinberg::Vst::kAudio, direction, bus, state);
+                if (state) {
+                    csound->Message(csound, "activateBus(kAudio, %s, %d) returned %d\n", direction == Steinberg::Vst::kInput ? "kInput" : "kOutput", bus, result);
+                }
+            }
+        }
+    }
+    /**
+     * Returns one arrangement per audio bus in the direction: the plugin's
+     * own, except that the main bus gets a standard arrangement for the
+     * requested number of channels, if any.
+     */
+    std::vector<Steinberg::Vst::SpeakerArrangement> bus_arrangements(Steinberg::Vst::BusDirection direction, Steinberg::int32 requested_channels) {
+        std::vector<Steinberg::Vst::SpeakerArrangement> arrangements(component->getBusCount(Steinberg::Vst::kAudio, direction), Steinberg::Vst::SpeakerArr::kEmpty);
+        for (Steinberg::int32 bus = 0; bus < Steinberg::int32(arrangements.size()); ++bus) {
+            processor->getBusArrangement(direction, bus, arrangements[bus]);
+        }
+        if (requested_channels > 0 && !arrangements.empty()) {
+            arrangements[0] = speaker_arrangement(requested_channels);
+        }
+        return arrangements;
+    }
+    /**
+     * Zeros every input buffer, for sends to accumulate into.
+     */
+    void clear_inputs() {
+        for (Steinberg::int32 bus = 0; bus < hostProcessData.numInputs; ++bus) {
+            auto &buffers = hostProcessData.inputs[bus];
+            for (Steinberg::int32 channel = 0; channel < buffers.numChannels; ++channel) {
+                if (plugin_sample_size == Steinberg::Vst::kSample64) {
+                    std::fill_n(buffers.channelBuffers64[channel], blockSize, 0.);
+                } else {
+                    std::fill_n(buffers.channelBuffers32[channel], blockSize, 0.f);
+                }
+            }
+        }
+    }
+    /**
+     * Zeros the input buffers if they hold the sends of a block before the
+     * one at time_in_frames, i.e. if the block they were for was skipped, so
+     * that they are dropped rather than heard late. Called by vst3send and by
+     * the opcodes that consume sends before they touch the inputs. The
+     * caller must hold the state_mutex.
+     */
+    void begin_sends(int64_t time_in_frames) {
+        if (sends_time_in_frames < time_in_frames) {
+            clear_inputs();
+            sends_time_in_frames = time_in_frames;
+        }
+    }
+    /**
+     * Zeros the input buffers once they have been processed, so that sends
+     * that run later in this kperiod are heard in the next block, which
+     * starts at next_time_in_frames. The caller must hold the state_mutex.
+     */
+    void end_sends(int64_t next_time_in_frames) {
+        clear_inputs();
+        sends_time_in_frames = next_time_in_frames;
+    }
+    void silence_outputs() {
+        for (Steinberg::int32 bus = 0; bus < hostProcessData.numOutputs; ++bus) {
+            auto &buffers = hostProcessData.outputs[bus];
+            for (Steinberg::int32 channel = 0; channel < buffers.numChannels; ++channel) {
+                if (plugin_sample_size == Steinberg::Vst::kSample64) {
+                    std::fill_n(buffers.channelBuffers64[channel], blockSize, 0.);
+                } else {
+                    std::fill_n(buffers.channelBuffers32[channel], blockSize, 0.f);
+                }
+            }
+        }
+    }
+    bool setSamplerate(double value) {
+        if (sampleRate == value) {
+            return true;
+        }
+        sampleRate = value;
+        processContext.sampleRate = sampleRate;
+        if (blockSize == 0) {
+            return true;
+        }
+        return update_process_setup();
+    }
+    /**
+     * Sets up the plugin to process blocks of the given size at the given
+     * rate, times the oversampling factor, or at the bridge's rate, and
+     * activates it; at i-time only. The buffers are allocated by
+     * update_process_setup, once the bus arrangements have been negotiated.
+     */
+    void prepare(double sample_rate, Steinberg::int32 block_size) {
+        if (bridge.plugin_sample_rate > 0) {
+            bridge.host_sample_rate = sample_rate;
+            bridge.host_block_size = block_size;
+            time_scale = bridge.plugin_sample_rate / sample_rate;
+            sampleRate = bridge.plugin_sample_rate;
+            blockSize = static_cast<Steinberg::int32>(std::ceil(block_size * time_scale));
+        } else {
+            time_scale = oversampling;
+            sampleRate = sample_rate * oversampling;
+            blockSize = block_size * oversampling;
+        }
+        processContext.sampleRate = sampleRate;
+        update_process_setup();
+        update_latency();
+        // Reactivation resets the plugin, so no notes are sounding.
+        active_notes.clear();
+        warm_up();
+        capture_good_state();
+        buffer_generation.fetch_add(1, std::memory_order_acq_rel);
+    }
+    /**
+     * Processes warmup_blocks blocks of silence, so that the plugin does
+     * its lazy allocation and its code and data are faulted in before
+     * performance starts, then puts the plugin back as it was. If
+     * warmup_key is not negative, that key is played for the first half.
+     * The blocks use their own event lists and parameter changes, so
+     * nothing queued for the plugin is consumed. At i-time only; the
+     * caller must hold the state_mutex if the plugin may be processing.
+     */
+    void warm_up() {
+        if (warmup_blocks <= 0 || !isProcessing) {
+            return;
+        }
+        auto started = std::chrono::steady_clock::now();
+        Steinberg::MemoryStream component_state;
+        Steinberg::MemoryStream controller_state;
+        if (component->getState(&component_state) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::warm_up: could not get component state.\n");
+            return;
+        }
+        bool has_controller_state = controller && controller->getState(&controller_state) == Steinberg::kResultOk;
+        Steinberg::Vst::EventList input_events;
+        Steinberg::Vst::EventList output_events;
+        Steinberg::Vst::ParameterChanges input_changes;
+        Steinberg::Vst::ParameterChanges output_changes;
+        hostProcessData.inputEvents = &input_events;
+        hostProcessData.outputEvents = &output_events;
+        hostProcessData.inputParameterChanges = &input_changes;
+        hostProcessData.outputParameterChanges = &output_changes;
+        hostProcessData.numSamples = blockSize;
+        auto context = processContext;
+        clear_inputs();
+        Steinberg::Vst::Event event{};
+        for (Steinberg::int32 block = 0; block < warmup_blocks; ++block) {
+            if (warmup_key >= 0 && block == 0) {
+                event.type = Steinberg::Vst::Event::EventTypes::kNoteOnEvent;
+                event.noteOn.pitch = static_cast<Steinberg::int16>(warmup_key);
+                event.noteOn.velocity = 100 / 127.;
+                event.noteOn.noteId = -1;
+                input_events.addEvent(event);
+            } else if (warmup_key >= 0 && block == std::max(warmup_blocks / 2, 1)) {
+                event = {};
+                event.type = Steinberg::Vst::Event::EventTypes::kNoteOffEvent;
+                event.noteOff.pitch = static_cast<Steinberg::int16>(warmup_key);
+                event.noteOff.noteId = -1;
+                input_events.addEvent(event);
+            }
+            processContext.continousTimeSamples = int64_t(block) * blockSize;
+            denormal_guard_t denormal_guard(flush_denormals);
+            processor->process(hostProcessData);
+            input_events.clear();
+            output_events.clear();
+            input_changes.clearQueue();
+            output_changes.clearQueue();
+        }
+        hostProcessData.inputEvents = &inputEventList;
+        hostProcessData.outputEvents = &outputEventList;
+        hostProcessData.inputParameterChanges = &inputParameterChanges;
+        hostProcessData.outputParameterChanges = &outputParameterChanges;
+        processContext = context;
+        reactivate(&component_state, has_controller_state ? &controller_state : nullptr);
+        silence_outputs();
+        auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started);
+        stats.set(plugin_stats_t::kWarmupBlocks, warmup_blocks);
+        stats.set(plugin_stats_t::kWarmupMicroseconds, elapsed.count());
+        csound->Message(csound, "vst3_plugin_t::warm_up: %d blocks in %.3f ms.\n", warmup_blocks, elapsed.count() / 1000.);
+    }
+    /**
+     * Here the host (this) creates buffers for hostProcessData.
+     */
+    bool create_audio_buffers(Steinberg::int32 value) {
+        blockSize = value;
+        if (sampleRate == 0) {
+            return true;
+        }
+        if (processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue) {
+            plugin_sample_size = Steinberg::Vst::kSample64;
+        } else {
+            plugin_sample_size = Steinberg::Vst::kSample32;
+        }
+        // HostProcessData looks up the Component's BusInfos and creates
+        // channel pointers for every bus, active or not, as the plugin
+        // expects. With no block size it does not own the channel buffers,
+        // which are then taken from the arena. The hostProcessData number
+        // of inputs and outputs must not be changed here, as they are used
+        // to free the old pointers.
+        auto result = hostProcessData.prepare(*component, 0, plugin_sample_size);
+        if (!allocate_channel_buffers()) {
+            csound->Message(csound, "vst3_plugin::create_audio_buffers: failed to allocate %zu bytes.\n", arena.size());
+            return false;
+        }
+        if (oversampling > 1) {
+            Steinberg::int32 input_channels = 0;
+            Steinberg::int32 output_channels = 0;
+            for (Steinberg::int32 bus = 0; bus < hostProcessData.numInputs; ++bus) {
+                input_channels += hostProcessData.inputs[bus].numChannels;
+            }
+            for (Steinberg::int32 bus = 0; bus < hostProcessData.numOutputs; ++bus) {
+                output_channels += hostProcessData.outputs[bus].numChannels;
+            }
+            oversampler.allocate(oversampling, input_channels, output_channels, blockSize / oversampling);
+            csound->Message(csound, "vst3_plugin::create_audio_buffers: oversampling:       %9d\n", oversampling);
+        }
+        if (bridge.plugin_sample_rate > 0) {
+            Steinberg::int32 input_channels = 0;
+            Steinberg::int32 output_channels = 0;
+            for (Steinberg::int32 bus = 0; bus < hostProcessData.numInputs; ++bus) {
+                input_channels += hostProcessData.inputs[bus].numChannels;
+            }
+            for (Steinberg::int32 bus = 0; bus < hostProcessData.numOutputs; ++bus) {
+                output_channels += hostProcessData.outputs[bus].numChannels;
+            }
+            bridge.allocate(input_channels, output_channels, blockSize);
+            csound->Message(csound, "vst3_plugin::create_audio_buffers: resampling from:    %9.3f\n", bridge.host_sample_rate);
+        }
+        /// result = update_process_setup();
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: plugin_sample_size: %s\n", plugin_sample_size ? "64 bits" : "32 bits");
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: sampleRate:         %9.3f\n", sampleRate);
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: blockSize:          %9d\n", blockSize);
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: input busses:       %9d\n", hostProcessData.numInputs);
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: output busses:      %9d\n", hostProcessData.numOutputs);
+        csound->Message(csound, "vst3_plugin::create_audio_buffers: buffer arena:       %9zu bytes%s%s\n", arena.size(), arena.locked() ? ", locked" : "", arena.on_huge_pages() ? ", huge pages" : "");
+        return result;
+    }
+    /**
+     * Takes every channel buffer of every bus, inputs and then outputs,
+     * from one arena, each channel starting on a cache line.
+     */
+    bool allocate_channel_buffers() {
+        size_t sample_size = plugin_sample_size == Steinberg::Vst::kSample64 ? sizeof(Steinberg::Vst::Sample64) : sizeof(Steinberg::Vst::Sample32);
+        size_t stride = buffer_arena_t::round_up(size_t(blockSize) * sample_size, buffer_arena_t::kCacheLine);
+        size_t channel_count = 0;
+        for (Steinberg::int32 bus = 0; bus < hostProcessData.numInputs; ++bus) {
+            channel_count += hostProcessData.inputs[bus].numChannels;
+        }
+        for (Steinberg::int32 bus = 0; bus < hostProcessData.numOutputs; ++bus) {
+            channel_count += hostProcessData.outputs[bus].numChannels;
+        }
+        if (!arena.allocate(channel_count * stride)) {
+            return false;
+        }
+        auto take = [&] (Steinberg::Vst::AudioBusBuffers *busses, Steinberg::int32 bus_count) {
+            for (Steinberg::int32 bus = 0; bus < bus_count; ++bus) {
+                for (Steinberg::int32 channel = 0; channel < busses[bus].numChannels; ++channel) {
+                    void *buffer = arena.take(stride);
+                    if (plugin_sample_size == Steinberg::Vst::kSample64) {
+                        busses[bus].channelBuffers64[channel] = static_cast<Steinberg::Vst::Sample64 *>(buffer);
+                    } else {
+                        busses[bus].channelBuffers32[channel] = static_cast<Steinberg::Vst::Sample32 *>(buffer);
+                    }
+                }
+            }
+        };
+        take(hostProcessData.inputs, hostProcessData.numInputs);
+        take(hostProcessData.outputs, hostProcessData.numOutputs);
+        return true;
+    }
+    // It is assumed that "values" may be in musical units and ranges, and
+    // such must be normalized.  Note that `id` is `id`, and not an index.
+    // Note also that many parameters one might think are not normalized,
+    // _are_ normalized (legacy code).
+    void setParameter(Steinberg::int32 id, double value, Steinberg::int32 sampleOffset) {
+        double normalized_value = controller->plainParamToNormalized(id, value);
+#if PARAMETER_TRACING
+        csound->Message(csound, "vst3_plugin_t::setParameter: id: %9d  value: %9.4f normalized: %9.4f offset: %d\n",
+                        id,
+                        value,
+                        normalized_value,
+                        sampleOffset);
+#endif
+        // Handle program changes.
+        // The controller is queried and its parameters are sent to the processor.
+        Steinberg::Vst::ParameterInfo parameter_info;
+        controller->getParameterInfo(id, parameter_info);
+#if PARAMETER_TRACING
+        csound->Message(csound, "vst3_plugin_t::setParameter: getParameterInfo: id: %9d  flags: %d program change? %d\n",
+                        parameter_info.id, parameter_info.flags, (parameter_info.flags & parameter_info.kIsProgramChange));
+#endif
+        if (id == program_change_id) {
+            // Release the voices of the old program before it goes away.
+            release_all_notes(0);
+            auto controller_parameter_count = controller->getParameterCount();
+            for (auto controller_parameter = 0; controller_parameter < controller_parameter_count; ++controller_parameter) {
+                auto result = controller->getParameterInfo(controller_parameter, parameter_info);
+                // This all happens between process calls.
+                if (!(parameter_info.flags & parameter_info.kIsProgramChange)) {
+                    auto id = parameter_info.id;
+                    auto normalized_value = controller->getParamNormalized(id);
+                    add_parameter_change(id, normalized_value, 0);
+#if PARAMETER_TRACING
+                    csound->Message(csound, "vst3_plugin_t::setParameter: preset change from controller: id: %9d  normalized value: %9.4f\n",
+                                    id, normalized_value);
+#endif
+                }
+            }
+#if PARAMETER_TRACING
+            csound->Message(csound, "vst3_plugin_t::setParameter: handling program change...\n");
+#endif
+            Steinberg::FUnknownPtr<Steinberg::Vst::IEditControllerHostEditing> host_controller(controller);
+            if (host_controller) {
+#if PARAMETER_TRACING
+                csound->Message(csound, "vst3_plugin_t::setParameter: got IEditControllerHostEditing.\n");
+#endif
+                host_controller->beginEditFromHost(id);
+            }
+            component->setActive(false);
+            processor->setProcessing(false);
+            controller->setParamNormalized(id, normalized_value);
+#if PARAMETER_TRACING
+            csound->Message(csound, "vst3_plugin_t::setParameter: IEditController::setParamNormalized: id: %9d normalized_value: %9.4f.\n", id, normalized_value);
+#endif
+            if (host_controller) {
+                host_controller->endEditFromHost(id);
+            }
+            processor->setProcessing(true);
+            component->setActive(true);
+        }
+        add_parameter_change(id, normalized_value, sampleOffset);
+#if PARAMETER_TRACING
+        csound->Message(csound, "vst3_plugin_t::setParameter: ParameterChangeTransfer::addChange: id: %9d normalized_value: %9.4f sample offset: %9d.\n", id, normalized_value, sampleOffset);
+#endif
+    }
+    bool initialize(CSOUND *csound_, const VST3::Hosting::ClassInfo &classInfo_, Steinberg::Vst::PlugProvider *provider_) {
+        csound = csound_;
+        provider = provider_;
+        classInfo = classInfo_;
+        component_class_id = Steinberg::FUID{ classInfo.ID().data() };
+        processor_class_id = component_class_id;
+        component = provider->getComponent();
+        controller = provider->getController();
+        Steinberg::TUID controllerClassTUID;
+        if (component->getControllerClassId(controllerClassTUID) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::initialize: This component does not export an edit controller class ID!\n");
+        }
+        controller_class_id = Steinberg::FUID{ controllerClassTUID };
+#if EDITOR_IMPLEMENTED
+        if (controller) {
+            controller->setComponentHandler(component_handler());
+        }
+#endif
+        if (controller) {
+            controller->setComponentHandler(component_handler());
+        }
+        processor = component.get();
+        initProcessData();
+        paramTransferrer.setMaxParameters(parameter_change_capacity);
+        if (controller) {
+            reserve_parameter_queues(controller->getParameterCount());
+        }
+        midi_parameter_changes.reserve(kMaxMidiParameterChanges);
+        inputEventList.setMaxSize(kMaxInputEvents);
+        outputEventList.setMaxSize(kMaxOutputEvents);
+        output_events.reserve(kMaxOutputEvents);
+        information(false);
+        csound->Message(csound, "vst3_plugin_t::initialize completed.\n");
+        return true;
+    }
+    void terminate() {
+        if (!processor) {
+            return;
+        }
+        processor->setProcessing(false);
+        component->setActive(false);
+    }
+    void initProcessData() {
+        hostProcessData.inputEvents = &inputEventList;
+        hostProcessData.outputEvents = &outputEventList;
+        hostProcessData.inputParameterChanges = &inputParameterChanges;
+        hostProcessData.outputParameterChanges = &outputParameterChanges;
+        hostProcessData.processContext = &processContext;
+        initProcessContext();
+    }
+    void initProcessContext() {
+        processContext = {};
+        // Csound's default tempo is one beat per second.
+        processContext.tempo = 60;
+    }
+    bool update_process_setup() {
+        if (!processor) {
+            csound->Message(csound, "vst3_plugin_t::update_process_setup: null IProcessor.\n");
+            return false;
+        }
+        if (isProcessing) {
+            if (processor->setProcessing(false) != Steinberg::kResultOk) {
+                csound->Message(csound, "vst3_plugin_t::update_process_setup: Could not stop processing.\n");
+                return false;
+            }
+            if (component->setActive(false) != Steinberg::kResultOk) {
+                csound->Message(csound, "vst3_plugin_t::setActive: Could not deactivate component.\n");
+                return false;
+            }
+        }
+        Steinberg::Vst::ProcessSetup setup;
+        csound->Message(csound, "vst3_plugin_t::update_process_setup: canProcessSampleSize.\n");
+        if (processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue) {
+            plugin_sample_size = Steinberg::Vst::kSample64;
+            csound->Message(csound, "vst3_plugin_t::update_process_setup: processing 64 bit samples.\n");
+            setup.symbolicSampleSize = Steinberg::Vst::kSample64;
+        } else {
+            plugin_sample_size = Steinberg::Vst::kSample32;
+            csound->Message(csound, "vst3_plugin_t::update_process_setup: processing 32 bit samples.\n");
+            setup.symbolicSampleSize = Steinberg::Vst::kSample32;
+        }
+
+        // Request the VST3 plugin to adapt to the opcode's inputs and outputs. If that doesn't work,
+        // reset the bus arrangements according to what the plugin actually has implemented, and Csound
+        // will adapt to that.
+
+        auto inputArrangements = bus_arrangements(Steinberg::Vst::kInput, requested_input_channels);
+        auto outputArrangements = bus_arrangements(Steinberg::Vst::kOutput, requested_output_channels);
+        auto result = processor->setBusArrangements(
+                          inputArrangements.data(), static_cast<int32>(inputArrangements.size()),
+                          outputArrangements.data(), static_cast<int32>(outputArrangements.size()));
+        if (result == Steinberg::kResultOk) {
+            csound->Message(csound, "setBusArrangements succeeded.\n");
+        } else {
+            csound->Message(csound, "Warning: setBusArrangements returned %d.\n", result);
+            result = configureBusArrangementsFromPlugin(component, processor);
+            csound->Message(csound, "Setting bus arrangements from plugin returned %d.\n", result);
+        }
+        // The channel counts of the busses are only known now.
+        if (blockSize > 0 && !create_audio_buffers(blockSize)) {
+            isProcessing = false;
+            return false;
+        }
+        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kInput, 0, false);
+        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kOutput, 0, false);
+        activate_audio_busses(false);
+        setup.processMode = Steinberg::Vst::kRealtime;
+        setup.maxSamplesPerBlock = blockSize;
+        setup.sampleRate = sampleRate;
+        if (processor->setupProcessing(setup) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::update_process_setup: setupProcessing returned not OK.\n");
+            return false;
+        }
+        csound->Message(csound, "vst3_plugin_t::update_process_setup: activateBus.\n");
+        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kInput, 0, true);
+        csound->Message(csound, "activateBus(kEvent, kInput, 0)  returned %d\n", result);
+        result = component->activateBus(Steinberg::Vst::kEvent, Steinberg::Vst::kOutput, 0, true);
+        csound->Message(csound, "activateBus(kEvent, kOutput, 0) returned %d\n", result);
+        activate_audio_busses(true);
+        if (component->setActive(true) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::update_process_setup: setActive returned not OK.\n");
+            return false;
+        }
+        tail_samples = processor->getTailSamples();
+        publish_latency();
+        samples_since_activity = 0;
+        output_silent = false;
+        result = processor->setProcessing(true);
+        csound->Message(csound, "vst3_plugin_t::update_process_setup: setProcessing returned %d.\n", result);
+        if (result == Steinberg::kResultOk) {
+            isProcessing = true;
+        } else {
+            isProcessing = false;
+        }
+        return isProcessing;
+    }
+    /**
+     * Returns the plugin's latency at Csound's rate, including the delay of
+     * any oversampling filters.
+     */
+    Steinberg::uint32 plugin_latency() {
+        auto latency = processor->getLatencySamples();
+        if (oversampling > 1) {
+            latency = latency / oversampling + oversampler.latency();
+        } else if (bridge.plugin_sample_rate > 0) {
+            latency = static_cast<Steinberg::uint32>(latency / time_scale) + bridge.latency;
+        }
+        return latency;
+    }
+    /**
+     * Returns true if the plugin runs at Csound's rate, i.e. neither
+     * oversampled nor bridged.
+     */
+    bool runs_at_host_rate() const {
+        return oversampling == 1 && bridge.plugin_sample_rate == 0;
+    }
+    /**
+     * Converts a sample offset at Csound's rate to the plugin's rate.
+     */
+    Steinberg::int32 scale_offset(Steinberg::int32 sample_offset) const {
+        if (time_scale == 1.) {
+            return sample_offset;
+        }
+        auto scaled = static_cast<Steinberg::int32>(sample_offset * time_scale);
+        return blockSize > 0 ? std::min(scaled, blockSize - 1) : scaled;
+    }
+    /**
+     * Reads the plugin's latency, for update_latency to take up; on the
+     * worker thread, or at i-time.
+     */
+    void publish_latency() {
+        published_latency.store(plugin_latency(), std::memory_order_relaxed);
+        latency_changed.store(true, std::memory_order_release);
+    }
+    /**
+     * Takes up the latency last published, if it is new; returns true if it
+     * is. The plugin reports changes with kLatencyChanged, which is handled
+     * on the worker thread; see handle_restart_requests.
+     */
+    bool update_latency() {
+        if (!latency_changed.exchange(false, std::memory_order_acquire)) {
+            return false;
+        }
+        latency_samples = published_latency.load(std::memory_order_relaxed);
+        return true;
+    }
+    /**
+     * Turns latency compensation on or off; when on, output channels are
+     * delayed so that they line up with the plugin that has the most latency.
+     * The delay lines, and the buffer that vst3audiomix uses to delay the
+     * plugin's outputs before adding them, are sized for at least channels
+     * channels of frames frames. Allocates, and so must only be called at
+     * i-time.
+     */
+    void set_latency_compensation(bool enable, size_t channels, size_t frames) {
+        latency_compensation = enable;
+        if (enable) {
+            compensation_delay_lines.allocate(channels);
+            if (compensation_mix.size() < channels * frames) {
+                compensation_mix.resize(channels * frames);
+            }
+        }
+    }
+    /**
+     * Queues a normalized parameter value for the next block; the sample
+     * offset is at Csound's rate.
+     */
+    void add_parameter_change(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value, Steinberg::int32 sample_offset) {
+        paramTransferrer.addChange(id, value, scale_offset(sample_offset));
+        parameter_changes_pending = true;
+    }
+    /**
+     * Called once per block before processing; returns true if the plugin
+     * need not be processed in this block: auto-suspend is enabled, there
+     * are no events, parameter changes, sounding notes, or input signal,
+     * the last block output was silent, and the plugin's tail has expired.
+     */
+    bool should_suspend(bool input_silent) {
+        bool active = !input_silent ||
+                      inputEventList.getEventCount() > 0 ||
+                      parameter_changes_pending ||
+                      !midi_parameter_changes.empty() ||
+                      active_notes.size() > 0 ||
+                      pending_state_loads.load(std::memory_order_acquire) > 0;
+        if (active) {
+            samples_since_activity = 0;
+            return false;
+        }
+        samples_since_activity += blockSize;
+        return auto_suspend &&
+               output_silent &&
+               tail_samples != Steinberg::Vst::kInfiniteTail &&
+               samples_since_activity > tail_samples;
+    }
+    /**
+     * Builds the MIDI controller mapping table on first use; this should be
+     * called at i-time, as it may query the controller thousands of times.
+     */
+    void initialize_midi_cc_mapping() {
+        if (midiCCMapping.is_initialized()) {
+            return;
+        }
+        Steinberg::FUnknownPtr<Steinberg::Vst::IMidiMapping> midi_mapping(controller);
+        midiCCMapping.initialize(component, midi_mapping);
+        csound->Message(csound, "vst3_plugin_t::initialize_midi_cc_mapping: event busses: %d mapped controllers: %d\n",
+                        midiCCMapping.bus_count,
+                        int(std::count_if(midiCCMapping.parameter_ids.begin(), midiCCMapping.parameter_ids.end(),
+                                          [](Steinberg::Vst::ParamID id) { return id != Steinberg::Vst::kNoParamId; })));
+    }
+    /**
+     * Queues a parameter change translated from MIDI. If the same parameter
+     * has already been changed at the same sample offset in this block, the
+     * later value replaces the earlier one.
+     */
+    void add_midi_parameter_change(Steinberg::Vst::ParamID id, Steinberg::Vst::ParamValue value, Steinberg::int32 sample_offset) {
+        sample_offset = scale_offset(sample_offset);
+        for (auto &change : midi_parameter_changes) {
+            if (change.id == id && change.sample_offset == sample_offset) {
+                change.value = value;
+                return;
+            }
+        }
+        if (midi_parameter_changes.size() < midi_parameter_changes.capacity()) {
+            midi_parameter_changes.push_back({id, sample_offset, value});
+        } else {
+            csound->Message(csound, "vst3_plugin_t::add_midi_parameter_change: too many changes in this block, dropping id: %d.\n", id);
+        }
+    }
+    /**
+     * Copies the events that the plugin output during the most recent
+     * process call into a preallocated buffer, where they remain until the
+     * next process call. Each copy is stamped with a block count so that
+     * readers can tell when the buffer has been refilled. Between
+     * begin_output_events and end_output_events, the events of several
+     * process calls are gathered instead.
+     */
+    void capture_output_events() {
+        if (!accumulating_output_events) {
+            output_events.clear();
+        }
+        auto event_count = outputEventList.getEventCount();
+        for (Steinberg::int32 event_index = 0; event_index < event_count; ++event_index) {
+            if (output_events.size() == output_events.capacity()) {
+                break;
+            }
+            Steinberg::Vst::Event event;
+            if (outputEventList.getEvent(event_index, event) == Steinberg::kResultOk) {
+                event.sampleOffset = static_cast<Steinberg::int32>((output_events_offset + event.sampleOffset) / time_scale);
+                output_events.push_back(event);
+            }
+        }
+        if (!accumulating_output_events) {
+            output_events_block++;
+        }
+    }
+    /**
+     * Begins a Csound block that is processed as several plugin blocks,
+     * e.g. by the sample rate bridge, so that the events output by all of
+     * them are captured as one block. Before each process call, the caller
+     * sets output_events_offset to the start of the plugin block in plugin
+     * frames.
+     */
+    void begin_output_events() {
+        output_events.clear();
+        output_events_offset = 0;
+        accumulating_output_events = true;
+    }
+    /**
+     * Ends the Csound block begun by begin_output_events, clamping the
+     * sample offsets to its frame_count frames, and routes the events.
+     */
+    void end_output_events(Steinberg::int32 frame_count) {
+        for (auto &event : output_events) {
+            event.sampleOffset = std::min(event.sampleOffset, frame_count - 1);
+        }
+        accumulating_output_events = false;
+        output_events_offset = 0;
+        output_events_block++;
+        route_output_events();
+    }
+    /**
+     * Sends the events captured from this plugin's most recent block
+     * straight into the input of each destination plugin, with their sample
+     * offsets unchanged. Routed notes are entered in the destination's table
+     * of active notes, under IDs that it assigns, so that they cannot clash
+     * with its other notes and vst3panic can release them. MIDI controller
+     * events are translated through the destination's MIDI mapping into
+     * parameter changes. If the destination has not yet been processed in
+     * this kperiod, the events are processed in the same block; otherwise,
+     * in the next block. On the performance thread only, as the
+     * destinations are not locked; see defer_event_routing.
+     */
+    void route_output_events() {
+        if (event_destinations.empty()) {
+            return;
+        }
+        for (auto destination : event_destinations) {
+            for (auto event : output_events) {
+                if (event.type == Steinberg::Vst::Event::kLegacyMIDICCOutEvent) {
+                    MYFLT fields[6];
+                    if (event_to_midi(event, fields)) {
+                        destination->send_channel_message(uint8_t(fields[0]), uint8_t(fields[1]), uint8_t(fields[2]), uint8_t(fields[3]), event.sampleOffset);
+                    }
+                    continue;
+                }
+                if (event.type == Steinberg::Vst::Event::kNoteOnEvent) {
+                    auto source_id = event.noteOn.noteId;
+                    event.noteOn.noteId = destination->active_notes.add(event.noteOn.channel, event.noteOn.pitch, event.noteOn.tuning);
+                    if (event.noteOn.noteId != -1 && routed_note_count < routed_notes.size()) {
+                        routed_notes[routed_note_count++] = {destination, source_id, event.noteOn.channel, event.noteOn.pitch, event.noteOn.noteId};
+                    }
+                } else if (event.type == Steinberg::Vst::Event::kNoteOffEvent) {
+                    auto id = find_routed_note(destination, event.noteOff.noteId, event.noteOff.channel, event.noteOff.pitch, true);
+                    if (id == -1) {
+                        id = destination->active_notes.find(event.noteOff.channel, event.noteOff.pitch);
+                    }
+                    // Already released, e.g. by vst3panic.
+                    if (!destination->active_notes.remove(id)) {
+                        continue;
+                    }
+                    event.noteOff.noteId = id;
+                } else if (event.type == Steinberg::Vst::Event::kPolyPressureEvent) {
+                    event.polyPressure.noteId = find_routed_note(destination, event.polyPressure.noteId, event.polyPressure.channel, event.polyPressure.pitch, false);
+                }
+                event.busIndex = 0;
+                if (destination->inputEventList.addEvent(event) != Steinberg::kResultOk) {
+                    csound->Message(csound, "vst3_plugin_t::route_output_events: addEvent error.\n");
+                }
+            }
+        }
+    }
+    /**
+     * Returns the destination's ID for a note that this plugin has routed
+     * to it, found by this plugin's note ID or, if that is -1, by the most
+     * recent note on the key; or -1 if there is none. If release is true,
+     * the note is forgotten.
+     */
+    Steinberg::int32 find_routed_note(vst3_plugin_t *destination, Steinberg::int32 source_id, Steinberg::int16 channel, Steinberg::int16 pitch, bool release) {
+        for (size_t index = routed_note_count; index-- > 0;) {
+            auto &note = routed_notes[index];
+            if (note.destination != destination) {
+                continue;
+            }
+            if (source_id != -1 ? note.source_id == source_id : (note.channel == channel && note.pitch == pitch)) {
+                auto id = note.destination_id;
+                if (release) {
+                    note = routed_notes[--routed_note_count];
+                }
+                return id;
+            }
+        }
+        return -1;
+    }
+    void transfer_midi_parameter_changes() {
+        for (const auto &change : midi_parameter_changes) {
+            Steinberg::int32 index = 0;
+            auto queue = inputParameterChanges.addParameterData(change.id, index);
+            if (queue) {
+                queue->addPoint(change.sample_offset, change.value, index);
+            }
+        }
+        midi_parameter_changes.clear();
+    }
+    /**
+     * Sends a note on event, and enters the note in the table of active
+     * notes. The real-valued MIDI key is split into an integer key and a
+     * tuning in cents, and the velocity is in MIDI units. Returns the new
+     * note's ID.
+     */
+    Steinberg::int32 note_on(Steinberg::int16 channel, MYFLT key, MYFLT velocity, Steinberg::int32 length, Steinberg::int32 sample_offset) {
+        Steinberg::Vst::Event event{};
+        event.type = Steinberg::Vst::Event::EventTypes::kNoteOnEvent;
+        event.sampleOffset = sample_offset;
+        event.noteOn.channel = channel & 0xF;
+        event.noteOn.pitch = static_cast<Steinberg::int16>(std::round(key));
+        event.noteOn.tuning = (key - event.noteOn.pitch) * double(100.0);
+        event.noteOn.velocity = velocity / 127.;
+        event.noteOn.length = length;
+        event.noteOn.noteId = active_notes.add(event.noteOn.channel, event.noteOn.pitch, event.noteOn.tuning);
+        if (event.noteOn.noteId == -1) {
+            csound->Message(csound, "vst3_plugin_t::note_on: too many active notes, note will not be tracked.\n");
+        }
+        if (inputEventList.addEvent(event) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::note_on: addEvent error.\n");
+        }
+        return event.noteOn.noteId;
+    }
+    /**
+     * Sends a note off event, and removes the note from the table of active
+     * notes. If id is -1, the most recent note on the key is turned off.
+     * Does nothing and returns false if the note is no longer sounding, e.g.
+     * because it was turned off by vst3panic.
+     */
+    bool note_off(Steinberg::int16 channel, Steinberg::int16 pitch, float tuning, Steinberg::int32 id, Steinberg::int32 sample_offset) {
+        if (id == -1) {
+            id = active_notes.find(channel, pitch);
+        }
+        if (!active_notes.remove(id)) {
+            return false;
+        }
+        Steinberg::Vst::Event event{};
+        event.type = Steinberg::Vst::Event::EventTypes::kNoteOffEvent;
+        event.sampleOffset = sample_offset;
+        event.noteOff.channel = channel & 0xF;
+        event.noteOff.pitch = pitch;
+        event.noteOff.tuning = tuning;
+        event.noteOff.velocity = 0;
+        event.noteOff.noteId = id;
+        if (inputEventList.addEvent(event) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::note_off: addEvent error.\n");
+        }
+        return true;
+    }
+    /**
+     * Turns off every active note in one sweep of the table of active notes.
+     * Returns the number of notes turned off.
+     */
+    Steinberg::int32 release_all_notes(Steinberg::int32 sample_offset) {
+        Steinberg::int32 count = 0;
+        for (const auto &note : active_notes.notes) {
+            if (note.note_id != -1) {
+                if (note_off(note.channel, note.pitch, note.tuning, note.note_id, sample_offset)) {
+                    count++;
+                }
+            }
+        }
+        return count;
+    }
+    /**
+     * Sends one MIDI channel message to the plugin on the first event bus.
+     * Note on and note off messages are tracked in the table of active notes.
+     * Control change, channel aftertouch, pitch bend, and program change
+     * messages are translated through the plugin's MIDI mapping into
+     * parameter changes, because VST3 plugins do not receive these as
+     * events; all other messages are sent as events. Returns false if the
+     * message could not be delivered.
+     */
+    bool send_channel_message(uint8_t status, uint8_t channel, uint8_t data1, uint8_t data2, Steinberg::int32 sample_offset) {
+        status = status & 0xF0;
+        channel = channel & 0x0F;
+        data1 = data1 & 0x7F;
+        data2 = data2 & 0x7F;
+        Steinberg::int32 controller = -1;
+        Steinberg::Vst::ParamValue value = 0;
+        switch (status) {
+        case 0xB0:
+            controller = data1;
+            value = data2 / 127.;
+            break;
+        case 0xD0:
+            controller = Steinberg::Vst::kAfterTouch;
+            value = data1 / 127.;
+            break;
+        case 0xE0:
+            controller = Steinberg::Vst::kPitchBend;
+            value = ((data2 << 7) | data1) / 16383.;
+            break;
+        case 0xC0:
+            controller = Steinberg::Vst::kCtrlProgramChange;
+            break;
+        default:
+            break;
+        }
+        if (status == 0x90 && data2 > 0) {
+            note_on(channel, data1, data2, 0, sample_offset);
+            return true;
+        }
+        if (status == 0x80 || status == 0x90) {
+            return note_off(channel, data1, 0, -1, sample_offset);
+        }
+        if (controller != -1) {
+            auto parameter_id = midiCCMapping.parameter_id(0, channel, controller);
+            if (parameter_id == Steinberg::Vst::kNoParamId) {
+#if EVENT_TRACING
+                csound->Message(csound, "vst3_plugin_t::send_channel_message: controller %d on channel %d is not mapped.\n", controller, channel);
+#endif
+                return false;
+            }
+            if (status == 0xC0) {
+                // Program changes are plain values, and need the controller's
+                // own handling.
+                setParameter(parameter_id, data1, sample_offset);
+            } else {
+                add_midi_parameter_change(parameter_id, value, sample_offset);
+            }
+            return true;
+        }
+        auto event = Steinberg::Vst::midiToEvent(status, channel, data1, data2);
+        if (!event) {
+            return false;
+        }
+        event->sampleOffset = sample_offset;
+        if (inputEventList.addEvent(*event) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::send_channel_message: addEvent error.\n");
+            return false;
+        }
+        return true;
+    }
+#if EDITOR_IMPLEMENTED
+    bool processVstEvent(const Steinberg::Vst::IMidiClient::Event& event, int32 port) {
+        auto vstEvent = Steinberg::Vst::midiToEvent(event.type, event.channel, event.data0, event.data1);
+        if (vstEvent) {
+            vstEvent->busIndex = port;
+            if (inputEventList.addEvent(*vstEvent) != Steinberg::kResultOk) {
+                assert(false && "Event was not added to EventList!");
+            }
+            return true;
+        }
+        return false;
+    }
+    bool processParamChange(const Steinberg::Vst::IMidiClient::Event& event, int32 port) {
+        auto paramMapping = [port, this](int32 channel, Steinberg::Vst::MidiData data1) -> Steinberg::Vst::ParamID {
+            return midiCCMapping.parameter_id(port, channel, data1);
+        };
+        auto paramChange =
+            Steinberg::Vst::midiToParameter(event.type, event.channel, event.data0, event.data1, paramMapping);
+        if (paramChange) {
+            int32 index = 0;
+            Steinberg::Vst::IParamValueQueue* queue =
+                inputParameterChanges.addParameterData((*paramChange).first, index);
+            if (queue) {
+                if (queue->addPoint(event.timestamp,(*paramChange).second, index) != Steinberg::kResultOk) {
+                    assert(false && "Parameter point was not added to ParamValueQueue!");
+                }
+            }
+            return true;
+        }
+        return false;
+    }
+#endif
+    void information(bool print) {
+        Steinberg::TUID controllerClassTUID;
+        if (controller_class_id.isValid() == false) {
+            csound->Message(csound, "vst3_plugin_t: The edit controller class has no valid UID!\n");
+        }
+        // Class information.
+        if (print == true) {
+            char buffer[0x200];
+            component_class_id.toRegistryString(buffer);
+            csound->Message(csound, "vst3_plugin_t: class:      component class id:  %s\n", buffer);
+            // Same as Component class ID.
+            csound->Message(csound, "               class:      processor class id:  %s\n", buffer);
+            controller_class_id.toRegistryString(buffer);
+            csound->Message(csound, "               class:      controller class id: %s\n", buffer);
+            csound->Message(csound, "               class:      cardinality:         %i\n", classInfo.cardinality());
+            csound->Message(csound, "               class:      category:            %s\n", classInfo.category().c_str());
+            csound->Message(csound, "               class:      name:                %s\n", classInfo.name().c_str());
+            csound->Message(csound, "               class:      vendor:              %s\n", classInfo.vendor().c_str());
+            csound->Message(csound, "               class:      version:             %s\n", classInfo.version().c_str());
+            csound->Message(csound, "               class:      sdkVersion:          %s\n", classInfo.sdkVersion().c_str());
+            csound->Message(csound, "               class:      subCategoriesString: %s\n", classInfo.subCategoriesString().c_str());
+            csound->Message(csound, "               class:      classFlags:          %i\n", classInfo.classFlags());
+            csound->Message(csound, "               can process 32 bit samples: %s\n", processor->canProcessSampleSize(Steinberg::Vst::kSample32) == Steinberg::kResultTrue ? "yes" : "no");
+            csound->Message(csound, "               can process 64 bit samples: %s\n", processor->canProcessSampleSize(Steinberg::Vst::kSample64) == Steinberg::kResultTrue ? "yes" : "no");
+            csound->Message(csound, "               Csound samples: %d bits\n", int((sizeof(MYFLT) * 8)));
+            // Input and output busses.
+            // There is no ID in a BusInfo.
+            int32 n = component->getBusCount( Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kInput);
+            for (int32 i = 0; i < n; i++) {
+                Steinberg::Vst::BusInfo busInfo = {};
+                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kInput, i, busInfo);
+                auto name = VST3::StringConvert::convert(busInfo.name);
+                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
+                                i,
+                                busInfo.direction == 0 ? "Input " : "Output",
+                                busInfo.mediaType == 0 ? "Audio" : "Event",
+                                busInfo.channelCount,
+                                busInfo.busType == 0 ? "Main" : "Aux ",
+                                busInfo.flags,
+                                name.data());
+            }
+            n = component->getBusCount( Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kInput);
+            for (int32 i = 0; i < n; i++) {
+                Steinberg::Vst::BusInfo busInfo = {};
+                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kInput, i, busInfo);
+                auto name = VST3::StringConvert::convert(busInfo.name);
+                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
+                                i,
+                                busInfo.direction == 0 ? "Input " : "Output",
+                                busInfo.mediaType == 0 ? "Audio" : "Event",
+                                busInfo.channelCount,
+                                busInfo.busType == 0 ? "Main" : "Aux ",
+                                busInfo.flags,
+                                name.data());
+            }
+            n = component->getBusCount( Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kOutput);
+            for (int32 i = 0; i < n; i++) {
+                Steinberg::Vst::BusInfo busInfo = {};
+                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kAudio, Steinberg::Vst::kOutput, i, busInfo);
+                auto name = VST3::StringConvert::convert(busInfo.name);
+                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
+                                i,
+                                busInfo.direction == 0 ? "Input " : "Output",
+                                busInfo.mediaType == 0 ? "Audio" : "Event",
+                                busInfo.channelCount,
+                                busInfo.busType == 0 ? "Main" : "Aux ",
+                                busInfo.flags,
+                                name.data());
+            }
+            n = component->getBusCount( Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kOutput);
+            for (int32 i = 0; i < n; i++) {
+                Steinberg::Vst::BusInfo busInfo = {};
+                auto result = component->getBusInfo(Steinberg::Vst::MediaTypes::kEvent, Steinberg::Vst::kOutput, i, busInfo);
+                auto name = VST3::StringConvert::convert(busInfo.name);
+                csound->Message(csound, "               Buss[%3d]:  direction: %s  media: %s  channels: %3d  bus type: %s  flags: %d  name: %-32s\n",
+                                i,
+                                busInfo.direction == 0 ? "Input " : "Output",
+                                busInfo.mediaType == 0 ? "Audio" : "Event",
+                                busInfo.channelCount,
+                                busInfo.busType == 0 ? "Main" : "Aux ",
+                                busInfo.flags,
+                                name.data());
+            }
+        }
+        // Parameters.
+        if (controller) {
+            int32 n = controller->getParameterCount();
+            Steinberg::Vst::ParameterInfo parameterInfo;
+            if (print == true)
+            {
+                csound->Message(csound, "               parameter count:   %4d\n", n);
+                for (int i = 0; i < n; ++i) {
+                    controller->getParameterInfo(i, parameterInfo);
+                    Steinberg::String title(parameterInfo.title);
+                    title.toMultiByte(Steinberg::kCP_Utf8);
+                    Steinberg::String units(parameterInfo.units);
+                    units.toMultiByte(Steinberg::kCP_Utf8);
+                    double value = controller->getParamNormalized(parameterInfo.id);
+                    int32 step_count = parameterInfo.stepCount;
+                    if (((parameterInfo.flags & Steinberg::Vst::ParameterInfo::kIsProgramChange) == Steinberg::Vst::ParameterInfo::kIsProgramChange)) {
+                        program_change_id = parameterInfo.id;
+                    }
+                    if (print == true) csound->Message(csound, "               parameter:  index: %4d: id: %12d name: %-64s units: %-16s step count: %-4d default: %9.4f value: %9.4f %s\n",
+                                                           i,
+                                                           parameterInfo.id,
+                                                           title.text8(),
+                                                           units.text8(),
+                                                           step_count,
+                                                           parameterInfo.defaultNormalizedValue,
+                                                           value,
+                                                           ((parameterInfo.flags & Steinberg::Vst::ParameterInfo::kIsProgramChange) == Steinberg::Vst::ParameterInfo::kIsProgramChange) ? "program change" : "");
+                }
+            }
+        }
+        if (print == true) {
+            // Units, program lists, and programs, in a flat list.
+            Steinberg::FUnknownPtr<Steinberg::Vst::IUnitInfo> i_unit_info(controller);
+            if (i_unit_info) {
+                auto unit_count = i_unit_info->getUnitCount();
+                for (auto unit_index = 0; unit_index < unit_count; ++unit_index) {
+                    Steinberg::Vst::UnitInfo unit_info;
+                    i_unit_info->getUnitInfo(unit_index, unit_info);
+                    auto program_list_count = i_unit_info->getProgramListCount();
+                    for (auto program_list_index = 0; program_list_index < program_list_count; ++program_list_index) {
+                        Steinberg::Vst::ProgramListInfo program_list_info;
+                        if (i_unit_info->getProgramListInfo(program_list_index, program_list_info) == Steinberg::kResultOk) {
+                            for (auto program_index = 0; program_index < program_list_info.programCount; ++program_index) {
+                                Steinberg::Vst::TChar program_name[256];
+                                i_unit_info->getProgramName(unit_info.programListId, program_index, program_name);
+                                csound->Message(csound, "               unit:       id: %7d (parent id: %4d) name: %-32s program list: id: %12d (index: %4d) program: id: %4d name: %s\n",
+                                                unit_info.id,
+                                                unit_info.parentUnitId,
+                                                VST3::StringConvert::convert(unit_info.name).c_str(),
+                                                unit_info.programListId,
+                                                program_list_index,
+                                                program_index,
+                                                VST3::StringConvert::convert(program_name).data());
+                            }
+                        }
+                    }
+                }
+            }
+        }
+    }
+    void setTempo(double new_tempo) {
+        processContext.tempo = new_tempo;
+    }
+#if EDITOR_IMPLEMENTED
+    void showPluginEditorWindow() {
+        auto view = owned(controller->createView(Steinberg::Vst::ViewType::kEditor));
+        if (!view) {
+            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: controller does not provide its own editor!\n");
+            \
+            return;
+        }
+        Steinberg::ViewRect plugViewSize {};
+        auto result = view->getSize(&plugViewSize);
+        if (result != Steinberg::kResultTrue) {
+            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: could not get editor view size.\n");
+            \
+        }
+        auto viewRect = Steinberg::Vst::EditorHost::ViewRectToRect(plugViewSize);
+#if 1
+        auto windowController = std::make_shared<CsoundWindowController>(view);
+        auto window = Steinberg::Vst::EditorHost::IPlatform::instance().createWindow("Editor",
+                      viewRect.size, view->canResize() == Steinberg::kResultTrue, windowController);
+        if (result != Steinberg::kResultTrue) {
+            csound->Message(csound, "vst3_plugin_t::showPluginEditorWindow: could not create window for plugin editor.\n");
+            \
+        }
+        if (window) {
+            window->show();
+        }
+#endif
+    }
+#endif
+    ComponentHandler *component_handler() {
+        return &component_handler_;
+    }
+    // Returns true on success; false on any failure.
+    inline bool load_preset(const std::string &filepath) {
+        csound->Message(csound, "Loading preset from file: \"%s\"...\n", filepath.c_str());
+        if (!component) {
+            csound->Message(csound, "Error: IComponent is null.\n");
+            return false;
+        }
+        release_all_notes(0);
+        auto blob = read_preset(filepath);
+        if (!blob) {
+            return false;
+        }
+        std::lock_guard<std::mutex> state_lock(state_mutex);
+        return apply_preset(blob->data(), blob->size());
+    }
+    /**
+     * Loads the preset on the worker thread, and returns at once. The
+     * plugin's state changes between two kperiods. Until then, the plugin
+     * goes on playing its old state; or, if keep_old_state is false, is
+     * silent.
+     */
+    void load_preset_async(const std::string &filepath, bool keep_old_state) {
+        if (!worker) {
+            load_preset(filepath);
+            return;
+        }
+        csound->Message(csound, "Loading preset from file in the background: \"%s\"...\n", filepath.c_str());
+        if (!component) {
+            csound->Message(csound, "Error: IComponent is null.\n");
+            return;
+        }
+        post_state_change(keep_old_state, [this, filepath] {
+            auto blob = read_preset(filepath);
+            if (blob) {
+                std::lock_guard<std::mutex> state_lock(state_mutex);
+                apply_preset(blob->data(), blob->size());
+            }
+        });
+    }
+    /**
+     * Loads a preset that is already in memory, e.g. in a preset bank,
+     * which must outlive the load; if async is true, as load_preset_async.
+     */
+    bool load_preset_data(const char *data, size_t size, bool async, bool keep_old_state) {
+        if (!component) {
+            csound->Message(csound, "Error: IComponent is null.\n");
+            return false;
+        }
+        if (!async || !worker) {
+            release_all_notes(0);
+            std::lock_guard<std::mutex> state_lock(state_mutex);
+            return apply_preset(data, size);
+        }
+        post_state_change(keep_old_state, [this, data, size] {
+            std::lock_guard<std::mutex> state_lock(state_mutex);
+            apply_preset(data, size);
+        });
+        return true;
+    }
+    /**
+     * Runs a change of the plugin's state on the worker thread. The change
+     * must take the state_mutex while it touches the plugin. Unless
+     * keep_old_state is true, the plugin is silent until the change is done.
+     */
+    void post_state_change(bool keep_old_state, std::function<void()> change) {
+        // Note offs must be sent from the performance thread.
+        release_all_notes(0);
+        pending_state_loads.fetch_add(1, std::memory_order_acq_rel);
+        if (!keep_old_state) {
+            muting_state_loads.fetch_add(1, std::memory_order_acq_rel);
+        }
+        worker->post([this, keep_old_state, change] {
+            change();
+            {
+                std::lock_guard<std::mutex> state_lock(state_mutex);
+                capture_good_state();
+            }
+            if (!keep_old_state) {
+                muting_state_loads.fetch_sub(1, std::memory_order_acq_rel);
+            }
+            pending_state_loads.fetch_sub(1, std::memory_order_acq_rel);
+        });
+    }
+    /**
+     * Captures the plugin's state now, and writes it as a preset file on the
+     * worker thread, atomically. Returns the serial number of the save, for
+     * save_status, or 0 if the state could not be captured.
+     */
+    uint64_t save_preset_async(const std::string &filepath) {
+        if (!component) {
+            csound->Message(csound, "vst3_plugin_t::save_preset_async: IComponent is null.\n");
+            return 0;
+        }
+        auto stream = stream_pool->acquire();
+        bool ok = Steinberg::Vst::PresetFile::savePreset(stream.get(), processor_class_id, component, controller);
+        if (!ok) {
+            csound->Message(csound, "vst3_plugin_t::save_preset_async: failed to serialize state.\n");
+            stream_pool->release(std::move(stream));
+            return 0;
+        }
+        auto serial = saves_requested.fetch_add(1, std::memory_order_acq_rel) + 1;
+        auto write = [this, filepath, stream, serial] {
+            Steinberg::int64 size = 0;
+            stream->tell(&size);
+            std::string error;
+            if (write_file_atomically(filepath, stream->getData(), static_cast<size_t>(size), error)) {
+                csound->Message(csound, "vst3_plugin_t::save_preset_async: saved preset to %s (%zu bytes).\n", filepath.c_str(), static_cast<size_t>(size));
+            } else {
+                csound->Message(csound, "vst3_plugin_t::save_preset_async: %s\n", error.c_str());
+                last_failed_save.store(serial, std::memory_order_release);
+            }
+            stream_pool->release(stream);
+            saves_done.store(serial, std::memory_order_release);
+        };
+        if (worker) {
+            worker->post(write);
+        } else {
+            write();
+        }
+        return serial;
+    }
+    /**
+     * Returns a new save request for the file, owned by the plugin; at
+     * i-time only.
+     */
+    preset_save_request_t *add_preset_save_request(const std::string &filepath) {
+        preset_save_requests.emplace_back(new preset_save_request_t);
+        preset_save_requests.back()->filepath = filepath;
+        return preset_save_requests.back().get();
+    }
+    /**
+     * Requests a save from the performance thread: this neither allocates
+     * nor waits. Returns the serial number of the save, for save_status, or
+     * 0 if the previous save of the request is still pending or the
+     * worker's queue is busy.
+     */
+    uint64_t request_preset_save(preset_save_request_t *request) {
+        if (!worker || !component || request->pending.exchange(true, std::memory_order_acq_rel)) {
+            return 0;
+        }
+        request->serial = saves_requested.fetch_add(1, std::memory_order_acq_rel) + 1;
+        worker_job_t job;
+        job.kind = worker_job_t::kSavePreset;
+        job.plugin = this;
+        job.save_request = request;
+        if (!worker->try_post(job)) {
+            // Never completed, so that save_status reports the failure.
+            last_failed_save.store(request->serial, std::memory_order_release);
+            request->pending.store(false, std::memory_order_release);
+            return 0;
+        }
+        return request->serial;
+    }
+    /**
+     * Runs on the worker thread; see request_preset_save. Hosts commonly
+     * call getState from a user interface thread while the plugin
+     * processes, so the plugin is not silenced.
+     */
+    void save_preset(preset_save_request_t *request) {
+        auto serial = request->serial;
+        auto stream = stream_pool->acquire();
+        std::string error;
+        Steinberg::int64 size = 0;
+        bool ok = Steinberg::Vst::PresetFile::savePreset(stream.get(), processor_class_id, component, controller);
+        if (ok) {
+            stream->tell(&size);
+            ok = write_file_atomically(request->filepath, stream->getData(), static_cast<size_t>(size), error);
+        } else {
+            error = "failed to serialize state.";
+        }
+        if (ok) {
+            csound->Message(csound, "vst3_plugin_t::save_preset: saved preset to %s (%zu bytes).\n", request->filepath.c_str(), static_cast<size_t>(size));
+        } else {
+            csound->Message(csound, "vst3_plugin_t::save_preset: %s\n", error.c_str());
+            last_failed_save.store(serial, std::memory_order_release);
+        }
+        stream_pool->release(std::move(stream));
+        saves_done.store(serial, std::memory_order_release);
+        request->pending.store(false, std::memory_order_release);
+    }
+    /**
+     * Returns 0 while the save is pending, 1 if it succeeded, and -1 if it
+     * failed.
+     */
+    int save_status(uint64_t serial) const {
+        if (serial == 0 || last_failed_save.load(std::memory_order_acquire) == serial) {
+            return -1;
+        }
+        return saves_done.load(std::memory_order_acquire) >= serial ? 1 : 0;
+    }
+    /**
+     * Lists, once, the IDs and step counts of the parameters that can be
+     * set from the host, i.e. all but read-only and program change
+     * parameters.
+     */
+    void initialize_parameter_list() {
+        if (!controller || !parameter_ids.empty()) {
+            return;
+        }
+        list_parameters(parameter_ids, parameter_step_counts);
+        // Every parameter may change in one kperiod.
+        reserve_parameter_changes(parameter_ids.size());
+    }
+    void list_parameters(std::vector<Steinberg::Vst::ParamID> &ids, std::vector<Steinberg::int32> &step_counts) {
+        auto count = controller->getParameterCount();
+        for (Steinberg::int32 index = 0; index < count; ++index) {
+            Steinberg::Vst::ParameterInfo parameter_info;
+            if (controller->getParameterInfo(index, parameter_info) != Steinberg::kResultOk) {
+                continue;
+            }
+            if (parameter_info.flags & (parameter_info.kIsReadOnly | parameter_info.kIsProgramChange)) {
+                continue;
+            }
+            ids.push_back(parameter_info.id);
+            step_counts.push_back(parameter_info.stepCount);
+        }
+    }
+    /**
+     * Returns a lock on the state_mutex, which is not held if the worker is
+     * changing the plugin's state or configuration; in that case, the plugin
+     * must not be processed, nor its buffers touched.
+     */
+    std::unique_lock<std::mutex> try_lock_state() {
+        return std::unique_lock<std::mutex>(state_mutex, std::try_to_lock);
+    }
+    /**
+     * Handles the plugin's restartComponent requests. This is called once
+     * per kperiod on the performance thread, and takes no locks: the work is
+     * posted to the worker thread, and its results are taken up here.
+     * Reconfiguring the plugin's busses holds the state_mutex, so the plugin
+     * is silent for the few kperiods that takes, and bumps buffer_generation
+     * so that opcodes know to look up the new buffers.
+     */
+    void handle_restart_requests() {
+        if (notes_cleared.exchange(false, std::memory_order_acq_rel)) {
+            active_notes.clear();
+        }
+        // Do not free memory on this thread: a refresh that has been taken
+        // up is freed on the worker, and kept until it can be posted there.
+        if (retired_refresh && free_on_worker(retired_refresh)) {
+            retired_refresh = nullptr;
+        }
+        auto refresh = retired_refresh ? nullptr : pending_refresh.exchange(nullptr, std::memory_order_acq_rel);
+        if (refresh) {
+            if (refresh->has_midi_cc_mapping) {
+                std::swap(midiCCMapping, refresh->midi_cc_mapping);
+            }
+            if (refresh->has_parameter_list) {
+                std::swap(parameter_ids, refresh->parameter_ids);
+                std::swap(parameter_step_counts, refresh->parameter_step_counts);
+            }
+            if (!free_on_worker(refresh)) {
+                retired_refresh = refresh;
+            }
+        }
+        if (restart_pending.load(std::memory_order_acquire)) {
+            return;
+        }
+        auto flags = component_handler_.take_restart_flags(Steinberg::Vst::kReloadComponent |
+                     Steinberg::Vst::kIoChanged |
+                     Steinberg::Vst::kLatencyChanged |
+                     Steinberg::Vst::kMidiCCAssignmentChanged |
+                     Steinberg::Vst::kParamTitlesChanged |
+                     Steinberg::Vst::kParamIDMappingChanged);
+        if (flags == 0 || !worker) {
+            return;
+        }
+        restart_pending.store(true, std::memory_order_release);
+        worker_job_t job;
+        job.kind = worker_job_t::kRestart;
+        job.plugin = this;
+        job.flags = flags;
+        if (!worker->try_post(job)) {
+            // Try again in the next kperiod.
+            restart_pending.store(false, std::memory_order_release);
+            component_handler_.restartComponent(flags);
+        }
+    }
+    /**
+     * Posts a refresh to the worker to be freed; returns false if it could
+     * not be posted.
+     */
+    bool free_on_worker(controller_refresh_t *refresh) {
+        worker_job_t job;
+        job.kind = worker_job_t::kFreeRefresh;
+        job.refresh = refresh;
+        return worker->try_post(job);
+    }
+    /**
+     * Deactivates and reactivates the plugin, which clears its voices and
+     * delay lines, and then restores the given state; the controller state
+     * may be null. The caller must hold the state_mutex if the plugin may be
+     * processing. The table of active notes is cleared on the performance
+     * thread; see handle_restart_requests.
+     */
+    void reactivate(Steinberg::MemoryStream *component_state, Steinberg::MemoryStream *controller_state) {
+        processor->setProcessing(false);
+        component->setActive(false);
+        component_state->seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+        component->setState(component_state);
+        if (controller_state) {
+            controller_state->seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+            controller->setState(controller_state);
+        }
+        component->setActive(true);
+        isProcessing = processor->setProcessing(true) == Steinberg::kResultOk;
+        notes_cleared.store(true, std::memory_order_release);
+    }
+    /**
+     * Adds one block's counts of abnormal output samples to the statistics;
+     * any non-finite samples, which have been silenced, are a fault. On the
+     * performance thread.
+     */
+    void record_abnormal_samples(uint64_t denormals, uint64_t non_finite) {
+        if (denormals) {
+            stats.add(plugin_stats_t::kDenormals, denormals);
+        }
+        if (non_finite) {
+            stats.add(plugin_stats_t::kNonFinite, non_finite);
+            output_fault();
+        }
+    }
+    /**
+     * Called on the performance thread when the plugin has output NaN or
+     * infinite samples, which have already been replaced with silence.
+     * Counts the fault and, if reset_on_fault is set, posts a reset to the
+     * worker thread unless one is already pending.
+     */
+    void output_fault() {
+        stats.add(plugin_stats_t::kFaults, 1);
+        if (!reset_on_fault || !worker || reset_pending.exchange(true, std::memory_order_acq_rel)) {
+            return;
+        }
+        worker_job_t job;
+        job.kind = worker_job_t::kReset;
+        job.plugin = this;
+        if (!worker->try_post(job)) {
+            // Try again at the next fault.
+            reset_pending.store(false, std::memory_order_release);
+        }
+    }
+    /**
+     * If the plugin is to be reset on faults, captures its component state
+     * as the last known-good state, which reset restores. This is done when
+     * the plugin is set up, when vst3guard is initialized, and after each
+     * change of state on the worker thread, i.e. whenever the state is one
+     * that the user chose; parameter changes since then are not kept. The
+     * caller must hold the state_mutex if the plugin may be processing.
+     */
+    void capture_good_state() {
+        if (!reset_on_fault.load(std::memory_order_acquire) || !component || !stream_pool) {
+            return;
+        }
+        auto stream = stream_pool->acquire();
+        if (component->getState(stream.get()) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::capture_good_state: could not get component state.\n");
+            stream_pool->release(std::move(stream));
+            return;
+        }
+        if (good_state) {
+            stream_pool->release(std::move(good_state));
+        }
+        good_state = std::move(stream);
+        good_state->tell(&good_state_size);
+    }
+    /**
+     * Runs on the worker thread; see output_fault. The plugin is given back
+     * its last known-good state rather than its current one, which may be
+     * what made it fault; without one, only its voices and delay lines are
+     * cleared.
+     */
+    void reset() {
+        std::lock_guard<std::mutex> state_lock(state_mutex);
+        if (!isProcessing) {
+            return;
+        }
+        if (good_state) {
+            Steinberg::MemoryStream component_state(good_state->getData(), good_state_size);
+            reactivate(&component_state, nullptr);
+            if (controller) {
+                component_state.seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+                controller->setComponentState(&component_state);
+            }
+        } else {
+            Steinberg::MemoryStream component_state;
+            if (component->getState(&component_state) != Steinberg::kResultOk) {
+                csound->Message(csound, "vst3_plugin_t::reset: could not get component state.\n");
+                return;
+            }
+            reactivate(&component_state, nullptr);
+        }
+        stats.add(plugin_stats_t::kResets, 1);
+        csound->Message(csound, "vst3_plugin_t::reset: reset after non-finite output%s.\n", good_state ? " to the last known-good state" : "");
+    }
+    /**
+     * Runs on the worker thread; see handle_restart_requests.
+     */
+    void restart(Steinberg::int32 flags) {
+        csound->Message(csound, "vst3_plugin_t::restart: flags: 0x%x\n", flags);
+        if ((flags & (Steinberg::Vst::kReloadComponent | Steinberg::Vst::kIoChanged)) && blockSize > 0) {
+            std::lock_guard<std::mutex> state_lock(state_mutex);
+            if (isProcessing) {
+                processor->setProcessing(false);
+                component->setActive(false);
+                isProcessing = false;
+            }
+            update_process_setup();
+            // Reactivation resets the plugin, so no notes are sounding.
+            notes_cleared.store(true, std::memory_order_release);
+            buffer_generation.fetch_add(1, std::memory_order_acq_rel);
+        } else if (flags & Steinberg::Vst::kLatencyChanged) {
+            publish_latency();
+            csound->Message(csound, "vst3_plugin_t::restart: latency: %d samples.\n", static_cast<int>(published_latency.load(std::memory_order_relaxed)));
+        }
+        if (flags & (Steinberg::Vst::kMidiCCAssignmentChanged | Steinberg::Vst::kParamTitlesChanged | Steinberg::Vst::kParamIDMappingChanged)) {
+            auto refresh = new controller_refresh_t;
+            if (flags & Steinberg::Vst::kMidiCCAssignmentChanged) {
+                Steinberg::FUnknownPtr<Steinberg::Vst::IMidiMapping> midi_mapping(controller);
+                refresh->midi_cc_mapping.initialize(component, midi_mapping);
+                refresh->has_midi_cc_mapping = true;
+            }
+            if (flags & (Steinberg::Vst::kParamTitlesChanged | Steinberg::Vst::kParamIDMappingChanged)) {
+                list_parameters(refresh->parameter_ids, refresh->parameter_step_counts);
+                refresh->has_parameter_list = true;
+                // Before the list is published, so that changes to the new
+                // parameters do not allocate while processing.
+                std::lock_guard<std::mutex> state_lock(state_mutex);
+                reserve_parameter_queues(refresh->parameter_ids.size());
+            }
+            delete pending_refresh.exchange(refresh, std::memory_order_acq_rel);
+        }
+    }
+    /**
+     * Ensures that at least count parameter changes can be queued in one
+     * kperiod. This discards changes queued since the last kperiod, so must
+     * only be called at i-time.
+     */
+    void reserve_parameter_changes(size_t count) {
+        if (count > parameter_change_capacity) {
+            parameter_change_capacity = count;
+            paramTransferrer.setMaxParameters(static_cast<Steinberg::int32>(count));
+        }
+        reserve_parameter_queues(count);
+    }
+    /**
+     * Ensures that the plugin's parameter changes have a queue for each of
+     * count parameters, so that none is allocated while processing. The
+     * caller must hold the state_mutex if the plugin may be processing.
+     */
+    void reserve_parameter_queues(size_t count) {
+        if (count > parameter_queue_capacity) {
+            parameter_queue_capacity = count;
+            inputParameterChanges.setMaxParameters(static_cast<Steinberg::int32>(count));
+            outputParameterChanges.setMaxParameters(static_cast<Steinberg::int32>(count));
+        }
+    }
+    /**
+     * Captures the plugin's state into a numbered slot in memory. The state
+     * is captured into streams from the pool, and replaces the slot's only
+     * if that succeeds; the slot's old streams go back to the pool unless a
+     * recall is still reading them.
+     */
+    bool capture_snapshot(size_t slot) {
+        if (!component) {
+            csound->Message(csound, "vst3_plugin_t::capture_snapshot: IComponent is null.\n");
+            return false;
+        }
+        initialize_parameter_list();
+        auto component_state = stream_pool->acquire();
+        auto controller_state = stream_pool->acquire();
+        if (component->getState(component_state.get()) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_plugin_t::capture_snapshot: could not get component state.\n");
+            stream_pool->release(std::move(component_state));
+            stream_pool->release(std::move(controller_state));
+            return false;
+        }
+        Steinberg::int64 component_state_size = 0;
+        Steinberg::int64 controller_state_size = 0;
+        component_state->tell(&component_state_size);
+        if (controller && controller->getState(controller_state.get()) == Steinberg::kResultOk) {
+            controller_state->tell(&controller_state_size);
+        }
+        if (slot >= snapshots.size()) {
+            snapshots.resize(slot + 1);
+        }
+        auto snapshot = snapshots[slot];
+        // Held by the slot and here, and by any recall still reading it.
+        if (!snapshot || snapshot.use_count() > 2) {
+            snapshot = std::make_shared<state_snapshot_t>();
+        } else {
+            stream_pool->release(std::move(snapshot->component_state));
+            stream_pool->release(std::move(snapshot->controller_state));
+        }
+        snapshot->component_state = std::move(component_state);
+        snapshot->component_state_size = component_state_size;
+        snapshot->controller_state = std::move(controller_state);
+        snapshot->controller_state_size = controller_state_size;
+        snapshot->parameter_ids = parameter_ids;
+        snapshot->parameter_values.resize(parameter_ids.size());
+        for (size_t index = 0; index < parameter_ids.size(); ++index) {
+            snapshot->parameter_values[index] = controller->getParamNormalized(parameter_ids[index]);
+        }
+        snapshots[slot] = snapshot;
+        return true;
+    }
+    /**
+     * Restores the state in a slot. Normally, the state is set on the
+     * worker thread, as with load_preset_async. In delta mode, only the
+     * parameters that differ from their current values are changed, at the
+     * start of the next kperiod, and the state streams are not used.
+     */
+    bool recall_snapshot(size_t slot, bool delta, bool keep_old_state) {
+        if (slot >= snapshots.size() || !snapshots[slot]) {
+            csound->Message(csound, "vst3_plugin_t::recall_snapshot: slot %d is empty.\n", static_cast<int>(slot));
+            return false;
+        }
+        auto snapshot = snapshots[slot];
+        if (delta) {
+            // By the IDs when captured, as the plugin's list may have
+            // changed since.
+            for (size_t index = 0; index < snapshot->parameter_ids.size(); ++index) {
+                auto id = snapshot->parameter_ids[index];
+                auto value = snapshot->parameter_values[index];
+                if (controller->getParamNormalized(id) != value) {
+                    controller->setParamNormalized(id, value);
+                    add_parameter_change(id, value, 0);
+                }
+            }
+            return true;
+        }
+        auto restore = [this, snapshot] {
+            std::lock_guard<std::mutex> state_lock(state_mutex);
+            if (!apply_state(snapshot->component_state->getData(), snapshot->component_state_size,
+                             snapshot->controller_state->getData(), snapshot->controller_state_size)) {
+                csound->Message(csound, "vst3_plugin_t::recall_snapshot: could not set component state.\n");
+            }
+        };
+        if (worker) {
+            post_state_change(keep_old_state, restore);
+        } else {
+            release_all_notes(0);
+            restore();
+        }
+        return true;
+    }
+    /**
+     * Sets the component state, and the controller's copy of it, and then
+     * the controller state if there is one. The caller must hold the
+     * state_mutex if the plugin may be processing. Returns false, without
+     * logging, if the component state could not be set.
+     */
+    bool apply_state(const char *component_data, Steinberg::int64 component_size,
+                     const char *controller_data, Steinberg::int64 controller_size) {
+        Steinberg::MemoryStream component_state(const_cast<char *>(component_data), component_size);
+        if (component->setState(&component_state) != Steinberg::kResultOk) {
+            return false;
+        }
+        if (controller) {
+            component_state.seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+            controller->setComponentState(&component_state);
+            if (controller_size > 0) {
+                Steinberg::MemoryStream controller_state(const_cast<char *>(controller_data), controller_size);
+                controller->setState(&controller_state);
+            }
+        }
+        return true;
+    }
+    /**
+     * Writes this plugin's entry in a session file; see
+     * vst3_host_t::save_session.
+     */
+    bool write_session_entry(std::ostream &output) {
+        initialize_parameter_list();
+        auto component_state = stream_pool->acquire();
+        auto controller_state = stream_pool->acquire();
+        Steinberg::int64 component_size = 0;
+        Steinberg::int64 controller_size = 0;
+        bool ok = component->getState(component_state.get()) == Steinberg::kResultOk;
+        if (ok) {
+            component_state->tell(&component_size);
+            if (controller && controller->getState(controller_state.get()) == Steinberg::kResultOk) {
+                controller_state->tell(&controller_size);
+            }
+            write_string(output, module_pathname);
+            write_string(output, name);
+            write_string(output, classInfo.ID().toString());
+            write_double(output, processContext.tempo);
+            write_le(output, component_size, 8);
+            output.write(component_state->getData(), component_size);
+            write_le(output, controller_size, 8);
+            output.write(controller_state->getData(), controller_size);
+            write_le(output, parameter_ids.size(), 4);
+            for (auto id : parameter_ids) {
+                write_le(output, id, 4);
+                write_double(output, controller->getParamNormalized(id));
+            }
+        } else {
+            csound->Message(csound, "vst3_plugin_t::write_session_entry: could not get component state.\n");
+        }
+        stream_pool->release(std::move(component_state));
+        stream_pool->release(std::move(controller_state));
+        return ok;
+    }
+    /**
+     * Returns the contents of the preset file, from the host's cache if it
+     * is up to date, or null on failure.
+     */
+    preset_cache_t::blob_t read_preset(const std::string &filepath) {
+        preset_cache_t::blob_t blob;
+        if (preset_cache) {
+            blob = preset_cache->get(filepath);
+        } else {
+            blob = preset_cache_t().get(filepath);
+        }
+        if (!blob) {
+            csound->Message(csound, "Error: Could not read preset file: \"%s\".\n", filepath.c_str());
+        }
+        return blob;
+    }
+    /**
+     * Sets the state of the component and controller from the contents of a
+     * preset file. The caller must hold the state_mutex.
+     */
+    bool apply_preset(const char *data, size_t size) {
+        Steinberg::MemoryStream stream(const_cast<char *>(data), static_cast<Steinberg::TSize>(size));
+        // Fast path: let PresetFile dispatch state to component/controller.
+        Steinberg::FUID component_class_id { classInfo.ID().data() };
+        std::vector<Steinberg::FUID> otherClassIDs; // collects other IDs embedded in the preset, if any
+        if (Steinberg::Vst::PresetFile::loadPreset(&stream, component_class_id, component, controller, &otherClassIDs)) {
+            csound->Message(csound, "Loaded preset file.\n");
+            return true;
+        } else {
+            csound->Message(csound, "Warning: Could not read preset file, trying to read chunk list.\n");
+        }
+        // Fallback path: parse and apply chunks manually for stubborn files.
+        stream.seek(0, Steinberg::IBStream::kIBSeekSet, nullptr);
+        Steinberg::Vst::PresetFile pf(&stream);
+        if (!pf.readChunkList()) {
+            csound->Message(csound, "Error: Could not read preset chunk list.\n");
+            return false;
+        }
+        // Ensure the preset targets the same processor class (defensive).
+        const Steinberg::FUID& presetCID = pf.getClassID();
+        if (presetCID != component_class_id) {
+           csound->Message(csound, "Error: Preset class ID does not match this plugin's processor.\n");
+           return false;
+        }
+        bool ok = pf.restoreComponentState(component);
+        if (!ok) {
+            csound->Message(csound, "Failed to restore component state.\n");
+            return false;
+        }
+        if (controller) {
+            // Apply controller state if present; not all presets have one.
+            (void)pf.seekToControllerState(); // safe to call; restoreControllerState will handle absence
+            ok = pf.restoreControllerState(controller) && ok;
+            if (!ok) {
+                csound->Message(csound, "Error: Failed to restore controller state.\n");
+            }
+        }
+        csound->Message(csound, "Loaded preset file.\n");
+        return true;
+    }
+    CSOUND* csound = nullptr;
+    Steinberg::IPtr<Steinberg::Vst::PlugProvider> provider;
+    VST3::Hosting::ClassInfo classInfo;
+    Steinberg::IPtr<Steinberg::Vst::IComponent> component;
+    Steinberg::FUID component_class_id;
+    Steinberg::FUnknownPtr<Steinberg::Vst::IAudioProcessor> processor;
+    Steinberg::FUID processor_class_id;
+    Steinberg::IPtr<Steinberg::Vst::IEditController> controller;
+    Steinberg::FUID controller_class_id;
+    Steinberg::Vst::HostProcessData hostProcessData;
+    Steinberg::Vst::ProcessContext processContext;
+    Steinberg::Vst::EventList inputEventList;
+    Steinberg::Vst::EventList outputEventList;
+    Steinberg::Vst::ParameterChanges inputParameterChanges;
+    Steinberg::Vst::ParameterChanges outputParameterChanges;
+    Steinberg::Vst::ParameterChangeTransfer paramTransferrer;
+    //std::shared_ptr<Steinberg::Vst::EditorHost::WindowController> windowController;
+    midi_cc_mapping_t midiCCMapping;
+    // Preallocated; parameter changes from MIDI for the current block.
+    static constexpr size_t kMaxMidiParameterChanges = 1024;
+    std::vector<midi_parameter_change_t> midi_parameter_changes;
+    // Preallocated; events output by the plugin in the most recent block.
+    static constexpr size_t kMaxOutputEvents = 1024;
+    std::vector<Steinberg::Vst::Event> output_events;
+    uint64_t output_events_block = 0;
+    // See begin_output_events.
+    bool accumulating_output_events = false;
+    Steinberg::int32 output_events_offset = 0;
+    static constexpr size_t kMaxInputEvents = 1024;
+    // Plugins that receive this plugin's output events; see vst3eventroute.
+    std::vector<vst3_plugin_t *> event_destinations;
+    // If true, the output events are not routed by postprocess, because the
+    // plugin is processed on a helper thread, but by its caller once back
+    // on the performance thread; see vst3layers.
+    bool defer_event_routing = false;
+    // Notes routed to those plugins, with their IDs there; see
+    // route_output_events.
+    struct routed_note_t {
+        vst3_plugin_t *destination;
+        Steinberg::int32 source_id;
+        Steinberg::int16 channel;
+        Steinberg::int16 pitch;
+        Steinberg::int32 destination_id;
+    };
+    std::array<routed_note_t, active_notes_t::kCapacity> routed_notes;
+    size_t routed_note_count = 0;
+    bool isProcessing = false;
+    double sampleRate = 0;
+    int32 blockSize = 0;
+    int32 plugin_sample_size;
+    // Records the id of the parameter used for program changes.
+    int32 program_change_id = -1;
+    // Every note sent to this plugin, until it is turned off; this also
+    // assigns the note IDs.
+    active_notes_t active_notes;
+    std::string module_pathname;
+    std::string name;
+    // Owned by the host.
+    vst3_worker_t *worker = nullptr;
+    preset_cache_t *preset_cache = nullptr;
+    memory_stream_pool_t *stream_pool = nullptr;
+    // Saves are numbered from 1, and are completed in order.
+    std::atomic<uint64_t> saves_requested{0};
+    std::atomic<uint64_t> saves_done{0};
+    std::atomic<uint64_t> last_failed_save{0};
+    std::vector<std::unique_ptr<preset_save_request_t>> preset_save_requests;
+    size_t parameter_change_capacity = 1000;
+    size_t parameter_queue_capacity = 0;
+    bool parameter_changes_pending = false;
+    // If true, every audio bus is activated, not just the main busses; see
+    // vst3audiobus.
+    bool all_busses = false;
+    // The plugin runs at this multiple of Csound's rate; see vst3oversample.
+    int oversampling = 1;
+    oversampler_t oversampler;
+    // Or at its own rate; see vst3samplerate.
+    resampling_bridge_t bridge;
+    // Holds the channel buffers of hostProcessData; see vst3memory.
+    buffer_arena_t arena;
+    // Silent blocks processed after setup, and the key played during them
+    // if not negative; see vst3warmup.
+    Steinberg::int32 warmup_blocks = 0;
+    Steinberg::int32 warmup_key = -1;
+    // If true, denormals are flushed to zero while the plugin processes;
+    // see vst3denormals.
+    bool flush_denormals = true;
+    // If true, the plugin is reset when it outputs NaN or infinite samples;
+    // see vst3guard.
+    std::atomic<bool> reset_on_fault{false};
+    // The state that reset restores; see capture_good_state.
+    std::shared_ptr<Steinberg::MemoryStream> good_state;
+    Steinberg::int64 good_state_size = 0;
+    plugin_stats_t stats;
+    // Plugin frames per Csound frame.
+    double time_scale = 1.;
+    // Channels wanted for the main busses, if not 0; see bus_arrangements.
+    Steinberg::int32 requested_input_channels = 0;
+    Steinberg::int32 requested_output_channels = 0;
+    // If true, vst3send accumulates into the input buffers, which vst3audio
+    // adds to rather than overwrites; see begin_sends.
+    bool input_sends = false;
+    // The block that the sends in the input buffers are for.
+    int64_t sends_time_in_frames = -1;
+    // For skipping idle plugins; see should_suspend.
+    bool auto_suspend = true;
+    Steinberg::uint32 tail_samples = 0;
+    int64_t samples_since_activity = 0;
+    bool output_silent = false;
+    // For latency compensation; see vst3latency.
+    ComponentHandler component_handler_;
+    Steinberg::uint32 latency_samples = 0;
+    // From the worker thread; see update_latency.
+    std::atomic<Steinberg::uint32> published_latency{0};
+    std::atomic<bool> latency_changed{false};
+    bool latency_compensation = false;
+    delay_lines_t compensation_delay_lines;
+    std::vector<MYFLT> compensation_mix;
+    // The parameters that can be set from the host; see
+    // initialize_parameter_list.
+    std::vector<Steinberg::Vst::ParamID> parameter_ids;
+    std::vector<Steinberg::int32> parameter_step_counts;
+    // Slots for vst3snapshot and vst3recall.
+    std::vector<std::shared_ptr<state_snapshot_t>> snapshots;
+    // Held by the worker while it changes the plugin's state; process skips
+    // any block in which it cannot take this lock.
+    std::mutex state_mutex;
+    std::atomic<int> pending_state_loads{0};
+    // For restartComponent; see handle_restart_requests.
+    std::atomic<bool> restart_pending{false};
+    // Set when the worker has reactivated the plugin, so that the
+    // performance thread clears the table of active notes.
+    std::atomic<bool> notes_cleared{false};
+    // For output_fault.
+    std::atomic<bool> reset_pending{false};
+    std::atomic<controller_refresh_t *> pending_refresh{nullptr};
+    // Taken up, but not yet posted to the worker to be freed; on the
+    // performance thread only.
+    controller_refresh_t *retired_refresh = nullptr;
+    std::atomic<uint64_t> buffer_generation{0};
+    std::atomic<int> muting_state_loads{0};
+};
+
+/**
+ * Runs a job posted from the performance thread, on the worker thread.
+ */
+static void run_worker_job(const worker_job_t &job) {
+    switch (job.kind) {
+    case worker_job_t::kSavePreset:
+        job.plugin->save_preset(job.save_request);
+        break;
+    case worker_job_t::kRestart:
+        job.plugin->restart(job.flags);
+        job.plugin->restart_pending.store(false, std::memory_order_release);
+        break;
+    case worker_job_t::kReset:
+        job.plugin->reset();
+        job.plugin->reset_pending.store(false, std::memory_order_release);
+        break;
+    case worker_job_t::kFreeRefresh:
+        delete job.refresh;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * One plugin read from a session file. The states point into the file.
+ */
+struct session_entry_t {
+    std::string module_pathname;
+    std::string plugin_name;
+    std::string class_id;
+    double tempo;
+    const char *component_state;
+    uint64_t component_state_size;
+    const char *controller_state;
+    uint64_t controller_state_size;
+    std::vector<std::pair<Steinberg::Vst::ParamID, double>> parameter_values;
+};
+
+/**
+ * Singleton class for managing all persistent VST3 state:
+ * (1) There is one and only one vst3_host_t instance in a process.
+ * (2) There are zero or more vst3_plugin_t instances for each CSOUND
+ *     instance, and these plugins are deleted when csoundModuleDestroy
+ *     is called.
+ */
+class vst3_host_t : public Steinberg::Vst::HostApplication {
+    int host_handle;
+public:
+    vst3_host_t() {
+    };
+    vst3_host_t(vst3_host_t const&) = delete;
+    void operator=(vst3_host_t const&) = delete;
+    ~vst3_host_t() noexcept override {
+        std::fprintf(stderr, "vst3_host_t::~vst3_host_t.\n");
+        // Finish any background work before the plugins go away.
+        worker.stop();
+    }
+    /**
+     * Loads a VST3 Module and obtains all plugins in it.
+     */
+    MYFLT load_module(CSOUND *csound, const std::string& module_pathname, const std::string &plugin_name, bool verbose) {
+        auto module = get_module(csound, module_pathname, verbose);
+        if (!module) {
+            return -1;
+        }
+        auto vst3_plugin = create_plugin(csound, module, module_pathname, plugin_name, verbose);
+        if (!vst3_plugin) {
+            return -1;
+        }
+        return register_plugin(vst3_plugin);
+    }
+    /**
+     * Returns the Module for the file, loading it if it has not already been
+     * loaded. Not thread-safe.
+     */
+    VST3::Hosting::Module::Ptr get_module(CSOUND *csound, const std::string& module_pathname, bool verbose) {
+        auto it = modules_for_pathnames.find(module_pathname);
+        if (it != modules_for_pathnames.end()) {
+            return it->second;
+        }
+        if (verbose == true) {
+            csound->Message(csound, "vst3_host_t::load_module: loading: \"%s\"\n", module_pathname.c_str());
+        }
+        std::string error;
+        auto module = VST3::Hosting::Module::create(module_pathname, error);
+        if (!module) {
+            std::string reason = "Could not create Module for file:";
+            reason += module_pathname;
+            reason += "\nError: ";
+            reason += error;
+            csound->Message(csound, "vst3_host_t::load_module: error: %s\n", reason.c_str());
+            return nullptr;
+        }
+        modules_for_pathnames[module_pathname] = module;
+        return module;
+    }
+    /**
+     * Creates and initializes the named plugin from a Module, without
+     * giving it a handle.
+     */
+    std::shared_ptr<vst3_plugin_t> create_plugin(CSOUND *csound, VST3::Hosting::Module::Ptr module, const std::string& module_pathname, const std::string &plugin_name, bool verbose) {
+        auto factory = module->getFactory();
+        int count = 0;
+        // Loop over all class infos from the module, but create only the requested plugin.
+        // This gives the user a list of all plugins available from the module.
+        VST3::Hosting::ClassInfo classInfo_;
+        for (auto& classInfo : factory.classInfos()) {
+            count = count + 1;
+            if (verbose == true) {
+                csound->Message(csound, "vst3_host_t::load_module: found module classinfo: %d\n", count);
+                csound->Message(csound, "                          module classinfo id:    %s\n", classInfo.ID().toString().c_str());
+                csound->Message(csound, "                          cardinality:            %i\n", classInfo.cardinality());
+                csound->Message(csound, "                          category:               %s\n", classInfo.category().c_str());
+                csound->Message(csound, "                          name:                   %s\n", classInfo.name().c_str());
+                csound->Message(csound, "                          vendor:                 %s\n", classInfo.vendor().c_str());
+                csound->Message(csound, "                          version:                %s\n", classInfo.version().c_str());
+                csound->Message(csound, "                          sdkVersion:             %s\n", classInfo.sdkVersion().c_str());
+                csound->Message(csound, "                          subCategoriesString:    %s\n", classInfo.subCategoriesString().c_str());
+                csound->Message(csound, "                          classFlags:             %i\n\n", classInfo.classFlags());
+            }
+            if ((classInfo.category() == kVstAudioEffectClass) && (plugin_name == classInfo.name())) {
+                classInfo_ = classInfo;
+            }
+        }
+        auto plugProvider = owned(NEW Steinberg::Vst::PlugProvider(factory, classInfo_, true));
+        if (!plugProvider) {
+            std::string error = "No VST3 Audio Module class found in file ";
+            error += module_pathname;
+            csound->Message(csound, "vst3_host_t::load_module: error: %s\n", error.c_str());
+            return nullptr;
+        }
+        auto vst3_plugin = std::make_shared<vst3_plugin_t>();
+        vst3_plugin->worker = &worker;
+        vst3_plugin->preset_cache = &preset_cache;
+        vst3_plugin->stream_pool = &stream_pool;
+        // So that the performance thread can post without waiting.
+        worker.ensure_started();
+        vst3_plugin->module_pathname = module_pathname;
+        vst3_plugin->name = plugin_name;
+        vst3_plugin->initialize(csound, classInfo_, plugProvider);
+        Steinberg::TUID controllerClassTUID;
+        if (vst3_plugin->component->getControllerClassId(controllerClassTUID) != Steinberg::kResultOk) {
+            csound->Message(csound, "vst3_host_t::load_module: This component does not export an edit controller class ID!\n");
+        }
+        Steinberg::FUID controllerClassUID;
+        controllerClassUID = Steinberg::FUID::fromTUID(controllerClassTUID);
+        if (controllerClassUID.isValid() == false) {
+            csound->Message(csound, "vst3_host_t::load_module: The edit controller class has no valid UID!\n");
+        }
+        return vst3_plugin;
+    }
+    /**
+     * Finds the greatest latency of the plugins that compensate for latency.
+     */
+    void update_max_latency() {
+        max_latency = 0;
+        for (auto &vst3_plugin : vst3_plugins_for_handles) {
+            if (vst3_plugin->latency_compensation) {
+                max_latency = std::max(max_latency, vst3_plugin->latency_samples);
+            }
+        }
+    }
+    /**
+     * Gives the plugin the next handle, and returns it.
+     */
+    MYFLT register_plugin(std::shared_ptr<vst3_plugin_t> vst3_plugin) {
+        size_t handle = vst3_plugins_for_handles.size();
+        vst3_plugins_for_handles.push_back(vst3_plugin);
+        MYFLT result = std::floor(static_cast<MYFLT>(handle));
+        return result;
+    }
+    /**
+     * Saves the state of every plugin to one session file. The states are
+     * captured now, and the file is written atomically on the worker thread.
+     * The layout, with all integers little-endian, strings as a uint32 size
+     * and bytes, and doubles as their IEEE bits, is:
+     *
+     *     char[8]     "VST3SESS"
+     *     uint32      version (1)
+     *     uint32      plugin count
+     *     count x     string module pathname, string plugin name,
+     *                 string class ID, double tempo,
+     *                 uint64 size and bytes of the component state,
+     *                 uint64 size and bytes of the controller state,
+     *                 uint32 parameter count,
+     *                 count x { uint32 parameter ID, double normalized value }
+     */
+    bool save_session(CSOUND *csound, const std::string &session_filepath) {
+        auto output = std::make_shared<std::ostringstream>(std::ios::binary);
+        output->write(kSessionMagic, 8);
+        write_le(*output, kSessionVersion, 4);
+        write_le(*output, vst3_plugins_for_handles.size(), 4);
+        for (auto &vst3_plugin : vst3_plugins_for_handles) {
+            if (!vst3_plugin->write_session_entry(*output)) {
+                return false;
+            }
+        }
+        worker.post([csound, output, session_filepath] {
+            auto contents = output->str();
+            std::string error;
+            if (write_file_atomically(session_filepath, contents.data(), contents.size(), error)) {
+                csound->Message(csound, "vst3_host_t::save_session: saved session to %s (%zu bytes).\n", session_filepath.c_str(), contents.size());
+            } else {
+                csound->Message(csound, "vst3_host_t::save_session: %s\n", error.c_str());
+            }
+        });
+        return true;
+    }
+    /**
+     * Creates every plugin in a session file and restores its state. Modules
+     * are loaded and plugins are created one at a time, on this thread; then
+     * their states are set in parallel; then the plugins are given handles
+     * in the order of the file. Returns the first handle, or -1 on failure.
+     */
+    MYFLT load_session(CSOUND *csound, const std::string &session_filepath, bool verbose) {
+        memory_mapped_file_t file;
+        if (!file.open(session_filepath)) {
+            csound->Message(csound, "vst3_host_t::load_session: could not open: %s\n", session_filepath.c_str());
+            return -1;
+        }
+        byte_reader_t reader(file.data(), file.size());
+        auto magic = reader.read_bytes(8);
+        if (!magic || std::memcmp(magic, kSessionMagic, 8) != 0 || reader.read(4) != kSessionVersion) {
+            csound->Message(csound, "vst3_host_t::load_session: not a session file: %s\n", session_filepath.c_str());
+            return -1;
+        }
+        // Three string sizes, the tempo, two state sizes, and the parameter
+        // count.
+        auto entry_count = reader.read_count(4, 4 + 4 + 4 + 8 + 8 + 8 + 4);
+        if (!reader.ok) {
+            csound->Message(csound, "vst3_host_t::load_session: truncated session file: %s\n", session_filepath.c_str());
+            return -1;
+        }
+        std::vector<session_entry_t> entries(entry_count);
+        for (auto &entry : entries) {
+            entry.module_pathname = reader.read_string();
+            entry.plugin_name = reader.read_string();
+            entry.class_id = reader.read_string();
+            entry.tempo = reader.read_double();
+            entry.component_state_size = reader.read(8);
+            entry.component_state = reader.read_bytes(entry.component_state_size);
+            entry.controller_state_size = reader.read(8);
+            entry.controller_state = reader.read_bytes(entry.controller_state_size);
+            auto parameter_count = reader.read_count(4, 4 + 8);
+            entry.parameter_values.reserve(parameter_count);
+            for (uint64_t index = 0; index < parameter_count && reader.ok; ++index) {
+                auto id = static_cast<Steinberg::Vst::ParamID>(reader.read(4));
+                entry.parameter_values.emplace_back(id, reader.read_double());
+            }
+        }
+        if (!reader.ok) {
+            csound->Message(csound, "vst3_host_t::load_session: truncated session file: %s\n", session_filepath.c_str());
+            return -1;
+        }
+        std::vector<VST3::Hosting::Module::Ptr> modules;
+        for (auto &entry : entries) {
+            modules.push_back(get_module(csound, entry.module_pathname, verbose));
+            if (!modules.back()) {
+                return -1;
+            }
+        }
+        // VST3 requires plugins to be created and initialized on one thread.
+        std::vector<std::shared_ptr<vst3_plugin_t>> plugins(entries.size());
+        for (size_t index = 0; index < entries.size(); ++index) {
+            auto &entry = entries[index];
+            plugins[index] = create_plugin(csound, modules[index], entry.module_pathname, entry.plugin_name, verbose);
+            if (!plugins[index]) {
+                csound->Message(csound, "vst3_host_t::load_session: could not create \"%s\".\n", entry.plugin_name.c_str());
+                return -1;
+            }
+            if (plugins[index]->classInfo.ID().toString() != entry.class_id) {
+                csound->Message(csound, "vst3_host_t::load_session: warning: class ID of \"%s\" has changed.\n", entry.plugin_name.c_str());
+            }
+        }
+        // Setting the states, which may be large, is what takes the time.
+        // The threads do not log; the results are reported below.
+        std::vector<char> applied(entries.size(), 0);
+        std::atomic<size_t> next_entry{0};
+        auto restore = [&] {
+            for (size_t index = next_entry++; index < entries.size(); index = next_entry++) {
+                auto &entry = entries[index];
+                // An exception must not escape the thread.
+                try {
+                    applied[index] = plugins[index]->apply_state(entry.component_state, entry.component_state_size,
+                                                                 entry.controller_state, entry.controller_state_size);
+                } catch (...) {
+                    applied[index] = 0;
+                }
+            }
+        };
+        auto thread_count = std::min<size_t>(entries.size(), std::max(1u, std::thread::hardware_concurrency()));
+        std::vector<std::thread> threads;
+        for (size_t index = 1; index < thread_count; ++index) {
+            threads.emplace_back(restore);
+        }
+        restore();
+        for (auto &thread : threads) {
+            thread.join();
+        }
+        for (size_t index = 0; index < entries.size(); ++index) {
+            auto &entry = entries[index];
+            if (!applied[index]) {
+                csound->Message(csound, "vst3_host_t::load_session: warning: could not set the state of \"%s\".\n", entry.plugin_name.c_str());
+            }
+            for (auto &parameter_value : entry.parameter_values) {
+                plugins[index]->controller->setParamNormalized(parameter_value.first, parameter_value.second);
+            }
+            plugins[index]->setTempo(entry.tempo);
+        }
+        MYFLT first_handle = vst3_plugins_for_handles.size();
+        for (auto &vst3_plugin : plugins) {
+            register_plugin(vst3_plugin);
+        }
+        csound->Message(csound, "vst3_host_t::load_session: restored %d plugins from %s.\n", static_cast<int>(plugins.size()), session_filepath.c_str());
+        return first_handle;
+    }
+    static constexpr const char *kSessionMagic = "VST3SESS";
+    static constexpr uint32_t kSessionVersion = 1;
+    vst3_plugin_t *plugin_for_handle(MYFLT *handle) {
+        auto handle_value = *handle;
+        auto index = static_cast<size_t>(handle_value);
+        return vst3_plugins_for_handles[index].get();
+    }
+    std::map<std::string, VST3::Hosting::Module::Ptr> modules_for_pathnames;
+    // Handles for vst3_plugin_t instances are indexes into a list of
+    // plugins. It's not possible to simply store the address of a
+    // vst3_plugin_t instance in a Csound opcode parameter, because the
+    // address might be 64 bits and the MYFLT parameter might be only 32
+    // bits.
+    std::vector<std::shared_ptr<vst3_plugin_t>> vst3_plugins_for_handles;
+    // Preset banks loaded by vst3bankload; handles are indexes.
+    std::vector<std::unique_ptr<preset_bank_t>> preset_banks;
+    // Shared by all plugins.
+    vst3_worker_t worker;
+    preset_cache_t preset_cache;
+    memory_stream_pool_t stream_pool;
+    // See update_max_latency.
+    Steinberg::uint32 max_latency = 0;
+};
+
+static inline vst3_host_t *vst3_host_for_csound(CSOUND *csound) {
+    int handle = 0;
+    auto host = vst3hosts::instance().object_for_handle(csound, handle);
+    // std::fprintf(stderr, "vst3_host_t::host_for_csound: csound: %p handle: %d host: %p...\n", csound, handle, host);
+    if (host == nullptr) {
+        host = new vst3_host_t;
+        handle = vst3hosts::instance().handle_for_object(csound, host);
+    }
+    host = vst3hosts::instance().object_for_handle(csound, handle);
+    // std::fprintf(stderr, "vst3_host_t::host_for_csound: csound: %p handle: %d host: %p\n", csound, handle, host);
+    return host;
+}
+
+static inline vst3_plugin_t *get_plugin(CSOUND *csound, size_t handle) {
+    auto host = vst3_host_for_csound(csound);
+    auto plugin = host->vst3_plugins_for_handles[handle];
+    return plugin.get();
+}
+
+/**
+ * Sizes an output array to rows by columns (one dimension if columns is 1)
+ * of members of the given size, e.g. ksmps MYFLTs for an a-rate array, and
+ * zeros it. This allocates, and so must only be called at i-time.
+ */
+static inline void allocate_array(CSOUND *csound, ARRAYDAT *array, int rows, int columns, size_t member_size = sizeof(MYFLT)) {
+    size_t size = size_t(rows) * columns * member_size;
+    if (array->data == nullptr || array->allocated < size) {
+        array->data = static_cast<MYFLT *>(csound->ReAlloc(csound, array->data, size));
+        array->allocated = size;
+    }
+    std::memset(array->data, 0, size);
+    int dimensions = columns > 1 ? 2 : 1;
+    if (array->sizes == nullptr || array->dimensions != dimensions) {
+        array->sizes = static_cast<int *>(csound->ReAlloc(csound, array->sizes, dimensions * sizeof(int)));
+    }
+    array->dimensions = dimensions;
+    array->sizes[0] = rows;
+    if (dimensions == 2) {
+        array->sizes[1] = columns;
+    }
+    array->arrayMemberSize = static_cast<int>(member_size);
+}
+
+/**
+ * Adds samples into an accumulator, in a loop simple enough for the compiler
+ * to vectorize.
+ */
+template<typename SAMPLE>
+static inline void mix_into(MYFLT *__restrict accumulator, const SAMPLE *__restrict samples, Steinberg::int32 frame_count) {
+    for (Steinberg::int32 frame = 0; frame < frame_count; ++frame) {
+        accumulator[frame] += MYFLT(samples[frame]);
+    }
+}
+
+/**
+ * Sends audio through a plugin. vst3audio uses only the plugin's main input
+ * and output busses; vst3audiobus activates and uses every audio bus, with
+ * the channels of all busses numbered in bus order, e.g. a stereo main input
+ * and a stereo sidechain are inputs 1 to 4, and a multi-output instrument
+ * with 16 stereo busses has 32 outputs. vst3audiomix is vst3audio, but adds
+ * the plugin's outputs to the output variables, e.g. global mix busses,
+ * instead of overwriting them; if the plugin is latency compensated, its
+ * outputs are delayed before they are added.
+ *
+ * The array forms, aout[] vst3audio ihandle, ain[], have no limit of 32
+ * channels; the output array is sized to the plugin's outputs.
+ */
+struct VST3AUDIO :
+    public csound::OpcodeBase<VST3AUDIO> {
+    static constexpr Steinberg::int32 kMaxPluginChannels = 256;
+    // Outputs.
+    MYFLT *a_output_channels[32];
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *a_input_channels[32];
+    // State.
+    bool all_busses;
+    bool accumulate_outputs;
+    bool array_arguments;
+    // The opcode's channels, from the arguments or the arrays.
+    MYFLT *input_channels[kMaxPluginChannels];
+    MYFLT *output_channels[kMaxPluginChannels];
+    vst3_host_t *host;
+    vst3_plugin_t *vst3_plugin;
+    MYFLT zerodbfs;
+    Steinberg::int32 opcode_input_channel_count;
+    Steinberg::int32 plugin_input_channel_count;
+    Steinberg::int32 opcode_output_channel_count;
+    Steinberg::int32 plugin_output_channel_count;
+    // Flat tables of the plugin's channels in all used busses, and the bus
+    // and channel in the bus of each; see refresh_buffers.
+    Steinberg::Vst::Sample32 *plugin_input_channels_32[kMaxPluginChannels];
+    Steinberg::Vst::Sample64 *plugin_input_channels_64[kMaxPluginChannels];
+    Steinberg::Vst::Sample32 *plugin_output_channels_32[kMaxPluginChannels];
+    Steinberg::Vst::Sample64 *plugin_output_channels_64[kMaxPluginChannels];
+    int16_t plugin_input_busses[kMaxPluginChannels];
+    int16_t plugin_input_bus_channels[kMaxPluginChannels];
+    int16_t plugin_output_busses[kMaxPluginChannels];
+    int16_t plugin_output_bus_channels[kMaxPluginChannels];
+    Steinberg::int32 plugin_input_bus_count;
+    Steinberg::int32 plugin_output_bus_count;
+    Steinberg::Vst::SymbolicSampleSizes plugin_sample_size;
+    Steinberg::int32 frame_count;
+    uint64_t buffer_generation;
+    static int init_all_busses_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3AUDIO *>(opcode)->all_busses = true;
+        return init_(csound, opcode);
+    }
+    static int init_accumulate_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3AUDIO *>(opcode)->accumulate_outputs = true;
+        return init_(csound, opcode);
+    }
+    static int init_array_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3AUDIO *>(opcode)->array_arguments = true;
+        return init_(csound, opcode);
+    }
+    static int init_all_busses_array_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3AUDIO *>(opcode)->all_busses = true;
+        reinterpret_cast<VST3AUDIO *>(opcode)->array_arguments = true;
+        return init_(csound, opcode);
+    }
+    /**
+     * In the array forms, the arguments occupy the first three slots: the
+     * output array, the handle, and the input array.
+     */
+    ARRAYDAT *output_array() {
+        return reinterpret_cast<ARRAYDAT *>(a_output_channels[0]);
+    }
+    MYFLT *vst3_handle() {
+        return array_arguments ? a_output_channels[1] : i_vst3_handle;
+    }
+    ARRAYDAT *input_array() {
+        return reinterpret_cast<ARRAYDAT *>(a_output_channels[2]);
+    }
+    int init(CSOUND *csound) {
+        int result = OK;
+        host = vst3_host_for_csound(csound);
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*vst3_handle()));
+        frame_count = ksmps();
+        if (array_arguments) {
+            opcode_input_channel_count = std::min(input_array()->sizes[0], kMaxPluginChannels);
+            for (Steinberg::int32 channel_index = 0; channel_index < opcode_input_channel_count; ++channel_index) {
+                input_channels[channel_index] = input_array()->data + size_t(channel_index) * frame_count;
+            }
+        } else {
+            // Allow for the first arg being the handle.
+            opcode_input_channel_count = input_arg_count() - 1;
+            opcode_output_channel_count = output_arg_count();
+            std::copy_n(a_input_channels, opcode_input_channel_count, input_channels);
+            std::copy_n(a_output_channels, opcode_output_channel_count, output_channels);
+        }
+        // Must be set before the busses are activated.
+        if (all_busses) {
+            vst3_plugin->all_busses = true;
+        } else {
+            // Ask for main busses that match the opcode; the plugin decides.
+            vst3_plugin->requested_input_channels = opcode_input_channel_count;
+            vst3_plugin->requested_output_channels = array_arguments ? 0 : opcode_output_channel_count;
+        }
+        vst3_plugin->prepare(csoundGetSr(csound), frame_count);
+        log(csound, "Final plugin configuration:\n");
+        // Because Csound and the plugin may not use the same sample word
+        // size, allowance must be made for different buffer shapes and
+        // sample word sizes, and the audio streams must be copied in and
+        // out sample for sample. Csound will try to match its input and
+        // output channels with the hosted plugin, and the maximum matching
+        // set will be used. Whether the HostProcessData busses are "Main"
+        // is not considered. The Csound instrument hosting this opcode
+        // may ignore or duplicate channels depending on documentation or
+        // experience.
+
+        refresh_buffers(csound);
+        if (array_arguments) {
+            // Sized to whatever the plugin has settled on.
+            opcode_output_channel_count = plugin_output_channel_count;
+            allocate_array(csound, output_array(), opcode_output_channel_count, 1, sizeof(MYFLT) * frame_count);
+            for (Steinberg::int32 channel_index = 0; channel_index < opcode_output_channel_count; ++channel_index) {
+                output_channels[channel_index] = output_array()->data + size_t(channel_index) * frame_count;
+            }
+        }
+        if (vst3_plugin->latency_compensation) {
+            vst3_plugin->set_latency_compensation(true, opcode_output_channel_count, frame_count);
+        }
+        host->update_max_latency();
+        vst3_plugin->information(true);
+        return result;
+    };
+    /**
+     * Looks up the plugin's buffers, which change when the plugin's busses
+     * are reconfigured.
+     */
+    void refresh_buffers(CSOUND *csound) {
+        auto &process_data = vst3_plugin->hostProcessData;
+        buffer_generation = vst3_plugin->buffer_generation.load(std::memory_order_acquire);
+        plugin_sample_size = static_cast<Steinberg::Vst::SymbolicSampleSizes>(vst3_plugin->plugin_sample_size);
+        plugin_input_bus_count = all_busses ? process_data.numInputs : std::min(process_data.numInputs, 1);
+        plugin_input_channel_count = map_channels(csound, "input", process_data.inputs, plugin_input_bus_count,
+                                     plugin_input_channels_32, plugin_input_channels_64,
+                                     plugin_input_busses, plugin_input_bus_channels);
+        plugin_output_bus_count = all_busses ? process_data.numOutputs : std::min(process_data.numOutputs, 1);
+        plugin_output_channel_count = map_channels(csound, "output", process_data.outputs, plugin_output_bus_count,
+                                      plugin_output_channels_32, plugin_output_channels_64,
+                                      plugin_output_busses, plugin_output_bus_channels);
+        log(csound, "vst3audio::init: opcode_input_channel_count:  %3d plugin_input_channel_count:  %3d\n", opcode_input_channel_count, plugin_input_channel_count);
+        log(csound, "vst3audio::init: opcode_output_channel_count: %3d plugin_output_channel_count: %3d\n", opcode_output_channel_count, plugin_output_channel_count);
+    }
+    /**
+     * Fills the flat channel tables for the busses used, and returns the
+     * number of channels.
+     */
+    Steinberg::int32 map_channels(CSOUND *csound, const char *direction, Steinberg::Vst::AudioBusBuffers *busses, Steinberg::int32 bus_count,
+                                  Steinberg::Vst::Sample32 **channels_32, Steinberg::Vst::Sample64 **channels_64,
+                                  int16_t *channel_busses, int16_t *bus_channels) {
+        Steinberg::int32 channel_count = 0;
+        for (Steinberg::int32 bus = 0; bus < bus_count; ++bus) {
+            for (Steinberg::int32 channel = 0; channel < busses[bus].numChannels; ++channel) {
+                if (channel_count == kMaxPluginChannels) {
+                    log(csound, "vst3audio::init: warning! only %d plugin %s channels are used.\n", kMaxPluginChannels, direction);
+                    return channel_count;
+                }
+                channels_32[channel_count] = busses[bus].channelBuffers32 ? busses[bus].channelBuffers32[channel] : nullptr;
+                channels_64[channel_count] = busses[bus].channelBuffers64 ? busses[bus].channelBuffers64[channel] : nullptr;
+                channel_busses[channel_count] = int16_t(bus);
+                bus_channels[channel_count] = int16_t(channel);
+                log(csound, "vst3audio::init: %s %3d: bus: %3d channel: %3d\n", direction, channel_count + 1, bus, channel);
+                ++channel_count;
+            }
+        }
+        if (channel_count == 0) {
+            log(csound, "vst3audio::init: no plugin %s channels.\n", direction);
+        }
+        return channel_count;
+    }
+    int audio(CSOUND *csound) {
+        int result = OK;
+        int64_t current_time_in_frames = csound->GetCurrentTimeSamples(csound);
+        if (current_time_in_frames < 0) {
+            log(csound, "vst3audio::audio: warning! current_time_in_frames is less than 0: %d\n", current_time_in_frames);
+            return NOTOK;
+        }
+        if (vst3_plugin->runs_at_host_rate() && frame_count != vst3_plugin->hostProcessData.numSamples) {
+            log(csound, "vst3audio::audio: warning! ksmps (%d) != numSamples: %d\n", ksmps(), vst3_plugin->hostProcessData.numSamples);
+            /// return NOTOK;
+        }
+#if EVENT_TRACING
+        auto &data = vst3_plugin->hostProcessData;
+        if (data.inputEvents) {
+            const Steinberg::int32 numEvents = data.inputEvents->getEventCount();
+            for (Steinberg::int32 i = 0; i < numEvents; ++i) {
+                Steinberg::Vst::Event event;
+                if (data.inputEvents->getEvent(i, event) == Steinberg::kResultOk) {
+                    switch (event.type) {
+                case Steinberg::Vst::Event::kNoteOnEvent:
+                            std::printf("Note On:  Channel %d, Pitch %d, Velocity %.2f\n",
+                                        event.noteOn.channel,
+                                        event.noteOn.pitch,
+                                        event.noteOn.velocity);
+                        break;
+                case Steinberg::Vst::Event::kNoteOffEvent:
+                            std::printf("Note Off: Channel %d, Pitch %d, Velocity %.2f\n",
+                                        event.noteOff.channel,
+                                        event.noteOff.pitch,
+                                        event.noteOff.velocity);
+                        break;
+                case Steinberg::Vst::Event::kPolyPressureEvent:
+                            std::printf("Poly Pressure: Channel %d, Pitch %d, Pressure %.2f\n",
+                                        event.polyPressure.channel,
+                                        event.polyPressure.pitch,
+                                        std::printf("Other MIDI event type: %d\n", event.type);
+                                        event.polyPressure.pressure);
+                        break;
+                case Steinberg::Vst::Event::kDataEvent:
+                            std::printf("Data: byte 0 %d, byte 1 %d, byte 2 %.2f\n",
+                                        event.data.bytes[0],
+                                        event.data.bytes[1],
+                                        event.data.bytes[2]);
+                        break;
+                default:
+                        break;
+                    }
+                }
+            }
+        }
+#endif
+        vst3_plugin->handle_restart_requests();
+        // While the worker is changing the plugin's state or busses, output
+        // silence; events and parameter changes remain queued for the next
+        // block.
+        auto state_lock = vst3_plugin->try_lock_state();
+        if (!state_lock.owns_lock()) {
+            silence_outputs();
+            return result;
+        }
+        if (buffer_generation != vst3_plugin->buffer_generation.load(std::memory_order_acquire)) {
+            refresh_buffers(csound);
+        }
+        if (vst3_plugin->input_sends) {
+            vst3_plugin->begin_sends(current_time_in_frames);
+        }
+        // The plugin's outputs must be delayed before they are added to the
+        // output variables, so what those hold is set aside meanwhile.
+        auto compensated_channels = vst3_plugin->latency_compensation ? compensated_channel_count() : 0;
+        bool set_aside = accumulate_outputs && compensated_channels > 0;
+        if (set_aside) {
+            auto mix = vst3_plugin->compensation_mix.data();
+            for (size_t channel_index = 0; channel_index < compensated_channels; ++channel_index) {
+                auto output = output_channels[channel_index];
+                std::copy_n(output, frame_count, mix + channel_index * frame_count);
+                std::fill_n(output, frame_count, MYFLT(0));
+            }
+        }
+        if (vst3_plugin->bridge.plugin_sample_rate > 0) {
+            if (plugin_sample_size == Steinberg::Vst::kSample32) {
+                vst3_plugin->output_silent = bridge_audio(current_time_in_frames, plugin_input_channels_32, plugin_output_channels_32);
+            } else {
+                vst3_plugin->output_silent = bridge_audio(current_time_in_frames, plugin_input_channels_64, plugin_output_channels_64);
+            }
+        } else {
+            process_block(csound, current_time_in_frames);
+        }
+        if (vst3_plugin->input_sends) {
+            vst3_plugin->end_sends(current_time_in_frames + frame_count);
+        }
+        if (vst3_plugin->update_latency()) {
+            host->update_max_latency();
+        }
+        if (compensated_channels > 0) {
+            auto &delay_lines = vst3_plugin->compensation_delay_lines;
+            size_t delay = host->max_latency - std::min(host->max_latency, vst3_plugin->latency_samples);
+            for (size_t channel_index = 0; channel_index < compensated_channels; ++channel_index) {
+                delay_lines.process(channel_index, output_channels[channel_index], frame_count, delay);
+            }
+            delay_lines.advance(frame_count);
+        }
+        if (set_aside) {
+            auto mix = vst3_plugin->compensation_mix.data();
+            for (size_t channel_index = 0; channel_index < compensated_channels; ++channel_index) {
+                mix_into(output_channels[channel_index], mix + channel_index * frame_count, frame_count);
+            }
+        }
+        return result;
+    };
+    /**
+     * Returns how many of the opcode's outputs the delay lines, and the
+     * buffer for setting aside added-to outputs, can compensate.
+     */
+    size_t compensated_channel_count() const {
+        auto channels = std::min<size_t>(opcode_output_channel_count, vst3_plugin->compensation_delay_lines.channels());
+        if (accumulate_outputs) {
+            channels = std::min(channels, vst3_plugin->compensation_mix.size() / size_t(frame_count));
+        }
+        return channels;
+    }
+    void process_block(CSOUND *csound, int64_t current_time_in_frames) {
+        // We must read or write every sample in the host buffers, but we
+        // must not access nonexistent samples in the opcode buffers. This
+        // assumes that the number of opcode channels is never greater than
+        // the number of plugin channels or that, if it is, no harm comes.
+        bool input_silent;
+        if (plugin_sample_size == Steinberg::Vst::kSample32) {
+            input_silent = copy_input(csound, plugin_input_channels_32);
+        } else {
+            input_silent = copy_input(csound, plugin_input_channels_64);
+        }
+        // An idle plugin is not processed at all until it has something to
+        // do.
+        if (vst3_plugin->should_suspend(input_silent)) {
+            silence_outputs();
+        } else {
+            vst3_plugin->process(current_time_in_frames);
+            if (plugin_sample_size == Steinberg::Vst::kSample32) {
+                vst3_plugin->output_silent = copy_output(csound, plugin_output_channels_32);
+            } else {
+                vst3_plugin->output_silent = copy_output(csound, plugin_output_channels_64);
+            }
+        }
+    }
+    /**
+     * Resamples the opcode's inputs into the bridge, processes as many
+     * whole plugin blocks as there are, and resamples the bridge's output
+     * to the opcode's outputs; returns true if the output is silent. Sends
+     * are not used.
+     */
+    template<typename SAMPLE>
+    bool bridge_audio(int64_t current_time_in_frames, SAMPLE **plugin_input_channels, SAMPLE **plugin_output_channels) {
+        auto &bridge = vst3_plugin->bridge;
+        auto block_size = vst3_plugin->blockSize;
+        auto &process_data = vst3_plugin->hostProcessData;
+        bool input_silent = true;
+        uint64_t denormals = 0;
+        uint64_t non_finite = 0;
+        for (Steinberg::int32 channel_index = 0; channel_index < plugin_input_channel_count; ++channel_index) {
+            if (channel_index < opcode_input_channel_count) {
+                auto input = input_channels[channel_index];
+                bridge.input.write(channel_index, input, frame_count);
+                input_silent = input_silent && std::all_of(input, input + frame_count, [](MYFLT sample) { return sample == 0; });
+            } else {
+                bridge.input.write<MYFLT>(channel_index, nullptr, frame_count);
+            }
+        }
+        bridge.input.commit(frame_count);
+        // The plugin's events from all of its blocks in this kperiod.
+        vst3_plugin->begin_output_events();
+        Steinberg::int32 plugin_block_start = 0;
+        while (bridge.input.available() >= size_t(block_size)) {
+            for (Steinberg::int32 channel_index = 0; channel_index < plugin_input_channel_count; ++channel_index) {
+                bridge.input.read(channel_index, plugin_input_channels[channel_index], block_size);
+            }
+            bridge.input.advance(block_size);
+            for (Steinberg::int32 bus = 0; bus < plugin_input_bus_count; ++bus) {
+                process_data.inputs[bus].silenceFlags = 0;
+            }
+            if (vst3_plugin->should_suspend(input_silent)) {
+                vst3_plugin->silence_outputs();
+            } else {
+                vst3_plugin->output_events_offset = plugin_block_start;
+                vst3_plugin->process(current_time_in_frames);
+            }
+            plugin_block_start += block_size;
+            for (Steinberg::int32 channel_index = 0; channel_index < plugin_output_channel_count; ++channel_index) {
+                auto bus_channel = plugin_output_bus_channels[channel_index];
+                if (bus_channel < 64 && (process_data.outputs[plugin_output_busses[channel_index]].silenceFlags & (uint64_t(1) << bus_channel))) {
+                    bridge.output.write<SAMPLE>(channel_index, nullptr, block_size);
+                } else {
+                    auto prior_non_finite = non_finite;
+                    count_abnormal_samples(plugin_output_channels[channel_index], block_size, denormals, non_finite);
+                    // NaN would stay in the resampler.
+                    if (non_finite != prior_non_finite) {
+                        silence_non_finite_samples(plugin_output_channels[channel_index], block_size);
+                    }
+                    bridge.output.write(channel_index, plugin_output_channels[channel_index], block_size);
+                }
+            }
+            bridge.output.commit(block_size);
+        }
+        vst3_plugin->end_output_events(frame_count);
+        // The priming should prevent this from ever being short.
+        auto frames = std::min<size_t>(frame_count, bridge.output.available());
+        bool silent = true;
+        auto scratch = bridge.scratch.data();
+        for (Steinberg::int32 channel_index = 0; channel_index < std::min(plugin_output_channel_count, opcode_output_channel_count); ++channel_index) {
+            bridge.output.read(channel_index, scratch, frames);
+            std::fill(scratch + frames, scratch + frame_count, MYFLT(0));
+            silent = silent && std::all_of(scratch, scratch + frame_count, [](MYFLT sample) { return sample == 0; });
+            auto output = output_channels[channel_index];
+            if (accumulate_outputs) {
+                for (Steinberg::int32 frame = 0; frame < frame_count; ++frame) {
+                    output[frame] += scratch[frame];
+                }
+            } else {
+                std::copy_n(scratch, frame_count, output);
+            }
+        }
+        bridge.output.advance(frames);
+        vst3_plugin->record_abnormal_samples(denormals, non_finite);
+        return silent;
+    }
+    /**
+     * Zeros the opcode's outputs, unless they are being accumulated.
+     */
+    void silence_outputs() {
+        if (accumulate_outputs) {
+            return;
+        }
+        for (Steinberg::int32 channel_index = 0; channel_index < opcode_output_channel_count; ++channel_index) {
+            std::fill_n(output_channels[channel_index], frame_count, MYFLT(0));
+        }
+    }
+    /**
+     * Copies the opcode's input channels to the plugin's input buffers, or
+     * adds them if vst3send is in use, and flags silent channels for the
+     * plugin; returns true if all are silent.
+     */
+    template<typename SAMPLE>
+    bool copy_input(CSOUND *csound, SAMPLE **plugin_input_channels) {
+        if (vst3_plugin->oversampling > 1) {
+            return upsample_input(plugin_input_channels);
+        }
+        auto busses = vst3_plugin->hostProcessData.inputs;
+        for (Steinberg::int32 bus = 0; bus < plugin_input_bus_count; ++bus) {
+            busses[bus].silenceFlags = 0;
+        }
+        bool all_silent = true;
+        bool accumulate = vst3_plugin->input_sends;
+        for (Steinberg::int32 channel_index_in = 0; channel_index_in < plugin_input_channel_count; ++channel_index_in) {
+            bool silent = true;
+            if (channel_index_in < opcode_input_channel_count) {
+                for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
+                    SAMPLE sample = input_channels[channel_index_in][frame_index];
+                    if (accumulate) {
+                        sample += plugin_input_channels[channel_index_in][frame_index];
+                    }
+                    plugin_input_channels[channel_index_in][frame_index] = sample;
+                    silent = silent && sample == 0;
+#if PROCESS_TRACING
+                    log(csound, "vst3audio::audio in: sample[%4d][%4d]: opcode: %f plugin: %f\n",
+                        channel_index_in, frame_index, input_channels[channel_index_in][frame_index], double(plugin_input_channels[channel_index_in][frame_index]));
+#endif
+                }
+            } else if (accumulate) {
+                auto samples = plugin_input_channels[channel_index_in];
+                silent = std::all_of(samples, samples + frame_count, [](SAMPLE sample) { return sample == 0; });
+            }
+            auto bus_channel = plugin_input_bus_channels[channel_index_in];
+            if (silent && bus_channel < 64) {
+                busses[plugin_input_busses[channel_index_in]].silenceFlags |= uint64_t(1) << bus_channel;
+            }
+            all_silent = all_silent && silent;
+        }
+        return all_silent;
+    }
+    /**
+     * Copies the plugin's output buffers to the opcode's output channels;
+     * channels that the plugin has flagged as silent are not read. Returns
+     * true if all are silent.
+     */
+    template<typename SAMPLE>
+    bool copy_output(CSOUND *csound, SAMPLE **plugin_output_channels) {
+        if (vst3_plugin->oversampling > 1) {
+            return downsample_output(plugin_output_channels);
+        }
+        auto busses = vst3_plugin->hostProcessData.outputs;
+        bool silent = true;
+        uint64_t denormals = 0;
+        uint64_t non_finite = 0;
+        for (Steinberg::int32 channel_index = 0; channel_index < plugin_output_channel_count; ++channel_index) {
+            auto bus_channel = plugin_output_bus_channels[channel_index];
+            if (bus_channel < 64 && (busses[plugin_output_busses[channel_index]].silenceFlags & (uint64_t(1) << bus_channel))) {
+                if (channel_index < opcode_output_channel_count && !accumulate_outputs) {
+                    std::fill_n(output_channels[channel_index], frame_count, MYFLT(0));
+                }
+                continue;
+            }
+            for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
+                SAMPLE plugin_sample = plugin_output_channels[channel_index][frame_index];
+                SAMPLE magnitude = std::abs(plugin_sample);
+                denormals += (magnitude < std::numeric_limits<SAMPLE>::min()) & (magnitude != 0);
+                bool finite = magnitude <= std::numeric_limits<SAMPLE>::max();
+                non_finite += !finite;
+                // A selection, not a branch, so that this still vectorizes.
+                MYFLT sample = finite ? MYFLT(plugin_sample) : MYFLT(0);
+                silent = silent && sample == 0;
+                if (channel_index < opcode_output_channel_count) {
+                    if (accumulate_outputs) {
+                        output_channels[channel_index][frame_index] += sample;
+                    } else {
+                        output_channels[channel_index][frame_index] = sample;
+                    }
+#if PROCESS_TRACING
+                    log(csound, "vst3audio::audio out: sample[%4d][%4d]: opcode: %f plugin: %f\n",
+                        channel_index, frame_index, output_channels[channel_index][frame_index], double(plugin_output_channels[channel_index][frame_index]));
+#endif
+                }
+            }
+        }
+        vst3_plugin->record_abnormal_samples(denormals, non_finite);
+        return silent;
+    }
+    /**
+     * Upsamples the opcode's input channels into the plugin's input buffers,
+     * and flags silent channels for the plugin; returns true if all are
+     * silent. Sends are not used.
+     */
+    template<typename SAMPLE>
+    bool upsample_input(SAMPLE **plugin_input_channels) {
+        auto busses = vst3_plugin->hostProcessData.inputs;
+        for (Steinberg::int32 bus = 0; bus < plugin_input_bus_count; ++bus) {
+            busses[bus].silenceFlags = 0;
+        }
+        bool all_silent = true;
+        for (Steinberg::int32 channel_index = 0; channel_index < plugin_input_channel_count; ++channel_index) {
+            bool silent = true;
+            if (channel_index < opcode_input_channel_count) {
+                auto input = input_channels[channel_index];
+                vst3_plugin->oversampler.upsample(channel_index, input, plugin_input_channels[channel_index]);
+                silent = std::all_of(input, input + frame_count, [](MYFLT sample) { return sample == 0; });
+            }
+            auto bus_channel = plugin_input_bus_channels[channel_index];
+            if (silent && bus_channel < 64) {
+                busses[plugin_input_busses[channel_index]].silenceFlags |= uint64_t(1) << bus_channel;
+            }
+            all_silent = all_silent && silent;
+        }
+        return all_silent;
+    }
+    /**
+     * Downsamples the plugin's output buffers to the opcode's output
+     * channels; returns true if all are silent.
+     */
+    template<typename SAMPLE>
+    bool downsample_output(SAMPLE **plugin_output_channels) {
+        auto busses = vst3_plugin->hostProcessData.outputs;
+        auto oversampled_frame_count = vst3_plugin->blockSize;
+        bool silent = true;
+        uint64_t denormals = 0;
+        uint64_t non_finite = 0;
+        for (Steinberg::int32 channel_index = 0; channel_index < std::min(plugin_output_channel_count, opcode_output_channel_count); ++channel_index) {
+            auto bus_channel = plugin_output_bus_channels[channel_index];
+            auto samples = plugin_output_channels[channel_index];
+            // The filters must see the silence.
+            if (bus_channel < 64 && (busses[plugin_output_busses[channel_index]].silenceFlags & (uint64_t(1) << bus_channel))) {
+                std::fill_n(samples, oversampled_frame_count, SAMPLE(0));
+            }
+            auto prior_non_finite = non_finite;
+            count_abnormal_samples(samples, oversampled_frame_count, denormals, non_finite);
+            // NaN would stay in the filters.
+            if (non_finite != prior_non_finite) {
+                silence_non_finite_samples(samples, oversampled_frame_count);
+            }
+            auto output = output_channels[channel_index];
+            vst3_plugin->oversampler.downsample(channel_index, samples, output, accumulate_outputs);
+            silent = silent && std::all_of(samples, samples + oversampled_frame_count, [](SAMPLE sample) { return sample == 0; });
+        }
+        vst3_plugin->record_abnormal_samples(denormals, non_finite);
+        return silent;
+    }
+};
+
+/**
+ * Adds a signal, times a gain, into one of the plugin's input channels for
+ * the current block, e.g. for many instruments to feed one reverb. Channels
+ * are numbered across all input busses as for vst3audiobus (from 0). Sends
+ * must run before the vst3audio for the plugin in the same kperiod, i.e. in
+ * lower numbered instruments; later sends are heard in the next block.
+ * Sends to an oversampled or bridged plugin are ignored.
+ */
+struct VST3SEND : public csound::OpcodeBase<VST3SEND> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *a_signal;
+    MYFLT *k_gain;
+    MYFLT *i_channel;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    Steinberg::int32 channel;
+    Steinberg::int32 frame_count;
+    int init(CSOUND *csound) {
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        if (*i_channel < 0) {
+            log(csound, "vst3send::init: invalid channel: %d\n", int(*i_channel));
+            return NOTOK;
+        }
+        channel = static_cast<Steinberg::int32>(*i_channel);
+        frame_count = ksmps();
+        vst3_plugin->input_sends = true;
+        return OK;
+    };
+    int audio(CSOUND *csound) {
+        // The buffers may be reallocated while the lock is not held.
+        auto state_lock = vst3_plugin->try_lock_state();
+        if (!state_lock.owns_lock()) {
+            return OK;
+        }
+        auto &process_data = vst3_plugin->hostProcessData;
+        if (!vst3_plugin->runs_at_host_rate() || frame_count > process_data.numSamples) {
+            return OK;
+        }
+        vst3_plugin->begin_sends(csound->GetCurrentTimeSamples(csound));
+        auto bus_channel = channel;
+        for (Steinberg::int32 bus = 0; bus < process_data.numInputs; ++bus) {
+            auto &buffers = process_data.inputs[bus];
+            if (bus_channel >= buffers.numChannels) {
+                bus_channel -= buffers.numChannels;
+                continue;
+            }
+            if (vst3_plugin->plugin_sample_size == Steinberg::Vst::kSample64) {
+                accumulate(buffers.channelBuffers64[bus_channel]);
+            } else {
+                accumulate(buffers.channelBuffers32[bus_channel]);
+            }
+            break;
+        }
+        return OK;
+    };
+    template<typename SAMPLE>
+    void accumulate(SAMPLE *__restrict samples) {
+        const MYFLT *__restrict signal = a_signal;
+        SAMPLE gain = SAMPLE(*k_gain);
+        for (Steinberg::int32 frame = 0; frame < frame_count; ++frame) {
+            samples[frame] += gain * SAMPLE(signal[frame]);
+        }
+    }
+};
+
+/**
+ * Returns a mask with the low count bits set, for silence flags.
+ */
+static inline uint64_t channel_mask(Steinberg::int32 count) {
+    return count >= 64 ? ~uint64_t(0) : (uint64_t(1) << count) - 1;
+}
+
+/**
+ * Two sets of channel buffers in each sample size. Plugins in a chain take
+ * turns reading one set and writing the other, so that audio passes from one
+ * plugin to the next without going through Csound; samples are converted
+ * only where adjacent plugins use different sample sizes.
+ */
+struct ping_pong_buffers_t {
+    Steinberg::int32 channel_count = 0;
+    Steinberg::int32 frame_count = 0;
+    std::vector<Steinberg::Vst::Sample32> samples_32[2];
+    std::vector<Steinberg::Vst::Sample64> samples_64[2];
+    std::vector<Steinberg::Vst::Sample32 *> channels_32[2];
+    std::vector<Steinberg::Vst::Sample64 *> channels_64[2];
+    /**
+     * Allocates, and so must only be called at i-time.
+     */
+    void allocate(Steinberg::int32 channels, Steinberg::int32 frames) {
+        channel_count = channels;
+        frame_count = frames;
+        for (int set = 0; set < 2; ++set) {
+            samples_32[set].assign(size_t(channels) * frames, 0.f);
+            samples_64[set].assign(size_t(channels) * frames, 0.);
+            channels_32[set].resize(channels);
+            channels_64[set].resize(channels);
+            for (Steinberg::int32 channel = 0; channel < channels; ++channel) {
+                channels_32[set][channel] = samples_32[set].data() + size_t(channel) * frames;
+                channels_64[set][channel] = samples_64[set].data() + size_t(channel) * frames;
+            }
+        }
+    }
+    /**
+     * Converts the channels in one set from one sample size to the other.
+     */
+    void convert(int set, Steinberg::int32 to_sample_size) {
+        for (Steinberg::int32 channel = 0; channel < channel_count; ++channel) {
+            if (to_sample_size == Steinberg::Vst::kSample64) {
+                std::copy_n(channels_32[set][channel], frame_count, channels_64[set][channel]);
+            } else {
+                std::copy_n(channels_64[set][channel], frame_count, channels_32[set][channel]);
+            }
+        }
+    }
+    void clear(int set, Steinberg::int32 sample_size, Steinberg::int32 channel) {
+        if (sample_size == Steinberg::Vst::kSample64) {
+            std::fill_n(channels_64[set][channel], frame_count, 0.);
+        } else {
+            std::fill_n(channels_32[set][channel], frame_count, 0.f);
+        }
+    }
+};
+
+/**
+ * Sends audio through a serial chain of plugins, e.g. a synthesizer, an
+ * equalizer, a compressor, and a reverb, in one opcode. The main output bus
+ * of each plugin feeds the main input bus of the next. Audio is converted
+ * from and to Csound's samples only at the ends of the chain; in between,
+ * the plugins read and write ping-pong buffers that are lent to them in
+ * place of their own. Plugins in the chain are not latency compensated.
+ */
+struct VST3CHAIN : public csound::OpcodeNoteoffBase<VST3CHAIN> {
+    // Outputs.
+    MYFLT *a_output_channels[32];
+    // Inputs.
+    ARRAYDAT *i_vst3_handles;
+    MYFLT *a_input_channels[32];
+    // State.
+    vst3_host_t *host;
+    std::vector<vst3_plugin_t *> *plugins;
+    ping_pong_buffers_t *buffers;
+    Steinberg::int32 opcode_input_channel_count;
+    Steinberg::int32 opcode_output_channel_count;
+    Steinberg::int32 frame_count;
+    bool warned;
+    int init(CSOUND *csound) {
+        host = vst3_host_for_csound(csound);
+        frame_count = ksmps();
+        opcode_input_channel_count = input_arg_count() - 1;
+        opcode_output_channel_count = output_arg_count();
+        if (plugins == nullptr) {
+            plugins = new std::vector<vst3_plugin_t *>;
+        }
+        plugins->clear();
+        auto handle_count = i_vst3_handles->sizes[0];
+        Steinberg::int32 channel_count = std::max(opcode_input_channel_count, opcode_output_channel_count);
+        for (int index = 0; index < handle_count; ++index) {
+            auto vst3_plugin = get_plugin(csound, static_cast<size_t>(i_vst3_handles->data[index]));
+            if (!vst3_plugin->runs_at_host_rate()) {
+                log(csound, "vst3chain::init: oversampled or bridged plugins are not supported.\n");
+                return NOTOK;
+            }
+            vst3_plugin->prepare(csoundGetSr(csound), frame_count);
+            auto &process_data = vst3_plugin->hostProcessData;
+            if (process_data.numInputs > 0) {
+                channel_count = std::max(channel_count, process_data.inputs[0].numChannels);
+            }
+            if (process_data.numOutputs > 0) {
+                channel_count = std::max(channel_count, process_data.outputs[0].numChannels);
+            }
+            plugins->push_back(vst3_plugin);
+        }
+        if (plugins->empty()) {
+            log(csound, "vst3chain::init: no plugins.\n");
+            return NOTOK;
+        }
+        if (buffers == nullptr) {
+            buffers = new ping_pong_buffers_t;
+        }
+        buffers->allocate(channel_count, frame_count);
+        warned = false;
+        log(csound, "vst3chain::init: %d plugins, %d channels.\n", int(plugins->size()), channel_count);
+        host->update_max_latency();
+        return OK;
+    };
+    int noteoff(CSOUND *csound) {
+        delete plugins;
+        plugins = nullptr;
+        delete buffers;
+        buffers = nullptr;
+        return OK;
+    };
+    int audio(CSOUND *csound) {
+        int64_t current_time_in_frames = csound->GetCurrentTimeSamples(csound);
+        int set = 0;
+        Steinberg::int32 sample_size = plugins->front()->plugin_sample_size;
+        uint64_t silence_flags = copy_input(sample_size);
+        for (auto vst3_plugin : *plugins) {
+            vst3_plugin->handle_restart_requests();
+            auto state_lock = vst3_plugin->try_lock_state();
+            if (!state_lock.owns_lock()) {
+                silence_outputs();
+                return OK;
+            }
+            // Sends reach the plugin's busses other than the main one.
+            if (vst3_plugin->input_sends) {
+                vst3_plugin->begin_sends(current_time_in_frames);
+            }
+            if (vst3_plugin->plugin_sample_size != sample_size) {
+                sample_size = vst3_plugin->plugin_sample_size;
+                buffers->convert(set, sample_size);
+            }
+            if (!process(csound, vst3_plugin, current_time_in_frames, set, sample_size, silence_flags)) {
+                silence_outputs();
+                return OK;
+            }
+            if (vst3_plugin->input_sends) {
+                vst3_plugin->end_sends(current_time_in_frames + frame_count);
+            }
+            set = 1 - set;
+            if (vst3_plugin->update_latency()) {
+                host->update_max_latency();
+            }
+        }
+        copy_output(set, sample_size, silence_flags);
+        return OK;
+    };
+    /**
+     * Processes one plugin, reading buffer set `set` and writing the other,
+     * which the plugin uses in place of its own main bus buffers. On return,
+     * silence_flags are those of the output.
+     */
+    bool process(CSOUND *csound, vst3_plugin_t *vst3_plugin, int64_t current_time_in_frames, int set, Steinberg::int32 sample_size, uint64_t &silence_flags) {
+        auto &process_data = vst3_plugin->hostProcessData;
+        Steinberg::Vst::AudioBusBuffers *inputs = process_data.numInputs > 0 ? &process_data.inputs[0] : nullptr;
+        Steinberg::Vst::AudioBusBuffers *outputs = process_data.numOutputs > 0 ? &process_data.outputs[0] : nullptr;
+        Steinberg::int32 input_channel_count = inputs ? inputs->numChannels : 0;
+        Steinberg::int32 output_channel_count = outputs ? outputs->numChannels : 0;
+        if (input_channel_count > buffers->channel_count || output_channel_count > buffers->channel_count) {
+            // The plugin has changed its busses since init.
+            if (!warned) {
+                log(csound, "vst3chain::audio: a plugin has more channels than the chain.\n");
+                warned = true;
+            }
+            return false;
+        }
+        int output_set = 1 - set;
+        Steinberg::Vst::Sample32 **saved_inputs_32 = nullptr;
+        Steinberg::Vst::Sample64 **saved_inputs_64 = nullptr;
+        Steinberg::Vst::Sample32 **saved_outputs_32 = nullptr;
+        Steinberg::Vst::Sample64 **saved_outputs_64 = nullptr;
+        if (inputs) {
+            saved_inputs_32 = inputs->channelBuffers32;
+            saved_inputs_64 = inputs->channelBuffers64;
+            if (sample_size == Steinberg::Vst::kSample64) {
+                inputs->channelBuffers64 = buffers->channels_64[set].data();
+            } else {
+                inputs->channelBuffers32 = buffers->channels_32[set].data();
+            }
+            inputs->silenceFlags = silence_flags & channel_mask(input_channel_count);
+        }
+        if (outputs) {
+            saved_outputs_32 = outputs->channelBuffers32;
+            saved_outputs_64 = outputs->channelBuffers64;
+            if (sample_size == Steinberg::Vst::kSample64) {
+                outputs->channelBuffers64 = buffers->channels_64[output_set].data();
+            } else {
+                outputs->channelBuffers32 = buffers->channels_32[output_set].data();
+            }
+        }
+        bool input_silent = (~silence_flags & channel_mask(input_channel_count)) == 0;
+        if (vst3_plugin->should_suspend(input_silent)) {
+            for (Steinberg::int32 channel = 0; channel < output_channel_count; ++channel) {
+                buffers->clear(output_set, sample_size, channel);
+            }
+            silence_flags = ~uint64_t(0);
+        } else {
+            vst3_plugin->process(current_time_in_frames);
+            silence_flags = outputs ? outputs->silenceFlags : 0;
+            // The next plugin may not honor the flags.
+            bool output_silent = true;
+            uint64_t denormals = 0;
+            uint64_t non_finite = 0;
+            for (Steinberg::int32 channel = 0; channel < output_channel_count; ++channel) {
+                if (channel < 64 && (silence_flags & (uint64_t(1) << channel))) {
+                    buffers->clear(output_set, sample_size, channel);
+                    continue;
+                }
+                // Here rather than in copy_output, so that NaN does not reach
+                // the next plugin, and the fault is the right plugin's.
+                auto prior_non_finite = non_finite;
+                if (sample_size == Steinberg::Vst::kSample64) {
+                    count_abnormal_samples(buffers->channels_64[output_set][channel], frame_count, denormals, non_finite);
+                    if (non_finite != prior_non_finite) {
+                        silence_non_finite_samples(buffers->channels_64[output_set][channel], frame_count);
+                    }
+                } else {
+                    count_abnormal_samples(buffers->channels_32[output_set][channel], frame_count, denormals, non_finite);
+                    if (non_finite != prior_non_finite) {
+                        silence_non_finite_samples(buffers->channels_32[output_set][channel], frame_count);
+                    }
+                }
+                if (vst3_plugin->auto_suspend && output_silent) {
+                    if (sample_size == Steinberg::Vst::kSample64) {
+                        auto samples = buffers->channels_64[output_set][channel];
+                        output_silent = std::all_of(samples, samples + frame_count, [](double sample) { return sample == 0; });
+                    } else {
+                        auto samples = buffers->channels_32[output_set][channel];
+                        output_silent = std::all_of(samples, samples + frame_count, [](float sample) { return sample == 0; });
+                    }
+                }
+            }
+            vst3_plugin->output_silent = output_silent;
+            vst3_plugin->record_abnormal_samples(denormals, non_finite);
+            silence_flags |= ~channel_mask(output_channel_count);
+        }
+        // Channels the plugin does not have are silent.
+        for (Steinberg::int32 channel = output_channel_count; channel < buffers->channel_count; ++channel) {
+            buffers->clear(output_set, sample_size, channel);
+        }
+        if (inputs) {
+            inputs->channelBuffers32 = saved_inputs_32;
+            inputs->channelBuffers64 = saved_inputs_64;
+        }
+        if (outputs) {
+            outputs->channelBuffers32 = saved_outputs_32;
+            outputs->channelBuffers64 = saved_outputs_64;
+        }
+        return true;
+    }
+    /**
+     * Copies the opcode's inputs to buffer set 0, and returns their silence
+     * flags.
+     */
+    uint64_t copy_input(Steinberg::int32 sample_size) {
+        uint64_t silence_flags = ~uint64_t(0);
+        for (Steinberg::int32 channel = 0; channel < buffers->channel_count; ++channel) {
+            if (channel >= opcode_input_channel_count) {
+                buffers->clear(0, sample_size, channel);
+                continue;
+            }
+            auto input = a_input_channels[channel];
+            if (sample_size == Steinberg::Vst::kSample64) {
+                std::copy_n(input, frame_count, buffers->channels_64[0][channel]);
+            } else {
+                std::copy_n(input, frame_count, buffers->channels_32[0][channel]);
+            }
+            bool silent = std::all_of(input, input + frame_count, [](MYFLT sample) { return sample == 0; });
+            if (!silent && channel < 64) {
+                silence_flags &= ~(uint64_t(1) << channel);
+            }
+        }
+        return silence_flags;
+    }
+    void copy_output(int set, Steinberg::int32 sample_size, uint64_t silence_flags) {
+        for (Steinberg::int32 channel = 0; channel < opcode_output_channel_count; ++channel) {
+            auto output = a_output_channels[channel];
+            if (channel >= buffers->channel_count || (channel < 64 && (silence_flags & (uint64_t(1) << channel)))) {
+                std::fill_n(output, frame_count, MYFLT(0));
+            } else if (sample_size == Steinberg::Vst::kSample64) {
+                std::copy_n(buffers->channels_64[set][channel], frame_count, output);
+            } else {
+                std::copy_n(buffers->channels_32[set][channel], frame_count, output);
+            }
+        }
+    }
+    void silence_outputs() {
+        for (Steinberg::int32 channel = 0; channel < opcode_output_channel_count; ++channel) {
+            std::fill_n(a_output_channels[channel], frame_count, MYFLT(0));
+        }
+    }
+};
+
+/**
+ * Runs a task for each of a number of items, on the calling thread and on a
+ * few helper threads. The calling thread never waits on a lock held for
+ * longer than it takes to wake the helpers, and takes items itself, so it
+ * finishes even if no helper wakes in time. Helpers spin briefly before they
+ * sleep, so that in steady state they are awake for the next kperiod.
+ *
+ * Items are claimed from one word holding the run's generation (high 32
+ * bits), its item count (16 bits), and the next item (low 16 bits). A helper
+ * still inside a finished run cannot claim an item of the next run, because
+ * its claim fails once the generation has changed; and a helper that claims
+ * an item has acquired everything the caller wrote before starting the run.
+ */
+class parallel_for_t {
+public:
+    parallel_for_t(size_t helper_count, std::function<void(size_t)> task_) : task(std::move(task_)) {
+        for (size_t index = 0; index < helper_count; ++index) {
+            helpers.emplace_back([this] { help(); });
+        }
+    }
+    ~parallel_for_t() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        condition.notify_all();
+        for (auto &helper : helpers) {
+            helper.join();
+        }
+    }
+    void run(size_t count) {
+        count = std::min<size_t>(count, kMaxItems);
+        // Every item of the previous run is done, so nothing else writes
+        // this now.
+        done_count.store(0, std::memory_order_relaxed);
+        auto run_generation = (claim.load(std::memory_order_relaxed) >> 32) + 1;
+        claim.store((run_generation << 32) | (uint64_t(count) << 16), std::memory_order_release);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+        }
+        condition.notify_all();
+        work(run_generation);
+        while (done_count.load(std::memory_order_acquire) < count) {
+            std::this_thread::yield();
+        }
+    }
+private:
+    static constexpr int kSpinCount = 4096;
+    static constexpr size_t kMaxItems = 0xFFFF;
+    /**
+     * Claims and runs items of the given run until there are none left, or
+     * until another run has started.
+     */
+    void work(uint64_t generation) {
+        auto current = claim.load(std::memory_order_acquire);
+        for (;;) {
+            if ((current >> 32) != generation) {
+                return;
+            }
+            auto item = current & 0xFFFF;
+            if (item >= ((current >> 16) & 0xFFFF)) {
+                return;
+            }
+            if (!claim.compare_exchange_weak(current, current + 1, std::memory_order_acq_rel, std::memory_order_acquire)) {
+                continue;
+            }
+            task(item);
+            done_count.fetch_add(1, std::memory_order_release);
+            current = claim.load(std::memory_order_acquire);
+        }
+    }
+    uint64_t generation() const {
+        return claim.load(std::memory_order_acquire) >> 32;
+    }
+    void help() {
+        uint64_t seen = 0;
+        for (;;) {
+            int spins = 0;
+            while (generation() == seen) {
+                if (++spins < kSpinCount) {
+                    std::this_thread::yield();
+                    continue;
+                }
+                std::unique_lock<std::mutex> lock(mutex);
+                condition.wait(lock, [&] { return stopping || generation() != seen; });
+                if (stopping) {
+                    return;
+                }
+            }
+            seen = generation();
+            work(seen);
+        }
+    }
+    std::function<void(size_t)> task;
+    std::vector<std::thread> helpers;
+    std::mutex mutex;
+    std::condition_variable condition;
+    bool stopping = false;
+    // The generation of the current run, its item count, and its next
+    // item; see work.
+    std::atomic<uint64_t> claim{0};
+    std::atomic<size_t> done_count{0};
+};
+
+/**
+ * Drives several instances of a plugin, e.g. layers of a sound, as one unit,
+ * and sums their main outputs. Events sent to the first (leader) handle,
+ * including MIDI controllers mapped to parameters, are sent to every
+ * instance; other parameters stay separate. The inputs, if any, are sent to
+ * every instance. If iparallel is non-zero, the instances are processed in
+ * parallel on that many threads in addition to Csound's.
+ */
+struct VST3LAYERS : public csound::OpcodeNoteoffBase<VST3LAYERS> {
+    // Outputs.
+    MYFLT *a_output_channels[32];
+    // Inputs.
+    ARRAYDAT *i_vst3_handles;
+    MYFLT *i_parallel;
+    MYFLT *a_input_channels[32];
+    // State.
+    std::vector<vst3_plugin_t *> *plugins;
+    std::vector<char> *processed;
+    parallel_for_t *parallel_for;
+    Steinberg::int32 opcode_input_channel_count;
+    Steinberg::int32 opcode_output_channel_count;
+    Steinberg::int32 frame_count;
+    int64_t current_time_in_frames;
+    // How many of the leader's queued events and MIDI controller changes
+    // have been sent to the other instances; see fan_out.
+    Steinberg::int32 fanned_out_events;
+    size_t fanned_out_changes;
+    int init(CSOUND *csound) {
+        frame_count = ksmps();
+        fanned_out_events = 0;
+        fanned_out_changes = 0;
+        opcode_input_channel_count = input_arg_count() - 2;
+        opcode_output_channel_count = output_arg_count();
+        if (plugins == nullptr) {
+            plugins = new std::vector<vst3_plugin_t *>;
+            processed = new std::vector<char>;
+        }
+        plugins->clear();
+        auto handle_count = i_vst3_handles->sizes[0];
+        for (int index = 0; index < handle_count; ++index) {
+            auto vst3_plugin = get_plugin(csound, static_cast<size_t>(i_vst3_handles->data[index]));
+            if (!vst3_plugin->runs_at_host_rate()) {
+                log(csound, "vst3layers::init: oversampled or bridged plugins are not supported.\n");
+                return NOTOK;
+            }
+            vst3_plugin->prepare(csoundGetSr(csound), frame_count);
+            vst3_plugin->initialize_midi_cc_mapping();
+            plugins->push_back(vst3_plugin);
+        }
+        if (plugins->empty()) {
+            log(csound, "vst3layers::init: no plugins.\n");
+            return NOTOK;
+        }
+        processed->assign(plugins->size(), 0);
+        delete parallel_for;
+        parallel_for = nullptr;
+        size_t helper_count = std::min(static_cast<size_t>(std::max(*i_parallel, MYFLT(0))), plugins->size() - 1);
+        if (helper_count > 0) {
+            parallel_for = new parallel_for_t(helper_count, [this](size_t index) { process(index); });
+        }
+        for (auto vst3_plugin : *plugins) {
+            vst3_plugin->defer_event_routing = parallel_for != nullptr;
+        }
+        log(csound, "vst3layers::init: %d plugins, %d helper threads.\n", int(plugins->size()), int(helper_count));
+        return OK;
+    };
+    int noteoff(CSOUND *csound) {
+        delete parallel_for;
+        parallel_for = nullptr;
+        if (plugins) {
+            for (auto vst3_plugin : *plugins) {
+                vst3_plugin->defer_event_routing = false;
+            }
+        }
+        delete plugins;
+        plugins = nullptr;
+        delete processed;
+        processed = nullptr;
+        return OK;
+    };
+    int audio(CSOUND *csound) {
+        current_time_in_frames = csound->GetCurrentTimeSamples(csound);
+        fan_out();
+        // Restart requests are taken on this thread, as vst3audio does.
+        for (auto vst3_plugin : *plugins) {
+            vst3_plugin->handle_restart_requests();
+        }
+        if (parallel_for) {
+            parallel_for->run(plugins->size());
+            // Routing writes to the destinations, which the helper threads
+            // may have been processing.
+            for (size_t index = 0; index < plugins->size(); ++index) {
+                if ((*processed)[index]) {
+                    (*plugins)[index]->route_output_events();
+                }
+            }
+        } else {
+            for (size_t index = 0; index < plugins->size(); ++index) {
+                process(index);
+            }
+        }
+        for (Steinberg::int32 channel = 0; channel < opcode_output_channel_count; ++channel) {
+            std::fill_n(a_output_channels[channel], frame_count, MYFLT(0));
+        }
+        for (size_t index = 0; index < plugins->size(); ++index) {
+            if ((*processed)[index]) {
+                mix((*plugins)[index]);
+            }
+        }
+        return OK;
+    };
+    /**
+     * Sends the events and MIDI controller changes queued for the leader
+     * since the last call to the other instances, so that each is sent only
+     * once even if the leader is skipped and keeps them queued.
+     */
+    void fan_out() {
+        auto leader = plugins->front();
+        auto event_count = leader->inputEventList.getEventCount();
+        auto change_count = leader->midi_parameter_changes.size();
+        for (size_t index = 1; index < plugins->size(); ++index) {
+            auto follower = (*plugins)[index];
+            for (Steinberg::int32 event_index = fanned_out_events; event_index < event_count; ++event_index) {
+                Steinberg::Vst::Event event;
+                if (leader->inputEventList.getEvent(event_index, event) == Steinberg::kResultOk) {
+                    follower->inputEventList.addEvent(event);
+                }
+            }
+            for (size_t change_index = fanned_out_changes; change_index < change_count; ++change_index) {
+                const auto &change = leader->midi_parameter_changes[change_index];
+                follower->add_midi_parameter_change(change.id, change.value, change.sample_offset);
+            }
+        }
+        fanned_out_events = event_count;
+        fanned_out_changes = change_count;
+    }
+    /**
+     * Copies the inputs to one instance and processes it; this may run on a
+     * helper thread. An instance whose state is being changed is skipped.
+     */
+    void process(size_t index) {
+        auto vst3_plugin = (*plugins)[index];
+        (*processed)[index] = 0;
+        auto state_lock = vst3_plugin->try_lock_state();
+        if (!state_lock.owns_lock()) {
+            return;
+        }
+        // Sends reach the plugin's busses other than the main one.
+        if (vst3_plugin->input_sends) {
+            vst3_plugin->begin_sends(current_time_in_frames);
+        }
+        auto &process_data = vst3_plugin->hostProcessData;
+        bool input_silent = true;
+        if (process_data.numInputs > 0) {
+            auto &inputs = process_data.inputs[0];
+            inputs.silenceFlags = 0;
+            for (Steinberg::int32 channel = 0; channel < inputs.numChannels; ++channel) {
+                bool silent = channel >= opcode_input_channel_count ||
+                              std::all_of(a_input_channels[channel], a_input_channels[channel] + frame_count, [](MYFLT sample) { return sample == 0; });
+                if (vst3_plugin->plugin_sample_size == Steinberg::Vst::kSample64) {
+                    if (silent) {
+                        std::fill_n(inputs.channelBuffers64[channel], frame_count, 0.);
+                    } else {
+                        std::copy_n(a_input_channels[channel], frame_count, inputs.channelBuffers64[channel]);
+                    }
+                } else {
+                    if (silent) {
+                        std::fill_n(inputs.channelBuffers32[channel], frame_count, 0.f);
+                    } else {
+                        std::copy_n(a_input_channels[channel], frame_count, inputs.channelBuffers32[channel]);
+                    }
+                }
+                if (silent && channel < 64) {
+                    inputs.silenceFlags |= uint64_t(1) << channel;
+                }
+                input_silent = input_silent && silent;
+            }
+        }
+        if (!vst3_plugin->should_suspend(input_silent) && vst3_plugin->process(current_time_in_frames)) {
+            (*processed)[index] = 1;
+        }
+        if (vst3_plugin->input_sends) {
+            vst3_plugin->end_sends(current_time_in_frames + frame_count);
+        }
+        // If the leader was suspended, its queues still hold what has
+        // already been sent to the other instances; otherwise they have been
+        // emptied. If it was skipped, they are as fan_out left them.
+        if (index == 0) {
+            fanned_out_events = std::min(fanned_out_events, vst3_plugin->inputEventList.getEventCount());
+            fanned_out_changes = std::min(fanned_out_changes, vst3_plugin->midi_parameter_changes.size());
+        }
+    }
+    /**
+     * Adds one instance's main outputs to the opcode's outputs.
+     */
+    void mix(vst3_plugin_t *vst3_plugin) {
+        auto &process_data = vst3_plugin->hostProcessData;
+        if (process_data.numOutputs == 0) {
+            return;
+        }
+        auto &outputs = process_data.outputs[0];
+        auto channel_count = std::min(outputs.numChannels, opcode_output_channel_count);
+        bool output_silent = true;
+        uint64_t denormals = 0;
+        uint64_t non_finite = 0;
+        for (Steinberg::int32 channel = 0; channel < channel_count; ++channel) {
+            if (channel < 64 && (outputs.silenceFlags & (uint64_t(1) << channel))) {
+                continue;
+            }
+            output_silent = false;
+            auto prior_non_finite = non_finite;
+            if (vst3_plugin->plugin_sample_size == Steinberg::Vst::kSample64) {
+                count_abnormal_samples(outputs.channelBuffers64[channel], frame_count, denormals, non_finite);
+                if (non_finite != prior_non_finite) {
+                    silence_non_finite_samples(outputs.channelBuffers64[channel], frame_count);
+                }
+                mix_into(a_output_channels[channel], outputs.channelBuffers64[channel], frame_count);
+            } else {
+                count_abnormal_samples(outputs.channelBuffers32[channel], frame_count, denormals, non_finite);
+                if (non_finite != prior_non_finite) {
+                    silence_non_finite_samples(outputs.channelBuffers32[channel], frame_count);
+                }
+                mix_into(a_output_channels[channel], outputs.channelBuffers32[channel], frame_count);
+            }
+        }
+        vst3_plugin->output_silent = output_silent;
+        vst3_plugin->record_abnormal_samples(denormals, non_finite);
+    }
+};
+
+struct VST3INFO : public csound::OpcodeBase<VST3INFO> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        log(csound, "vst3info::init: Current plugin configuration...\n");
+        vst3_plugin->information(true);
+        return result;
+    };
+};
+
+struct VST3INIT : public csound::OpcodeBase<VST3INIT> {
+    // Outputs.
+    MYFLT *i_vst3_handle;
+    // Inputs.
+    MYFLT *i_module_pathname;
+    MYFLT *i_plugin_name;
+    MYFLT *i_verbose;
+    int init(CSOUND *csound) {
+        int result = OK;
+        log(csound, "\nvst3init::init...\n");
+        auto host = vst3_host_for_csound(csound);
+        log(csound, "vst3init::init: host: %p\n", host);
+        std::string module_pathname  =((STRINGDAT *)i_module_pathname)->data;
+        std::string plugin_name = ((STRINGDAT *)i_plugin_name)->data;
+        log(csound, "vst3init::init: loading module: \"%s\",  \"%s\"...\n", module_pathname.c_str(), plugin_name.c_str());
+        *i_vst3_handle = host->load_module(csound, module_pathname, plugin_name,(bool)*i_verbose);
+        log(csound, "vst3init::init: loaded module: \"%s\",  \"%s\" i_vst3_handle: %ld...\n", module_pathname.c_str(), plugin_name.c_str(), (size_t)*i_vst3_handle);
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        log(csound, "vst3init::init: created plugin: \"%s\": address: %p handle: %ld\n", plugin_name.c_str(), vst3_plugin,(size_t) *i_vst3_handle);
+        return result;
+    };
+};
+
+/**
+ * Saves the state of every plugin in this Csound instance to one session
+ * file, written in the background.
+ */
+struct VST3SESSIONSAVE : public csound::OpcodeBase<VST3SESSIONSAVE> {
+    // Inputs.
+    MYFLT *i_session_filepath;
+    int init(CSOUND *csound) {
+        auto host = vst3_host_for_csound(csound);
+        std::string session_filepath = ((STRINGDAT *)i_session_filepath)->data;
+        if (!host->save_session(csound, session_filepath)) {
+            log(csound, "vst3sessionsave::init: could not capture the session.\n");
+            return NOTOK;
+        }
+        return OK;
+    };
+};
+
+/**
+ * Creates every plugin in a session file, with its state, and returns the
+ * handle of the first; the others have the following handles, in the order
+ * in which they were saved.
+ */
+struct VST3SESSIONLOAD : public csound::OpcodeBase<VST3SESSIONLOAD> {
+    // Outputs.
+    MYFLT *i_first_handle;
+    // Inputs.
+    MYFLT *i_session_filepath;
+    MYFLT *i_verbose;
+    int init(CSOUND *csound) {
+        auto host = vst3_host_for_csound(csound);
+        std::string session_filepath = ((STRINGDAT *)i_session_filepath)->data;
+        *i_first_handle = host->load_session(csound, session_filepath, *i_verbose != 0);
+        if (*i_first_handle < 0) {
+            return NOTOK;
+        }
+        return OK;
+    };
+};
+
+struct VST3INITPRESET : public csound::OpcodeBase<VST3INITPRESET> {
+    // Outputs.
+    MYFLT *i_vst3_handle;
+    // Inputs.
+    MYFLT *i_module_pathname;
+    MYFLT *i_plugin_name;
+    MYFLT *i_preset_filepath;
+    MYFLT *i_verbose;
+    int init(CSOUND *csound) {
+        int result = OK;
+        log(csound, "\nvst3init::init...\n");
+        auto host = vst3_host_for_csound(csound);
+        log(csound, "vst3init::init: host: %p\n", host);
+        std::string module_pathname  =((STRINGDAT *)i_module_pathname)->data;
+        std::string plugin_name = ((STRINGDAT *)i_plugin_name)->data;
+        log(csound, "vst3init::init: loading module: \"%s\",  \"%s\"...\n", module_pathname.c_str(), plugin_name.c_str());
+        *i_vst3_handle = host->load_module(csound, module_pathname, plugin_name,(bool)*i_verbose);
+        log(csound, "vst3init::init: loaded module: \"%s\",  \"%s\" i_vst3_handle: %ld...\n", module_pathname.c_str(), plugin_name.c_str(), (size_t)*i_vst3_handle);
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        log(csound, "vst3init::init: created plugin: \"%s\": address: %p handle: %ld\n", plugin_name.c_str(), vst3_plugin,(size_t) *i_vst3_handle);
+        std::string preset_filepath = ((STRINGDAT *)i_preset_filepath)->data;
+        if (preset_filepath.length() > 0) {
+            result = vst3_plugin->load_preset(preset_filepath);
+        }
+        return result;
+    };
+};
+
+
+#if EDITOR_IMPLEMENTED
+
+struct VST3EDIT : public csound::OpcodeBase<VST3EDIT> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    /**
+     * Set up a display, a window, and an associated event loop
+     * for showing the plugin editor. These will run until the user
+     * closes the editor window,
+     */
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+#if defined(LINUX)
+#ifdef EDITORHOST_GTK
+        app = Gtk::Application::create ("net.steinberg.vstsdk.editorhost");
+        application->init (cmdArgs);
+        eventLoop ();
+
+#else
+        // Connect to X server
+        std::string displayName (getenv ("DISPLAY"));
+        if (displayName.empty ())
+            displayName = ":0.0";
+        auto display = XOpenDisplay (displayName.data ());
+        RunLoop::instance ().setDisplay (display);
+        application->init (cmdArgs);
+        eventLoop ();
+        XCloseDisplay (display);
+#endif
+#endif
+        vst3_plugin->showPluginEditorWindow();
+        return result;
+    };
+};
+
+#endif
+
+struct VST3MIDIOUT : public csound::OpcodeBase<VST3MIDIOUT> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *k_status;
+    MYFLT *k_channel;
+    MYFLT *k_data1;
+    MYFLT *k_data2;
+    // State.
+    // MIDI channel message parts.
+    uint8_t status;
+    uint8_t channel;
+    uint8_t data1;
+    uint8_t data2;
+    uint32_t midi_channel_message;
+    uint32_t prior_midi_channel_message;
+    vst3_plugin_t *vst3_plugin;
+    int init(CSOUND *csound) {
+        int result = OK;
+        midi_channel_message = 0;
+        prior_midi_channel_message = 0;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        vst3_plugin->initialize_midi_cc_mapping();
+        return result;
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        status = static_cast<uint8_t>(*k_status) & 0xF0;
+        channel = static_cast<uint8_t>(*k_channel) & 0x0F;
+        data1 = static_cast<uint8_t>(*k_data1);
+        data2 = static_cast<uint8_t>(*k_data2);
+        if (status < 0x80) {
+            return result;
+        }
+        midi_channel_message = (status << 24) | (channel << 16) | (data1 << 8) | data2;
+        if (midi_channel_message != prior_midi_channel_message) {
+            // Only the first kperiod of a note can start part way into the block.
+            Steinberg::int32 sample_offset = static_cast<Steinberg::int32>(kperiodOffset());
+            vst3_plugin->send_channel_message(status, channel, data1, data2, sample_offset);
+            prior_midi_channel_message = midi_channel_message;
+        }
+        return result;
+    };
+};
+
+/**
+ * Reads the events that the plugin output in its most recent block, one
+ * event per call, so that all of a block's events can be read by calling
+ * this opcode in a loop until k_status is 0. Each opcode instance keeps its
+ * own place in the block. The plugin's vst3audio must run before this
+ * opcode in the same kperiod, i.e. in a lower-numbered instrument, for the
+ * events to be read in the same block they were output.
+ */
+struct VST3MIDIIN : public csound::OpcodeBase<VST3MIDIIN> {
+    // Outputs.
+    MYFLT *k_status;
+    MYFLT *k_channel;
+    MYFLT *k_data1;
+    MYFLT *k_data2;
+    MYFLT *k_sample_offset;
+    MYFLT *k_note_id;
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    uint64_t block;
+    size_t event_index;
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        block = vst3_plugin->output_events_block;
+        event_index = vst3_plugin->output_events.size();
+        return result;
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        if (block != vst3_plugin->output_events_block) {
+            block = vst3_plugin->output_events_block;
+            event_index = 0;
+        }
+        MYFLT fields[6] = {0, 0, 0, 0, 0, -1};
+        while (event_index < vst3_plugin->output_events.size()) {
+            if (event_to_midi(vst3_plugin->output_events[event_index++], fields)) {
+                break;
+            }
+            fields[0] = 0;
+        }
+        *k_status = fields[0];
+        *k_channel = fields[1];
+        *k_data1 = fields[2];
+        *k_data2 = fields[3];
+        *k_sample_offset = fields[4];
+        *k_note_id = fields[5];
+        return result;
+    };
+};
+
+/**
+ * Reads all the events that the plugin output in its most recent block
+ * into the rows of a two-dimensional array, one row per event with the
+ * columns status, channel, data1, data2, sample offset, and note ID. The
+ * array is sized once at i-time to i_maximum_events rows (default 128);
+ * k_count is the number of rows filled. Any events that do not fit are
+ * returned by the next call in the same block.
+ */
+struct VST3MIDIINARRAY : public csound::OpcodeBase<VST3MIDIINARRAY> {
+    // Outputs.
+    MYFLT *k_count;
+    ARRAYDAT *k_events;
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_maximum_events;
+    // State.
+    static constexpr int kColumns = 6;
+    vst3_plugin_t *vst3_plugin;
+    uint64_t block;
+    size_t event_index;
+    int maximum_events;
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        maximum_events = static_cast<int>(*i_maximum_events);
+        if (maximum_events <= 0) {
+            maximum_events = 128;
+        }
+        allocate_array(csound, k_events, maximum_events, kColumns);
+        block = vst3_plugin->output_events_block;
+        event_index = vst3_plugin->output_events.size();
+        return result;
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        if (block != vst3_plugin->output_events_block) {
+            block = vst3_plugin->output_events_block;
+            event_index = 0;
+        }
+        int count = 0;
+        const auto &output_events = vst3_plugin->output_events;
+        while (event_index < output_events.size() && count < maximum_events) {
+            if (event_to_midi(output_events[event_index++], &k_events->data[count * kColumns])) {
+                count++;
+            }
+        }
+        *k_count = count;
+        return result;
+    };
+};
+
+/**
+ * Routes all events output by the source plugin directly into the input of
+ * the destination plugin, without passing through Csound. For the events to
+ * arrive in the same block, the source plugin's vst3audio must run before
+ * the destination plugin's vst3audio. If i_enable is 0, removes the route.
+ */
+struct VST3EVENTROUTE : public csound::OpcodeBase<VST3EVENTROUTE> {
+    // Inputs.
+    MYFLT *i_source_handle;
+    MYFLT *i_destination_handle;
+    MYFLT *i_enable;
+    int init(CSOUND *csound) {
+        auto source = get_plugin(csound, static_cast<size_t>(*i_source_handle));
+        auto destination = get_plugin(csound, static_cast<size_t>(*i_destination_handle));
+        if (source == destination) {
+            log(csound, "vst3eventroute::init: a plugin cannot route events to itself.\n");
+            return NOTOK;
+        }
+        auto &destinations = source->event_destinations;
+        auto iterator = std::find(destinations.begin(), destinations.end(), destination);
+        if (*i_enable != 0) {
+            if (iterator == destinations.end()) {
+                destination->initialize_midi_cc_mapping();
+                destinations.push_back(destination);
+            }
+        } else if (iterator != destinations.end()) {
+            destinations.erase(iterator);
+        }
+        log(csound, "vst3eventroute::init: plugin %d routes events to %d plugin(s).\n", int(*i_source_handle), int(destinations.size()));
+        return OK;
+    };
+};
+
+struct VST3NOTE : public csound::OpcodeNoteoffBase<VST3NOTE> {
+    // Outputs.
+    MYFLT *i_note_id;
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_channel;
+    MYFLT *i_key;
+    MYFLT *i_velocity;
+    MYFLT *i_duration;
+    // State.
+    int16 channel;		// channel index in event bus
+    MYFLT pitch;
+    int16 midi_key;		// range [0, 127] = [C-2, G8] with A3=440Hz(12-TET)
+    float tuning_cents;	// 1.f = +1 cent, -1.f = -1 cent
+    float velocity;		// range [0.0, 1.0]
+    int32 length;		// in sample frames (optional, Note Off has to follow in any case!)
+    Steinberg::Vst::Event note_on_event{};
+    Steinberg::Vst::Event note_off_event{};
+    size_t framesRemaining;
+    vst3_plugin_t *vst3_plugin;
+    MYFLT note_on_time;
+    MYFLT note_duration;
+    MYFLT note_off_time;
+    MYFLT delta_time;
+    int delta_frames;
+    MYFLT note_off_delta_time;
+    int note_off_delta_frames;
+    bool on = false;
+    int init(CSOUND *csound) {
+        int result = OK;
+        on = false;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        auto current_time = csound->GetCurrentTimeSamples(csound) / csoundGetSr(csound);
+        // If scheduled after the beginning of the kperiod, will be slightly later.
+        note_on_time = opds.insdshead->p2.value;
+        note_duration = *i_duration;
+        delta_time = note_on_time - current_time;
+        int delta_frames = delta_time * csoundGetSr(csound);
+        // Use the warped p3 to schedule the note off message.
+        if (note_duration > static_cast<MYFLT>(0.0)) {
+            note_off_time = note_on_time + MYFLT(opds.insdshead->p3.value);
+            // In case of real-time performance with indefinite p3...
+        } else if (note_duration == static_cast<MYFLT>(0.0)) {
+#if DEBUGGING
+            csound->Message(csound,
+                            Str("vstnote::init: not scheduling 0 duration note.\n"));
+#endif
+            return OK;
+        } else {
+            note_off_time = note_on_time + static_cast<MYFLT>(1000000.0);
+        }
+        channel = Steinberg::int16(*i_channel) & 0xf;
+        // Split the real-valued MIDI key number
+        // into an integer key number and an integer number of cents(plus or
+        // minus 50 cents).
+        pitch = *i_key;
+        midi_key = std::round(pitch);
+        tuning_cents = (pitch - midi_key) * double(100.0);
+#if TUNING_TRACING
+        log(csound, "pitch: %9.4f midi_key: %4d tuning_cents: %9.4f\n", pitch, midi_key, tuning_cents);
+#endif
+        velocity = *i_velocity;
+        velocity = velocity / 127.;
+        // Ensure that the opcode instance is still active when we are scheduled
+        // to turn the note off!
+        opds.insdshead->xtratim = opds.insdshead->xtratim + 2;
+        on = true;
+        note_on_event.type = Steinberg::Vst::Event::EventTypes::kNoteOnEvent;
+        note_on_event.sampleOffset = delta_frames;
+        note_on_event.noteOn.channel = channel;
+        note_on_event.noteOn.pitch = midi_key;
+        note_on_event.noteOn.tuning = tuning_cents;
+        note_on_event.noteOn.velocity = velocity;
+        note_on_event.noteOn.length = note_duration * csoundGetSr(csound);
+        note_on_event.noteOn.noteId = vst3_plugin->active_notes.add(channel, midi_key, tuning_cents);
+        note_off_event.type = Steinberg::Vst::Event::EventTypes::kNoteOffEvent;
+        note_off_event.noteOff.channel = note_on_event.noteOn.channel;
+        note_off_event.noteOff.pitch = note_on_event.noteOn.pitch;
+        note_off_event.noteOff.tuning = note_on_event.noteOn.tuning;
+        note_off_event.noteOff.velocity = 0;
+        note_off_event.noteOff.noteId = note_on_event.noteOn.noteId;
+#if NOTE_TRACING
+        log(csound, "vst3note::init:    current_time:                %12.5f [%12d]\n", current_time, csound->GetCurrentTimeSamples(csound));
+        log(csound, "                   note_on_event time:          %12.5f\n", note_on_time);
+        log(csound, "                   delta_time:                  %12.5f\n", delta_time);
+        log(csound, "                   delta_frames:                %1d\n", delta_frames);
+        log(csound, "                   offset:                      %d\n", note_on_event.sampleOffset);
+        log(csound, "                   note_on_event.type:          %d\n", note_on_event.type);
+        log(csound, "                   note_on_event.sampleOffset:  %d\n", note_on_event.sampleOffset);
+        log(csound, "                   note_on_event.channel:       %d\n", note_on_event.noteOn.channel);
+        log(csound, "                   note_on_event.pitch:         %d\n", note_on_event.noteOn.pitch);
+        log(csound, "                   note_on_event.tuning:        %f\n", note_on_event.noteOn.tuning);
+        log(csound, "                   note_on_event.velocity:      %f\n", note_on_event.noteOn.velocity);
+        log(csound, "                   note_on_event.length:        %d\n", note_on_event.noteOn.length);
+        log(csound, "                   note_on_event.noteId:        %d\n", note_on_event.noteOn.noteId);
+#endif
+        if (vst3_plugin->inputEventList.addEvent(note_on_event) != Steinberg::kResultOk) {
+            log(csound, "vst3note::init: addEvent error for Note On.\n");
+        }
+        *i_note_id = note_on_event.noteOn.noteId;
+        return result;
+    }
+    int noteoff(CSOUND *csound) {
+        int result = OK;
+        if (!on) {
+            return result;
+        }
+        on = false;
+        // If the note has already been turned off, e.g. by vst3panic, do not
+        // turn it off again. Notes that the table of active notes could not
+        // hold are always turned off.
+        auto note_id = note_off_event.noteOff.noteId;
+        if (note_id != -1 && !vst3_plugin->active_notes.remove(note_id)) {
+            return result;
+        }
+        // Offset does not seem to apply to the notoff callback.
+        auto current_time = csoundGetCurrentTimeSamples(csound) / csoundGetSr(csound);
+        note_off_event.sampleOffset = 0;
+#if DEBUGGING
+        log(csound, "vst3note::noteoff: current_time:                %12.5f [%12d]\n", current_time, csound->GetCurrentTimeSamples(csound));
+        log(csound, "                   note_off_event.type:         %d\n", note_off_event.type);
+        log(csound, "                   note_off_event.sampleOffset: %d\n", note_off_event.sampleOffset);
+        log(csound, "                   note_off_event.channel:      %d\n", note_off_event.noteOff.channel);
+        log(csound, "                   note_off_event.pitch:        %d\n", note_off_event.noteOff.pitch);
+        log(csound, "                   note_off_event.tuning:       %f\n", note_off_event.noteOff.tuning);
+        log(csound, "                   note_off_event.velocity:     %f\n", note_off_event.noteOff.velocity);
+        log(csound, "                   note_off_event.noteId:       %d\n", note_off_event.noteOff.noteId);
+#endif
+        if (vst3_plugin->inputEventList.addEvent(note_off_event) != Steinberg::kResultOk) {
+            log(csound, "vst3note: addEvent error for Note Off.\n");
+        }
+        return result;
+
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        return result;
+    };
+};
+
+/**
+ * A list of notes, or a Standard MIDI File, to be played by one plugin
+ * with sample-accurate timing. Notes are read at k-rate as their times come
+ * due, so that no Csound instrument instance is needed for each note.
+ */
+struct vst3_sequence_t {
+    struct note_t {
+        double time;
+        double duration;
+        Steinberg::int16 channel;
+        MYFLT key;
+        MYFLT velocity;
+    };
+    struct note_off_t {
+        int64_t frame;
+        Steinberg::int16 channel;
+        Steinberg::int16 pitch;
+        float tuning;
+        Steinberg::int32 note_id;
+        bool operator > (const note_off_t &other) const {
+            return frame > other.frame;
+        }
+    };
+    vst3_sequence_t() {
+        smf_note_ids.fill(-1);
+    }
+    /**
+     * Reads notes from rows of (time, duration, channel, key, velocity), with
+     * time and duration in seconds, key as a real-valued MIDI key, and
+     * velocity in MIDI units. Notes of 0 duration are skipped.
+     */
+    void add_notes(const MYFLT *fields, size_t note_count) {
+        notes.reserve(notes.size() + note_count);
+        for (size_t note_index = 0; note_index < note_count; ++note_index) {
+            const MYFLT *row = &fields[note_index * 5];
+            if (row[1] <= 0) {
+                continue;
+            }
+            notes.push_back({row[0], row[1], Steinberg::int16(int(row[2]) & 0xF), row[3], row[4]});
+        }
+        std::stable_sort(notes.begin(), notes.end(), [](const note_t &a, const note_t &b) {
+            return a.time < b.time;
+        });
+        note_offs.reserve(notes.size());
+    }
+    bool open_smf(const std::string &filepath) {
+        is_smf = smf.open(filepath);
+        has_smf_event = is_smf && smf.next(smf_event);
+        return is_smf;
+    }
+    /**
+     * Sends all notes that are due before block_end, with their sample
+     * offsets from block_start. Note on and note off events are sent in time
+     * order.
+     */
+    void perform(vst3_plugin_t *plugin, int64_t block_start, int64_t block_end, double sr) {
+        for (;;) {
+            int64_t note_on_frame = INT64_MAX;
+            if (is_smf) {
+                if (has_smf_event) {
+                    note_on_frame = start_frame + static_cast<int64_t>(std::llround(smf_event.time * sr));
+                }
+            } else if (note_index < notes.size()) {
+                note_on_frame = start_frame + static_cast<int64_t>(std::llround(notes[note_index].time * sr));
             }
-            if ((classInfo.category() == kVstAudioEffectClass) && (plugin_name == classInfo.name())) {
-                classInfo_ = classInfo;
+            int64_t note_off_frame = note_offs.empty() ? INT64_MAX : note_offs.front().frame;
+            int64_t frame = std::min(note_on_frame, note_off_frame);
+            if (frame >= block_end) {
+                return;
+            }
+            auto sample_offset = static_cast<Steinberg::int32>(std::max<int64_t>(0, frame - block_start));
+            if (note_off_frame <= note_on_frame) {
+                std::pop_heap(note_offs.begin(), note_offs.end(), std::greater<note_off_t>());
+                const auto &note_off = note_offs.back();
+                plugin->note_off(note_off.channel, note_off.pitch, note_off.tuning, note_off.note_id, sample_offset);
+                note_offs.pop_back();
+            } else if (is_smf) {
+                perform_smf_event(plugin, sample_offset);
+                has_smf_event = smf.next(smf_event);
+            } else {
+                const auto &note = notes[note_index++];
+                auto length = static_cast<Steinberg::int32>(note.duration * sr);
+                auto id = plugin->note_on(note.channel, note.key, note.velocity, length, sample_offset);
+                note_off_t note_off;
+                note_off.frame = frame + std::max<int64_t>(1, length);
+                note_off.channel = note.channel;
+                note_off.pitch = static_cast<Steinberg::int16>(std::round(note.key));
+                note_off.tuning = (note.key - note_off.pitch) * double(100.0);
+                note_off.note_id = id;
+                note_offs.push_back(note_off);
+                std::push_heap(note_offs.begin(), note_offs.end(), std::greater<note_off_t>());
             }
         }
-        auto plugProvider = owned(NEW Steinberg::Vst::PlugProvider(factory, classInfo_, true));
-        if (!plugProvider) {
-            std::string error = "No VST3 Audio Module class found in file ";
-            error += module_pathname;
-            csound->Message(csound, "vst3_host_t::load_module: error: %s\n", error.c_str());
-            return -1;
+    }
+    void perform_smf_event(vst3_plugin_t *plugin, Steinberg::int32 sample_offset) {
+        uint8_t status = smf_event.status & 0xF0;
+        uint8_t channel = smf_event.status & 0x0F;
+        auto &id = smf_note_ids[channel * 128 + smf_event.data1];
+        if (status == 0x90 && smf_event.data2 > 0) {
+            if (id != -1) {
+                plugin->note_off(channel, smf_event.data1, 0, id, sample_offset);
+            }
+            id = plugin->note_on(channel, smf_event.data1, smf_event.data2, 0, sample_offset);
+        } else if (status == 0x80 || status == 0x90) {
+            if (id != -1) {
+                plugin->note_off(channel, smf_event.data1, 0, id, sample_offset);
+                id = -1;
+            }
+        } else {
+            plugin->send_channel_message(status, channel, smf_event.data1, smf_event.data2, sample_offset);
         }
-        auto vst3_plugin = std::make_shared<vst3_plugin_t>();
-        vst3_plugin->initialize(csound, classInfo_, plugProvider);
-        Steinberg::TUID controllerClassTUID;
-        if (vst3_plugin->component->getControllerClassId(controllerClassTUID) != Steinberg::kResultOk) {
-            csound->Message(csound, "vst3_host_t::load_module: This component does not export an edit controller class ID!\n");
+    }
+    /**
+     * Turns off all notes that are still sounding.
+     */
+    void stop(vst3_plugin_t *plugin) {
+        for (const auto &note_off : note_offs) {
+            plugin->note_off(note_off.channel, note_off.pitch, note_off.tuning, note_off.note_id, 0);
         }
-        Steinberg::FUID controllerClassUID;
-        controllerClassUID = Steinberg::FUID::fromTUID(controllerClassTUID);
-        if (controllerClassUID.isValid() == false) {
-            csound->Message(csound, "vst3_host_t::load_module: The edit controller class has no valid UID!\n");
+        note_offs.clear();
+        for (size_t index = 0; index < smf_note_ids.size(); ++index) {
+            if (smf_note_ids[index] != -1) {
+                plugin->note_off(Steinberg::int16(index / 128), Steinberg::int16(index % 128), 0, smf_note_ids[index], 0);
+                smf_note_ids[index] = -1;
+            }
         }
-        char cidString[50];
-        controllerClassUID.toString(cidString);
-        handle = vst3_plugins_for_handles.size();
-        vst3_plugins_for_handles.push_back(vst3_plugin);
-        MYFLT result = std::floor(static_cast<MYFLT>(handle));
-        return result;
-    }
-    vst3_plugin_t *plugin_for_handle(MYFLT *handle) {
-        auto handle_value = *handle;
-        auto index = static_cast<size_t>(handle_value);
-        return vst3_plugins_for_handles[index].get();
     }
-    std::map<std::string, VST3::Hosting::Module::Ptr> modules_for_pathnames;
-    // Handles for vst3_plugin_t instances are indexes into a list of
-    // plugins. It's not possible to simply store the address of a
-    // vst3_plugin_t instance in a Csound opcode parameter, because the
-    // address might be 64 bits and the MYFLT parameter might be only 32
-    // bits.
-    std::vector<std::shared_ptr<vst3_plugin_t>> vst3_plugins_for_handles;
+    int64_t start_frame = 0;
+    std::vector<note_t> notes;
+    size_t note_index = 0;
+    // A min-heap on frame, preallocated to the number of notes.
+    std::vector<note_off_t> note_offs;
+    bool is_smf = false;
+    smf_reader_t smf;
+    smf_event_t smf_event;
+    bool has_smf_event = false;
+    std::array<Steinberg::int32, 16 * 128> smf_note_ids;
 };
 
-static inline vst3_host_t *vst3_host_for_csound(CSOUND *csound) {
-    int handle = 0;
-    auto host = vst3hosts::instance().object_for_handle(csound, handle);
-    // std::fprintf(stderr, "vst3_host_t::host_for_csound: csound: %p handle: %d host: %p...\n", csound, handle, host);
-    if (host == nullptr) {
-        host = new vst3_host_t;
-        handle = vst3hosts::instance().handle_for_object(csound, host);
-    }
-    host = vst3hosts::instance().object_for_handle(csound, handle);
-    // std::fprintf(stderr, "vst3_host_t::host_for_csound: csound: %p handle: %d host: %p\n", csound, handle, host);
-    return host;
-}
-
-static inline vst3_plugin_t *get_plugin(CSOUND *csound, size_t handle) {
-    auto host = vst3_host_for_csound(csound);
-    auto plugin = host->vst3_plugins_for_handles[handle];
-    return plugin.get();
-}
-
-struct VST3AUDIO :
-    public csound::OpcodeBase<VST3AUDIO> {
-    // Outputs.
-    MYFLT *a_output_channels[32];
+/**
+ * Plays a whole sequence of notes on a plugin from a two-dimensional array
+ * or a function table of (time, duration, channel, key, velocity) rows, or
+ * from a Standard MIDI File, starting at the time of this opcode's
+ * instrument. Times in the sequence are in seconds, and all notes are
+ * scheduled with sample-accurate offsets. When the instrument is turned off,
+ * any notes still sounding are turned off.
+ */
+struct VST3SEQUENCE : public csound::OpcodeNoteoffBase<VST3SEQUENCE> {
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *a_input_channels[32];
+    MYFLT *i_notes;
     // State.
+    enum source_t {
+        kFunctionTable,
+        kArray,
+        kMidiFile
+    };
+    source_t source;
     vst3_plugin_t *vst3_plugin;
-    MYFLT zerodbfs;
-    Steinberg::int32 opcode_input_channel_count;
-    Steinberg::int32 plugin_input_channel_count;
-    Steinberg::int32 opcode_output_channel_count;
-    Steinberg::int32 plugin_output_channel_count;
-    Steinberg::Vst::Sample32 **plugin_input_channels_32;
-    Steinberg::Vst::Sample64 **plugin_input_channels_64;
-    Steinberg::Vst::Sample32 **plugin_output_channels_32;
-    Steinberg::Vst::Sample64 **plugin_output_channels_64;
-    Steinberg::Vst::SymbolicSampleSizes plugin_sample_size;
-    Steinberg::int32 frame_count;
+    vst3_sequence_t *sequence;
+    double sr;
+    static int init_table_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3SEQUENCE *>(opcode)->source = kFunctionTable;
+        return csound::OpcodeNoteoffBase<VST3SEQUENCE>::init_(csound, opcode);
+    }
+    static int init_array_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3SEQUENCE *>(opcode)->source = kArray;
+        return csound::OpcodeNoteoffBase<VST3SEQUENCE>::init_(csound, opcode);
+    }
+    static int init_smf_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3SEQUENCE *>(opcode)->source = kMidiFile;
+        return csound::OpcodeNoteoffBase<VST3SEQUENCE>::init_(csound, opcode);
+    }
     int init(CSOUND *csound) {
-        int result = OK;
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        auto sr = csoundGetSr(csound);
-        vst3_plugin->setSamplerate(sr);
-        frame_count = ksmps();
-        vst3_plugin->create_audio_buffers(frame_count);
-        vst3_plugin->update_process_setup();
-        log(csound, "Final plugin configuration:\n");
-        // Because Csound and the plugin may not use the same sample word
-        // size, allowance must be made for different buffer shapes and
-        // sample word sizes, and the audio streams must be copied in and
-        // out sample for sample. Csound will try to match its input and
-        // output channels with the hosted plugin, and the maximum matching
-        // set will be used. Whether the HostProcessData busses are "Main"
-        // is not considered. The Csound instrument hosting this opcode
-        // may ignore or duplicate channels depending on documentation or
-        // experience.
-
-        // Allow for the first arg being the handle.
-        opcode_input_channel_count = input_arg_count() - 1;
-        auto &process_data = vst3_plugin->hostProcessData;
-        if (process_data.numInputs > 0) {
-            // [bus][channel]
-            plugin_input_channel_count = process_data.inputs[0].numChannels;
-            plugin_input_channels_32 = process_data.inputs[0].channelBuffers32;
-            plugin_input_channels_64 = process_data.inputs[0].channelBuffers64;
-            log(csound, "vst3audio::init: opcode_input_channel_count:  %3d\n", opcode_input_channel_count);
-            log(csound, "vst3audio::init: plugin_input_channel_count:  %3d plugin_input_channels_32:  %p plugin_input_channels_64:  %p\n", plugin_input_channel_count, plugin_input_channels_32, plugin_input_channels_64);
-        } else {
-            log(csound, "vst3audio::init: no plugin input channels.\n");
-            plugin_input_channel_count = 0;
+        sr = csoundGetSr(csound);
+        if (sequence != nullptr) {
+            delete sequence;
         }
-        opcode_output_channel_count = output_arg_count();
-        if (process_data.numOutputs > 0) {
-            plugin_output_channel_count = process_data.outputs[0].numChannels;
-            plugin_output_channels_32 = process_data.outputs[0].channelBuffers32;
-            plugin_output_channels_64 = process_data.outputs[0].channelBuffers64;
-            log(csound, "vst3audio::init: plugin_output_channel_count: %3d plugin_output_channels_32: %p plugin_output_channels_64: %p\n", plugin_output_channel_count, plugin_output_channels_32, plugin_output_channels_64);
-            log(csound, "vst3audio::init: opcode_output_channel_count: %3d\n", opcode_output_channel_count);
+        sequence = new vst3_sequence_t;
+        sequence->start_frame = static_cast<int64_t>(std::llround(opds.insdshead->p2.value * sr));
+        if (source == kFunctionTable) {
+            FUNC *ftable = csound->FTFind(csound, i_notes);
+            if (ftable == nullptr) {
+                log(csound, "vst3sequence::init: function table %d not found.\n", int(*i_notes));
+                return NOTOK;
+            }
+            sequence->add_notes(ftable->ftable, ftable->flen / 5);
+            log(csound, "vst3sequence::init: %d notes from function table %d.\n", int(sequence->notes.size()), int(*i_notes));
+        } else if (source == kArray) {
+            auto array = reinterpret_cast<ARRAYDAT *>(i_notes);
+            size_t field_count = 1;
+            for (int dimension = 0; dimension < array->dimensions; ++dimension) {
+                field_count *= array->sizes[dimension];
+            }
+            sequence->add_notes(array->data, field_count / 5);
+            log(csound, "vst3sequence::init: %d notes from array.\n", int(sequence->notes.size()));
         } else {
-            log(csound, "vst3audio::init: no plugin output channels.\n");
-            plugin_output_channel_count = 0;
+            vst3_plugin->initialize_midi_cc_mapping();
+            std::string filepath = reinterpret_cast<STRINGDAT *>(i_notes)->data;
+            if (!sequence->open_smf(filepath)) {
+                log(csound, "vst3sequence::init: could not read MIDI file: %s\n", filepath.c_str());
+                return NOTOK;
+            }
+            log(csound, "vst3sequence::init: playing MIDI file: %s\n", filepath.c_str());
         }
-        vst3_plugin->information(true);
+        return OK;
+    }
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        if (sequence == nullptr) {
+            return result;
+        }
+        int64_t block_start = csound->GetCurrentTimeSamples(csound);
+        // Csound's block, not the plugin's, which may be oversampled or
+        // bridged.
+        sequence->perform(vst3_plugin, block_start, block_start + ksmps(), sr);
         return result;
     };
-    int audio(CSOUND *csound) {
+    int noteoff(CSOUND *csound) {
         int result = OK;
-        int64_t current_time_in_frames = csound->GetCurrentTimeSamples(csound);
-        if (current_time_in_frames < 0) {
-            log(csound, "vst3audio::audio: warning! current_time_in_frames is less than 0: %d\n", current_time_in_frames);
-            return NOTOK;
+        if (sequence != nullptr) {
+            sequence->stop(vst3_plugin);
+            delete sequence;
+            sequence = nullptr;
         }
-        if (frame_count != vst3_plugin->hostProcessData.numSamples) {
-            log(csound, "vst3audio::audio: warning! ksmps (%d) != numSamples: %d\n", ksmps(), vst3_plugin->hostProcessData.numSamples);
-            /// return NOTOK;
+        return result;
+    };
+};
+
+/**
+ * Turns off every note sounding on the plugin, and sends "all sounds off"
+ * and "all notes off" on every channel where the plugin maps these
+ * controllers. With no trigger, this happens at i-time; with a trigger, in
+ * every kperiod where the trigger changes from 0 to non-0.
+ */
+struct VST3PANIC : public csound::OpcodeBase<VST3PANIC> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *k_trigger;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    MYFLT prior_trigger;
+    int init(CSOUND *csound) {
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        vst3_plugin->initialize_midi_cc_mapping();
+        prior_trigger = 0;
+        if (input_arg_count() < 2) {
+            panic(csound, 0);
         }
-#if EVENT_TRACING
-        auto &data = vst3_plugin->hostProcessData;
-        if (data.inputEvents) {
-            const Steinberg::int32 numEvents = data.inputEvents->getEventCount();
-            for (Steinberg::int32 i = 0; i < numEvents; ++i) {
-                Steinberg::Vst::Event event;
-                if (data.inputEvents->getEvent(i, event) == Steinberg::kResultOk) {
-                    switch (event.type) {
-                case Steinberg::Vst::Event::kNoteOnEvent:
-                            std::printf("Note On:  Channel %d, Pitch %d, Velocity %.2f\n",
-                                        event.noteOn.channel,
-                                        event.noteOn.pitch,
-                                        event.noteOn.velocity);
-                        break;
-                case Steinberg::Vst::Event::kNoteOffEvent:
-                            std::printf("Note Off: Channel %d, Pitch %d, Velocity %.2f\n",
-                                        event.noteOff.channel,
-                                        event.noteOff.pitch,
-                                        event.noteOff.velocity);
-                        break;
-                case Steinberg::Vst::Event::kPolyPressureEvent:
-                            std::printf("Poly Pressure: Channel %d, Pitch %d, Pressure %.2f\n",
-                                        event.polyPressure.channel,
-                                        event.polyPressure.pitch,
-                                        std::printf("Other MIDI event type: %d\n", event.type);
-                                        event.polyPressure.pressure);
-                        break;
-                case Steinberg::Vst::Event::kDataEvent:
-                            std::printf("Data: byte 0 %d, byte 1 %d, byte 2 %.2f\n",
-                                        event.data.bytes[0],
-                                        event.data.bytes[1],
-                                        event.data.bytes[2]);
-                        break;
-                default:
-                        break;
-                    }
-                }
+        return OK;
+    };
+    int kontrol(CSOUND *csound) {
+        if (input_arg_count() >= 2) {
+            if (*k_trigger != 0 && prior_trigger == 0) {
+                panic(csound, static_cast<Steinberg::int32>(kperiodOffset()));
             }
+            prior_trigger = *k_trigger;
+        }
+        return OK;
+    };
+    void panic(CSOUND *csound, Steinberg::int32 sample_offset) {
+        auto count = vst3_plugin->release_all_notes(sample_offset);
+        for (uint8_t channel = 0; channel < kMaxMidiChannels; ++channel) {
+            vst3_plugin->send_channel_message(0xB0, channel, Steinberg::Vst::kCtrlAllSoundsOff, 0, sample_offset);
+            vst3_plugin->send_channel_message(0xB0, channel, Steinberg::Vst::kCtrlAllNotesOff, 0, sample_offset);
+        }
+        log(csound, "vst3panic: turned off %d notes.\n", count);
+    }
+};
+
+/**
+ * Returns the number of notes sounding on the plugin.
+ */
+struct VST3ACTIVENOTES : public csound::OpcodeBase<VST3ACTIVENOTES> {
+    // Outputs.
+    MYFLT *k_count;
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    int init(CSOUND *csound) {
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        *k_count = vst3_plugin->active_notes.size();
+        return OK;
+    };
+    int kontrol(CSOUND *csound) {
+        *k_count = vst3_plugin->active_notes.size();
+        return OK;
+    };
+};
+
+struct VST3PARAMGET : public csound::OpcodeBase<VST3PARAMGET> {
+    // Outputs.
+    MYFLT *k_parameter_value;
+    // Intputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *k_parameter_id;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    Steinberg::int32 parameter_id;
+    MYFLT old_parameter_value;
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        log(csound, "vst3paramget::kontrol: id: %4d  value: %9.4f\n", parameter_id, *k_parameter_value);
+        return result;
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        parameter_id = int(*k_parameter_id);
+        *k_parameter_value = vst3_plugin->controller->getParamNormalized(parameter_id);
+#if PARAMETER_TRACING
+        if (*k_parameter_value != old_parameter_value) {
+            log(csound, "vst3paramget::kontrol: id: %4d  value: %9.4f\n", parameter_id, *k_parameter_value);
+            old_parameter_value = *k_parameter_value;
         }
 #endif
-        // We must read or write every sample in the host buffers, but we
-        // must not access nonexistent samples in the opcode buffers. This
-        // assumes that the number of opcode channels is never greater than
-        // the number of plugin channels or that, if it is, no harm comes.
-        if (plugin_sample_size == Steinberg::Vst::kSample32) {
-            for (Steinberg::int32 channel_index_in = 0; channel_index_in < plugin_input_channel_count; ++channel_index_in) {
-                if (channel_index_in < opcode_input_channel_count) {
-                    for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
-                        plugin_input_channels_32[channel_index_in][frame_index] = a_input_channels[channel_index_in][frame_index];
-#if PROCESS_TRACING
-                        log(csound, "vst3audio::audio in for 32 bits: sample[%4d][%4d]: opcode: %f plugin: %f\n",
-                            channel_index_in, frame_index, a_input_channels[channel_index_in][frame_index], plugin_input_channels_32[channel_index_in][frame_index]);
-#endif
-                    }
-                }
-            }
-            vst3_plugin->process(current_time_in_frames);
-            for (Steinberg::int32 channel_index = 0; channel_index < plugin_output_channel_count; ++channel_index) {
-                for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
-                    /// a_output_channels[channel_index][frame_index] = static_cast<double>(plugin_output_channels_32[channel_index][frame_index]);
-                    if (channel_index < opcode_output_channel_count) {
-                        a_output_channels[channel_index][frame_index] = plugin_output_channels_32[channel_index][frame_index];
-#if PROCESS_TRACING
-                        log(csound, "vst3audio::audio out for 32 bits: sample[%4d][%4d]: opcode: %f plugin: %f\n",
-                            channel_index, frame_index, a_output_channels[channel_index][frame_index], plugin_output_channels_32[channel_index][frame_index]);
-#endif
-                    }
-                }
-            }
-        } else {
-            for (Steinberg::int32 channel_index_in = 0; channel_index_in < plugin_input_channel_count; ++channel_index_in) {
-                for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
-                    plugin_input_channels_64[channel_index_in][frame_index] = a_input_channels[channel_index_in][frame_index];
-                }
-            }
-            vst3_plugin->process(current_time_in_frames);
-            for (Steinberg::int32 channel_index = 0; channel_index < plugin_output_channel_count; ++channel_index) {
-                for (Steinberg::int32 frame_index = 0; frame_index < frame_count; ++frame_index) {
-                    a_output_channels[channel_index][frame_index] = plugin_output_channels_64[channel_index][frame_index];
-#if PROCESS_TRACING
-                    log(csound, "vst3audio::audio out for 64 bits: sample[%4d][%4d]: opcode: %f plugin: %f\n",
-                        channel_index, frame_index, a_output_channels[channel_index][frame_index], plugin_output_channels_64[channel_index][frame_index]);
+        return result;
+    };
+};
+
+struct VST3PARAMSET : public csound::OpcodeBase<VST3PARAMSET> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *k_parameter_id;
+    MYFLT *k_parameter_value;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    Steinberg::int32 parameter_id;
+    Steinberg::int32 prior_parameter_id;
+    double parameter_value;
+    double prior_parameter_value;
+    int64_t frames_per_kperiod;
+    int init(CSOUND *csound) {
+        int result = OK;
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        frames_per_kperiod = csoundGetKsmps(csound);
+        prior_parameter_id = -1;
+        prior_parameter_value = -1;
+        return result;
+    };
+    int kontrol(CSOUND *csound) {
+        int result = OK;
+        parameter_id = static_cast<Steinberg::int32>(*k_parameter_id);
+        parameter_value = static_cast<double>(*k_parameter_value);
+        // Find the frame at the beginning of the kperiod, and compute the
+        // delta frames for "now."
+        if (parameter_id != prior_parameter_id || parameter_value != prior_parameter_value) {
+            int64_t block_start_frames = opds.insdshead->kcounter * frames_per_kperiod;
+            int64_t current_time_frames = csound->GetCurrentTimeSamples(csound);
+            Steinberg::int32 delta_frames = static_cast<Steinberg::int32>(current_time_frames - block_start_frames);
+            vst3_plugin->setParameter(parameter_id, parameter_value, delta_frames);
+#if PARAMETER_TRACING
+            log(csound, "vst3paramset::kontrol: id: %4d  value: %9.4f  delta_frames: %4d\n", parameter_id, parameter_value, delta_frames);
 #endif
-                }
-            }
+            prior_parameter_id = parameter_id;
+            prior_parameter_value = parameter_value;
         }
         return result;
     };
 };
 
-struct VST3INFO : public csound::OpcodeBase<VST3INFO> {
+/**
+ * Loads a preset. Preset files are cached in memory. If iasync is non-zero,
+ * the preset is loaded in the background; until it is ready, the plugin
+ * is silent or, if ikeep_old_state is non-zero, goes on playing its old
+ * state.
+ */
+struct VST3PRESETLOAD : public csound::OpcodeBase<VST3PRESETLOAD> {
     // Inputs.
     MYFLT *i_vst3_handle;
+    MYFLT *i_preset_filepath;
+    MYFLT *i_async;
+    MYFLT *i_keep_old_state;
     // State.
     vst3_plugin_t *vst3_plugin;
     int init(CSOUND *csound) {
-        int result = OK;
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        log(csound, "vst3info::init: Current plugin configuration...\n");
-        vst3_plugin->information(true);
-        return result;
+        std::string preset_filepath = ((STRINGDAT *)i_preset_filepath)->data;
+        if (*i_async != 0) {
+            vst3_plugin->load_preset_async(preset_filepath, *i_keep_old_state != 0);
+        } else {
+            vst3_plugin->load_preset(preset_filepath);
+        }
+        return OK;
     };
 };
 
-struct VST3INIT : public csound::OpcodeBase<VST3INIT> {
+/**
+ * Opens a preset bank, and returns a handle to it.
+ */
+struct VST3BANKLOAD : public csound::OpcodeBase<VST3BANKLOAD> {
     // Outputs.
-    MYFLT *i_vst3_handle;
+    MYFLT *i_bank_handle;
     // Inputs.
-    MYFLT *i_module_pathname;
-    MYFLT *i_plugin_name;
-    MYFLT *i_verbose;
+    MYFLT *i_bank_filepath;
+    int init(CSOUND *csound) {
+        auto host = vst3_host_for_csound(csound);
+        std::string bank_filepath = ((STRINGDAT *)i_bank_filepath)->data;
+        auto bank = std::make_unique<preset_bank_t>();
+        if (!bank->open(bank_filepath)) {
+            log(csound, "vst3bankload::init: could not open preset bank: \"%s\"\n", bank_filepath.c_str());
+            return NOTOK;
+        }
+        log(csound, "vst3bankload::init: opened preset bank: \"%s\" with %d presets.\n", bank_filepath.c_str(), static_cast<int>(bank->size()));
+        *i_bank_handle = static_cast<MYFLT>(host->preset_banks.size());
+        host->preset_banks.push_back(std::move(bank));
+        return OK;
+    };
+};
+
+/**
+ * Loads a preset from a preset bank into a plugin, by index or by name.
+ * Optionally, as with vst3presetload, in the background.
+ */
+struct VST3BANKRECALL : public csound::OpcodeBase<VST3BANKRECALL> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_bank_handle;
+    MYFLT *i_preset;
+    MYFLT *i_async;
+    MYFLT *i_keep_old_state;
+    // State.
+    bool by_name;
+    static int init_index_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3BANKRECALL *>(opcode)->by_name = false;
+        return init_(csound, opcode);
+    }
+    static int init_name_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3BANKRECALL *>(opcode)->by_name = true;
+        return init_(csound, opcode);
+    }
     int init(CSOUND *csound) {
-        int result = OK;
-        log(csound, "\nvst3init::init...\n");
         auto host = vst3_host_for_csound(csound);
-        log(csound, "vst3init::init: host: %p\n", host);
-        std::string module_pathname  =((STRINGDAT *)i_module_pathname)->data;
-        std::string plugin_name = ((STRINGDAT *)i_plugin_name)->data;
-        log(csound, "vst3init::init: loading module: \"%s\",  \"%s\"...\n", module_pathname.c_str(), plugin_name.c_str());
-        *i_vst3_handle = host->load_module(csound, module_pathname, plugin_name,(bool)*i_verbose);
-        log(csound, "vst3init::init: loaded module: \"%s\",  \"%s\" i_vst3_handle: %ld...\n", module_pathname.c_str(), plugin_name.c_str(), (size_t)*i_vst3_handle);
         auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        log(csound, "vst3init::init: created plugin: \"%s\": address: %p handle: %ld\n", plugin_name.c_str(), vst3_plugin,(size_t) *i_vst3_handle);
-        return result;
+        auto bank_handle = static_cast<size_t>(*i_bank_handle);
+        if (bank_handle >= host->preset_banks.size()) {
+            log(csound, "vst3bankrecall::init: invalid bank handle: %d\n", static_cast<int>(bank_handle));
+            return NOTOK;
+        }
+        auto &bank = *host->preset_banks[bank_handle];
+        const preset_bank_t::preset_t *preset;
+        if (by_name) {
+            preset = bank.find(std::string(((STRINGDAT *)i_preset)->data));
+        } else {
+            preset = bank.find(static_cast<size_t>(*i_preset));
+        }
+        if (preset == nullptr) {
+            if (by_name) {
+                log(csound, "vst3bankrecall::init: no preset named \"%s\" in bank.\n", ((STRINGDAT *)i_preset)->data);
+            } else {
+                log(csound, "vst3bankrecall::init: no preset %d in bank.\n", static_cast<int>(*i_preset));
+            }
+            return NOTOK;
+        }
+        log(csound, "vst3bankrecall::init: recalling preset: \"%s\"\n", preset->name.c_str());
+        vst3_plugin->load_preset_data(preset->data, preset->size, *i_async != 0, *i_keep_old_state != 0);
+        return OK;
     };
 };
 
-struct VST3INITPRESET : public csound::OpcodeBase<VST3INITPRESET> {
+/**
+ * Builds a preset bank from all of the .vstpreset files in a directory,
+ * and returns the number of presets in it, or -1 on failure.
+ */
+struct VST3BANKBUILD : public csound::OpcodeBase<VST3BANKBUILD> {
     // Outputs.
-    MYFLT *i_vst3_handle;
+    MYFLT *i_count;
     // Inputs.
-    MYFLT *i_module_pathname;
-    MYFLT *i_plugin_name;
+    MYFLT *i_directory;
+    MYFLT *i_bank_filepath;
+    int init(CSOUND *csound) {
+        std::string directory = ((STRINGDAT *)i_directory)->data;
+        std::string bank_filepath = ((STRINGDAT *)i_bank_filepath)->data;
+        std::string error;
+        auto count = preset_bank_t::build(directory, bank_filepath, error);
+        *i_count = count;
+        if (count < 0) {
+            log(csound, "vst3bankbuild::init: %s\n", error.c_str());
+            return NOTOK;
+        }
+        log(csound, "vst3bankbuild::init: wrote %d presets from \"%s\" to \"%s\".\n", count, directory.c_str(), bank_filepath.c_str());
+        return OK;
+    };
+};
+
+/**
+ * Saves the plugin's state as a preset file. The state is captured at
+ * i-time, and the file is written in the background, to a temporary file
+ * that is then renamed, so a crash never leaves a truncated preset.
+ */
+struct VST3PRESETSAVE : public csound::OpcodeBase<VST3PRESETSAVE> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
     MYFLT *i_preset_filepath;
-    MYFLT *i_verbose;
+    // State.
+    vst3_plugin_t *vst3_plugin;
     int init(CSOUND *csound) {
-        int result = OK;
-        log(csound, "\nvst3init::init...\n");
-        auto host = vst3_host_for_csound(csound);
-        log(csound, "vst3init::init: host: %p\n", host);
-        std::string module_pathname  =((STRINGDAT *)i_module_pathname)->data;
-        std::string plugin_name = ((STRINGDAT *)i_plugin_name)->data;
-        log(csound, "vst3init::init: loading module: \"%s\",  \"%s\"...\n", module_pathname.c_str(), plugin_name.c_str());
-        *i_vst3_handle = host->load_module(csound, module_pathname, plugin_name,(bool)*i_verbose);
-        log(csound, "vst3init::init: loaded module: \"%s\",  \"%s\" i_vst3_handle: %ld...\n", module_pathname.c_str(), plugin_name.c_str(), (size_t)*i_vst3_handle);
-        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        log(csound, "vst3init::init: created plugin: \"%s\": address: %p handle: %ld\n", plugin_name.c_str(), vst3_plugin,(size_t) *i_vst3_handle);
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        if (!vst3_plugin || !vst3_plugin->component) {
+            log(csound, "vst3presetsave::init: invalid plugin handle or null component.\n");
+            return NOTOK;
+        }
         std::string preset_filepath = ((STRINGDAT *)i_preset_filepath)->data;
-        if (preset_filepath.length() > 0) {
-            result = vst3_plugin->load_preset(preset_filepath);
+        log(csound, "vst3presetsave: preset_filepath: %s\n", preset_filepath.c_str());
+        if (vst3_plugin->save_preset_async(preset_filepath) == 0) {
+            log(csound, "vst3presetsave::init: failed to serialize state.\n");
+            return NOTOK;
         }
-        return result;
+        return OK;
+    };
+};
+
+/**
+ * As vst3presetsave, but saves whenever the trigger changes from 0 to
+ * non-0, e.g. to autosave during a performance. The state is captured and
+ * written on the worker thread, so triggering neither allocates nor
+ * blocks. Returns 0 until the first save and while a save is pending, 1
+ * when the last save has succeeded, and -1 if it has failed or could not
+ * be queued, e.g. because the previous save is still running.
+ */
+struct VST3PRESETSAVETRIGGER : public csound::OpcodeBase<VST3PRESETSAVETRIGGER> {
+    // Outputs.
+    MYFLT *k_status;
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_preset_filepath;
+    MYFLT *k_trigger;
+    // State.
+    vst3_plugin_t *vst3_plugin;
+    preset_save_request_t *request;
+    bool triggered;
+    uint64_t serial;
+    MYFLT prior_trigger;
+    int init(CSOUND *csound) {
+        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        triggered = false;
+        serial = 0;
+        prior_trigger = 0;
+        *k_status = 0;
+        if (!vst3_plugin || !vst3_plugin->component) {
+            log(csound, "vst3presetsave::init: invalid plugin handle or null component.\n");
+            return NOTOK;
+        }
+        request = vst3_plugin->add_preset_save_request(((STRINGDAT *)i_preset_filepath)->data);
+        return OK;
+    };
+    int kontrol(CSOUND *csound) {
+        if (*k_trigger != 0 && prior_trigger == 0) {
+            triggered = true;
+            serial = vst3_plugin->request_preset_save(request);
+            if (serial == 0) {
+                log(csound, "vst3presetsave::kontrol: the save could not be queued.\n");
+            }
+        }
+        prior_trigger = *k_trigger;
+        if (triggered) {
+            *k_status = vst3_plugin->save_status(serial);
+        }
+        return OK;
     };
 };
 
+/**
+ * Captures the plugin's state into a numbered slot in memory.
+ */
+struct VST3SNAPSHOT : public csound::OpcodeBase<VST3SNAPSHOT> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_slot;
+    int init(CSOUND *csound) {
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        if (*i_slot < 0) {
+            log(csound, "vst3snapshot::init: invalid slot: %d\n", static_cast<int>(*i_slot));
+            return NOTOK;
+        }
+        if (!vst3_plugin->capture_snapshot(static_cast<size_t>(*i_slot))) {
+            return NOTOK;
+        }
+        return OK;
+    };
+};
 
-#if EDITOR_IMPLEMENTED
+/**
+ * Restores the plugin's state from a slot captured by vst3snapshot, in the
+ * background as with vst3presetload; or, if idelta is non-zero, by changing
+ * only the parameters that differ.
+ */
+struct VST3RECALL : public csound::OpcodeBase<VST3RECALL> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_slot;
+    MYFLT *i_delta;
+    MYFLT *i_keep_old_state;
+    int init(CSOUND *csound) {
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        if (*i_slot < 0) {
+            log(csound, "vst3recall::init: invalid slot: %d\n", static_cast<int>(*i_slot));
+            return NOTOK;
+        }
+        if (!vst3_plugin->recall_snapshot(static_cast<size_t>(*i_slot), *i_delta != 0, *i_keep_old_state != 0)) {
+            return NOTOK;
+        }
+        return OK;
+    };
+};
 
-struct VST3EDIT : public csound::OpcodeBase<VST3EDIT> {
+/**
+ * Morphs the plugin's parameters between the states in two slots captured by
+ * vst3snapshot, as the position goes from 0 to 1. Only parameters that
+ * change by more than iepsilon (default 0.00001) are sent. With an a-rate
+ * position, the parameters are sent at several points in each kperiod,
+ * and the plugin interpolates between them.
+ */
+struct VST3MORPH : public csound::OpcodeNoteoffBase<VST3MORPH> {
     // Inputs.
     MYFLT *i_vst3_handle;
+    MYFLT *i_slot_from;
+    MYFLT *i_slot_to;
+    MYFLT *x_position;
+    MYFLT *i_epsilon;
     // State.
+    static constexpr int kPointsPerBlock = 4;
+    bool audio_rate;
     vst3_plugin_t *vst3_plugin;
-    /**
-     * Set up a display, a window, and an associated event loop
-     * for showing the plugin editor. These will run until the user
-     * closes the editor window,
-     */
+    parameter_morph_t *morph;
+    double epsilon;
+    static int init_k_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3MORPH *>(opcode)->audio_rate = false;
+        return csound::OpcodeNoteoffBase<VST3MORPH>::init_(csound, opcode);
+    }
+    static int init_a_(CSOUND *csound, void *opcode) {
+        reinterpret_cast<VST3MORPH *>(opcode)->audio_rate = true;
+        return csound::OpcodeNoteoffBase<VST3MORPH>::init_(csound, opcode);
+    }
     int init(CSOUND *csound) {
-        int result = OK;
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-#if defined(LINUX)
-#ifdef EDITORHOST_GTK
-        app = Gtk::Application::create ("net.steinberg.vstsdk.editorhost");
-        application->init (cmdArgs);
-        eventLoop ();
+        auto &snapshots = vst3_plugin->snapshots;
+        auto slot_from = static_cast<size_t>(*i_slot_from);
+        auto slot_to = static_cast<size_t>(*i_slot_to);
+        if (*i_slot_from < 0 || *i_slot_to < 0 ||
+            slot_from >= snapshots.size() || !snapshots[slot_from] ||
+            slot_to >= snapshots.size() || !snapshots[slot_to]) {
+            log(csound, "vst3morph::init: both slots must hold snapshots.\n");
+            return NOTOK;
+        }
+        auto &ids = snapshots[slot_from]->parameter_ids;
+        if (ids != snapshots[slot_to]->parameter_ids) {
+            log(csound, "vst3morph::init: the snapshots have different parameters.\n");
+            return NOTOK;
+        }
+        epsilon = *i_epsilon > 0 ? *i_epsilon : 0.00001;
+        auto points = audio_rate ? kPointsPerBlock : 1;
+        vst3_plugin->reserve_parameter_changes(ids.size() * points);
+        if (morph == nullptr) {
+            morph = new parameter_morph_t;
+        }
+        // If the plugin's list has changed since, treat every parameter as
+        // continuous.
+        morph->initialize(ids,
+                          snapshots[slot_from]->parameter_values,
+                          snapshots[slot_to]->parameter_values,
+                          ids == vst3_plugin->parameter_ids ? vst3_plugin->parameter_step_counts : std::vector<Steinberg::int32>(ids.size(), 0));
+        return OK;
+    };
+    int kontrol(CSOUND *csound) {
+        if (!audio_rate) {
+            send(*x_position, static_cast<Steinberg::int32>(kperiodOffset()));
+            return OK;
+        }
+        auto frames = static_cast<int>(ksmps());
+        // No more points than frames, so that no offset is negative.
+        auto points = std::min(kPointsPerBlock, frames);
+        for (int point = 1; point <= points; ++point) {
+            auto offset = std::max((point * frames) / points - 1, 0);
+            send(x_position[offset], offset);
+        }
+        return OK;
+    };
+    int noteoff(CSOUND *csound) {
+        delete morph;
+        morph = nullptr;
+        return OK;
+    };
+    void send(double position, Steinberg::int32 sample_offset) {
+        morph->interpolate(position);
+        const auto &ids = morph->ids;
+        auto &values = morph->values;
+        auto &sent = morph->sent;
+        for (size_t index = 0; index < values.size(); ++index) {
+            if (std::fabs(values[index] - sent[index]) > epsilon) {
+                sent[index] = values[index];
+                vst3_plugin->add_parameter_change(ids[index], values[index], sample_offset);
+            }
+        }
+    }
+};
 
-#else
-        // Connect to X server
-        std::string displayName (getenv ("DISPLAY"));
-        if (displayName.empty ())
-            displayName = ":0.0";
-        auto display = XOpenDisplay (displayName.data ());
-        RunLoop::instance ().setDisplay (display);
-        application->init (cmdArgs);
-        eventLoop ();
-        XCloseDisplay (display);
-#endif
-#endif
-        vst3_plugin->showPluginEditorWindow();
-        return result;
+/**
+ * Enables (the default) or disables skipping the plugin's processing while
+ * it is idle.
+ */
+struct VST3AUTOSUSPEND : public csound::OpcodeBase<VST3AUTOSUSPEND> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_enable;
+    int init(CSOUND *csound) {
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        vst3_plugin->auto_suspend = *i_enable != 0;
+        return OK;
+    };
+};
+
+/**
+ * Runs the plugin at 1 (the default), 2, 4, or 8 times Csound's rate, with
+ * half-band filters around it, to reduce aliasing. Only this plugin pays for
+ * the higher rate. Event and parameter offsets are scaled, and the filters'
+ * delay is included in the plugin's latency. This is for vst3audio and
+ * vst3audiobus, not vst3chain or vst3layers.
+ */
+struct VST3OVERSAMPLE : public csound::OpcodeBase<VST3OVERSAMPLE> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_factor;
+    int init(CSOUND *csound) {
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        int factor = static_cast<int>(*i_factor);
+        if (factor != 1 && factor != 2 && factor != 4 && factor != 8) {
+            log(csound, "vst3oversample::init: the factor must be 1, 2, 4, or 8.\n");
+            return NOTOK;
+        }
+        if (factor == vst3_plugin->oversampling) {
+            return OK;
+        }
+        if (factor > 1 && vst3_plugin->bridge.plugin_sample_rate > 0) {
+            log(csound, "vst3oversample::init: the plugin already runs at its own rate.\n");
+            return NOTOK;
+        }
+        // The worker thread may be reconfiguring the plugin.
+        std::lock_guard<std::mutex> state_lock(vst3_plugin->state_mutex);
+        vst3_plugin->oversampling = factor;
+        // If vst3audio has already set the plugin up, do it again.
+        if (vst3_plugin->blockSize > 0) {
+            vst3_plugin->prepare(csoundGetSr(csound), ksmps());
+            vst3_host_for_csound(csound)->update_max_latency();
+        }
+        log(csound, "vst3oversample::init: oversampling: %d\n", factor);
+        return OK;
+    };
+};
+
+/**
+ * Sets how the plugin's audio buffers are allocated: ilock locks them in
+ * memory, iprefault maps every page at once, and ihugepages takes them from
+ * huge pages if the system has any. All default to off. The buffers of one
+ * plugin are always contiguous.
+ */
+struct VST3MEMORY : public csound::OpcodeBase<VST3MEMORY> {
+    // Inputs.
+    MYFLT *i_vst3_handle;
+    MYFLT *i_lock;
+    MYFLT *i_prefault;
+    MYFLT *i_huge_pages;
+    int init(CSOUND *csound) {
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        auto &arena = vst3_plugin->arena;
+        bool lock_memory = *i_lock != 0;
+        bool prefault = *i_prefault != 0;
+        bool huge_pages = *i_huge_pages != 0;
+        if (lock_memory == arena.lock_memory && prefault == arena.prefault && huge_pages == arena.huge_pages) {
+            return OK;
+        }
+        // The worker thread may be reconfiguring the plugin.
+        std::lock_guard<std::mutex> state_lock(vst3_plugin->state_mutex);
+        arena.lock_memory = lock_memory;
+        arena.prefault = prefault;
+        arena.huge_pages = huge_pages;
+        // If vst3audio has already set the plugin up, do it again.
+        if (vst3_plugin->blockSize > 0) {
+            vst3_plugin->prepare(csoundGetSr(csound), ksmps());
+        }
+        log(csound, "vst3memory::init: lock: %d prefault: %d huge pages: %d\n", lock_memory, prefault, huge_pages);
+        return OK;
     };
 };
 
-#endif
-
-struct VST3MIDIOUT : public csound::OpcodeBase<VST3MIDIOUT> {
+/**
+ * Runs the plugin at its own sample rate, for plugins that do not support
+ * Csound's; irate 0 runs it at Csound's rate again. The plugin processes
+ * whole blocks at its rate as the resampled input fills them; event and
+ * parameter offsets are converted, and the bridge's delay is included in
+ * the plugin's latency. This is for vst3audio and vst3audiobus, not
+ * vst3chain or vst3layers.
+ */
+struct VST3SAMPLERATE : public csound::OpcodeBase<VST3SAMPLERATE> {
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *k_status;
-    MYFLT *k_channel;
-    MYFLT *k_data1;
-    MYFLT *k_data2;
-    // State.
-    // MIDI channel message parts.
-    uint8_t status;
-    uint8_t channel;
-    uint8_t data1;
-    uint8_t data2;
-    Steinberg::Vst::Event midi_channel_message;
-    Steinberg::Vst::Event prior_midi_channel_message;
-    vst3_plugin_t *vst3_plugin;
+    MYFLT *i_sample_rate;
     int init(CSOUND *csound) {
-        int result = OK;
-        prior_midi_channel_message = midi_channel_message;
-        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        return result;
-    };
-    int kontrol(CSOUND *csound) {
-        int result = OK;
-        status = static_cast<uint8_t>(*k_status) & 0xF0;
-        channel = static_cast<uint8_t>(*k_channel) & 0x0F;
-        data1 = static_cast<uint8_t>(*k_data1);
-        data2 = static_cast<uint8_t>(*k_data2);
-        auto event = Steinberg::Vst::midiToEvent(status, channel, data1, data2);
-        if (event) {
-            midi_channel_message = *event;
-            if (std::memcmp(&prior_midi_channel_message, &midi_channel_message, sizeof(Steinberg::Vst::Event)) != 0) {
-                if (vst3_plugin->inputEventList.addEvent(midi_channel_message) != Steinberg::kResultOk) {
-                    log(csound, "vst3midiout: addEvent error.\n");
-                }
-                std::memcpy(&prior_midi_channel_message, &midi_channel_message, sizeof(Steinberg::Vst::Event));
-            }
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        double sample_rate = *i_sample_rate;
+        if (sample_rate < 0) {
+            log(csound, "vst3samplerate::init: invalid sample rate: %f\n", sample_rate);
+            return NOTOK;
         }
-        return result;
+        if (sample_rate == csoundGetSr(csound)) {
+            sample_rate = 0;
+        }
+        if (sample_rate == vst3_plugin->bridge.plugin_sample_rate) {
+            return OK;
+        }
+        if (sample_rate > 0 && vst3_plugin->oversampling > 1) {
+            log(csound, "vst3samplerate::init: the plugin is already oversampled.\n");
+            return NOTOK;
+        }
+        // The worker thread may be reconfiguring the plugin.
+        std::lock_guard<std::mutex> state_lock(vst3_plugin->state_mutex);
+        vst3_plugin->bridge.plugin_sample_rate = sample_rate;
+        // If vst3audio has already set the plugin up, do it again.
+        if (vst3_plugin->blockSize > 0) {
+            vst3_plugin->prepare(csoundGetSr(csound), ksmps());
+            vst3_host_for_csound(csound)->update_max_latency();
+        }
+        log(csound, "vst3samplerate::init: plugin sample rate: %f latency: %d\n", vst3_plugin->sampleRate, int(vst3_plugin->latency_samples));
+        return OK;
     };
 };
 
-struct VST3NOTE : public csound::OpcodeNoteoffBase<VST3NOTE> {
+/**
+ * Returns the plugin's latency in samples. If icompensate is non-zero,
+ * vst3audio, vst3audiobus, and vst3audiomix delay this plugin's outputs so
+ * that they line up with the outputs of the compensated plugin that has
+ * the most latency.
+ */
+struct VST3LATENCY : public csound::OpcodeBase<VST3LATENCY> {
     // Outputs.
-    MYFLT *i_note_id;
+    MYFLT *k_latency;
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *i_channel;
-    MYFLT *i_key;
-    MYFLT *i_velocity;
-    MYFLT *i_duration;
+    MYFLT *i_compensate;
     // State.
-    int16 channel;		// channel index in event bus
-    MYFLT pitch;
-    int16 midi_key;		// range [0, 127] = [C-2, G8] with A3=440Hz(12-TET)
-    float tuning_cents;	// 1.f = +1 cent, -1.f = -1 cent
-    float velocity;		// range [0.0, 1.0]
-    int32 length;		// in sample frames (optional, Note Off has to follow in any case!)
-    Steinberg::Vst::Event note_on_event{};
-    Steinberg::Vst::Event note_off_event{};
-    size_t framesRemaining;
     vst3_plugin_t *vst3_plugin;
-    MYFLT note_on_time;
-    MYFLT note_duration;
-    MYFLT note_off_time;
-    MYFLT delta_time;
-    int delta_frames;
-    MYFLT note_off_delta_time;
-    int note_off_delta_frames;
-    bool on = false;
     int init(CSOUND *csound) {
-        int result = OK;
+        auto host = vst3_host_for_csound(csound);
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        auto current_time = csound->GetCurrentTimeSamples(csound) / csoundGetSr(csound);
-        // If scheduled after the beginning of the kperiod, will be slightly later.
-        note_on_time = opds.insdshead->p2.value;
-        note_duration = *i_duration;
-        delta_time = note_on_time - current_time;
-        int delta_frames = delta_time * csoundGetSr(csound);
-        // Use the warped p3 to schedule the note off message.
-        if (note_duration > static_cast<MYFLT>(0.0)) {
-            note_off_time = note_on_time + MYFLT(opds.insdshead->p3.value);
-            // In case of real-time performance with indefinite p3...
-        } else if (note_duration == static_cast<MYFLT>(0.0)) {
-#if DEBUGGING
-            csound->Message(csound,
-                            Str("vstnote::init: not scheduling 0 duration note.\n"));
-#endif
-            return OK;
+        if (*i_compensate != 0) {
+            // Every output bus, as vst3audiobus may use them all; if
+            // vst3audio is initialized later, it sizes the delay lines for
+            // its own outputs.
+            auto &process_data = vst3_plugin->hostProcessData;
+            size_t channels = 0;
+            for (Steinberg::int32 bus = 0; bus < process_data.numOutputs; ++bus) {
+                channels += process_data.outputs[bus].numChannels;
+            }
+            if (channels == 0) {
+                channels = csound->GetNchnls(csound);
+            }
+            vst3_plugin->set_latency_compensation(true, channels, ksmps());
         } else {
-            note_off_time = note_on_time + static_cast<MYFLT>(1000000.0);
-        }
-        channel = Steinberg::int16(*i_channel) & 0xf;
-        // Split the real-valued MIDI key number
-        // into an integer key number and an integer number of cents(plus or
-        // minus 50 cents).
-        pitch = *i_key;
-        midi_key = std::round(pitch);
-        tuning_cents = (pitch - midi_key) * double(100.0);
-#if TUNING_TRACING
-        log(csound, "pitch: %9.4f midi_key: %4d tuning_cents: %9.4f\n", pitch, midi_key, tuning_cents);
-#endif
-        velocity = *i_velocity;
-        velocity = velocity / 127.;
-        // Ensure that the opcode instance is still active when we are scheduled
-        // to turn the note off!
-        opds.insdshead->xtratim = opds.insdshead->xtratim + 2;
-        on = true;
-        vst3_plugin->note_id++;
-        note_on_event.type = Steinberg::Vst::Event::EventTypes::kNoteOnEvent;
-        note_on_event.sampleOffset = delta_frames;
-        note_on_event.noteOn.channel = Steinberg::int16(*i_channel);
-        note_on_event.noteOn.pitch = midi_key;
-        note_on_event.noteOn.tuning = tuning_cents;
-        note_on_event.noteOn.velocity = velocity;
-        note_on_event.noteOn.length = note_duration * csoundGetSr(csound);
-        note_on_event.noteOn.noteId = vst3_plugin->note_id;
-        note_off_event.type = Steinberg::Vst::Event::EventTypes::kNoteOffEvent;
-        note_off_event.noteOff.channel = note_on_event.noteOn.channel;
-        note_off_event.noteOff.pitch = note_on_event.noteOn.pitch;
-        note_off_event.noteOff.tuning = note_on_event.noteOn.tuning;
-        note_off_event.noteOff.velocity = 0;
-        note_off_event.noteOff.noteId = note_on_event.noteOn.noteId;
-#if NOTE_TRACING
-        log(csound, "vst3note::init:    current_time:                %12.5f [%12d]\n", current_time, csound->GetCurrentTimeSamples(csound));
-        log(csound, "                   note_on_event time:          %12.5f\n", note_on_time);
-        log(csound, "                   delta_time:                  %12.5f\n", delta_time);
-        log(csound, "                   delta_frames:                %1d\n", delta_frames);
-        log(csound, "                   offset:                      %d\n", note_on_event.sampleOffset);
-        log(csound, "                   note_on_event.type:          %d\n", note_on_event.type);
-        log(csound, "                   note_on_event.sampleOffset:  %d\n", note_on_event.sampleOffset);
-        log(csound, "                   note_on_event.channel:       %d\n", note_on_event.noteOn.channel);
-        log(csound, "                   note_on_event.pitch:         %d\n", note_on_event.noteOn.pitch);
-        log(csound, "                   note_on_event.tuning:        %f\n", note_on_event.noteOn.tuning);
-        log(csound, "                   note_on_event.velocity:      %f\n", note_on_event.noteOn.velocity);
-        log(csound, "                   note_on_event.length:        %d\n", note_on_event.noteOn.length);
-        log(csound, "                   note_on_event.noteId:        %d\n", note_on_event.noteOn.noteId);
-#endif
-        if (vst3_plugin->inputEventList.addEvent(note_on_event) != Steinberg::kResultOk) {
-            log(csound, "vst3note::init: addEvent error for Note On.\n");
-        }
-        *i_note_id = note_on_event.noteOn.noteId;
-        return result;
-    }
-    int noteoff(CSOUND *csound) {
-        int result = OK;
-        // Offset does not seem to apply to the notoff callback.
-        auto current_time = csoundGetCurrentTimeSamples(csound) / csoundGetSr(csound);
-        note_off_event.sampleOffset = 0;
-#if DEBUGGING
-        log(csound, "vst3note::noteoff: current_time:                %12.5f [%12d]\n", current_time, csound->GetCurrentTimeSamples(csound));
-        log(csound, "                   note_off_event.type:         %d\n", note_off_event.type);
-        log(csound, "                   note_off_event.sampleOffset: %d\n", note_off_event.sampleOffset);
-        log(csound, "                   note_off_event.channel:      %d\n", note_off_event.noteOff.channel);
-        log(csound, "                   note_off_event.pitch:        %d\n", note_off_event.noteOff.pitch);
-        log(csound, "                   note_off_event.tuning:       %f\n", note_off_event.noteOff.tuning);
-        log(csound, "                   note_off_event.velocity:     %f\n", note_off_event.noteOff.velocity);
-        log(csound, "                   note_off_event.noteId:       %d\n", note_off_event.noteOff.noteId);
-#endif
-        if (vst3_plugin->inputEventList.addEvent(note_off_event) != Steinberg::kResultOk) {
-            log(csound, "vst3note: addEvent error for Note Off.\n");
+            vst3_plugin->set_latency_compensation(false, 0, 0);
         }
-        return result;
-
+        host->update_max_latency();
+        *k_latency = vst3_plugin->latency_samples;
+        return OK;
     };
     int kontrol(CSOUND *csound) {
-        int result = OK;
-        return result;
+        *k_latency = vst3_plugin->latency_samples;
+        return OK;
     };
 };
 
-struct VST3PARAMGET : public csound::OpcodeBase<VST3PARAMGET> {
+/**
+ * Returns a statistic about the plugin by name, e.g. "warmup_microseconds".
+ */
+struct VST3STATS : public csound::OpcodeBase<VST3STATS> {
     // Outputs.
-    MYFLT *k_parameter_value;
-    // Intputs.
+    MYFLT *k_value;
+    // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *k_parameter_id;
+    STRINGDAT *S_name;
     // State.
     vst3_plugin_t *vst3_plugin;
-    Steinberg::int32 parameter_id;
-    MYFLT old_parameter_value;
+    plugin_stats_t::statistic_t statistic;
     int init(CSOUND *csound) {
-        int result = OK;
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        log(csound, "vst3paramget::kontrol: id: %4d  value: %9.4f\n", parameter_id, *k_parameter_value);
-        return result;
+        statistic = plugin_stats_t::find(S_name->data);
+        if (statistic == plugin_stats_t::kStatisticCount) {
+            log(csound, "vst3stats::init: no statistic named \"%s\".\n", S_name->data);
+            return NOTOK;
+        }
+        return kontrol(csound);
     };
     int kontrol(CSOUND *csound) {
-        int result = OK;
-        parameter_id = int(*k_parameter_id);
-        *k_parameter_value = vst3_plugin->controller->getParamNormalized(parameter_id);
-#if PARAMETER_TRACING
-        if (*k_parameter_value != old_parameter_value) {
-            log(csound, "vst3paramget::kontrol: id: %4d  value: %9.4f\n", parameter_id, *k_parameter_value);
-            old_parameter_value = *k_parameter_value;
-        }
-#endif
-        return result;
+        *k_value = MYFLT(vst3_plugin->stats.get(statistic));
+        return OK;
     };
 };
 
-struct VST3PARAMSET : public csound::OpcodeBase<VST3PARAMSET> {
+/**
+ * Returns 1 in each kperiod in which the plugin output NaN or infinite
+ * samples, and otherwise 0. vst3audio, vst3chain, and vst3layers always
+ * replace such samples with silence; if ireset is non-zero, the plugin is
+ * also reset on the worker thread, i.e. deactivated, reactivated, and
+ * given back its last known-good state, so that it can recover without
+ * stopping the performance. That is its state when it was set up, when
+ * vst3guard was initialized, or when a preset, snapshot, or session was
+ * last loaded into it, whichever was latest.
+ */
+struct VST3GUARD : public csound::OpcodeBase<VST3GUARD> {
+    // Outputs.
+    MYFLT *k_fault;
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *k_parameter_id;
-    MYFLT *k_parameter_value;
+    MYFLT *i_reset;
     // State.
     vst3_plugin_t *vst3_plugin;
-    Steinberg::int32 parameter_id;
-    Steinberg::int32 prior_parameter_id;
-    double parameter_value;
-    double prior_parameter_value;
-    int64_t frames_per_kperiod;
+    uint64_t prior_faults;
     int init(CSOUND *csound) {
-        int result = OK;
         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        frames_per_kperiod = csoundGetKsmps(csound);
-        prior_parameter_id = -1;
-        prior_parameter_value = -1;
-        return result;
+        vst3_plugin->reset_on_fault = *i_reset != 0;
+        if (*i_reset != 0 && vst3_plugin->blockSize > 0) {
+            std::lock_guard<std::mutex> state_lock(vst3_plugin->state_mutex);
+            vst3_plugin->capture_good_state();
+        }
+        prior_faults = vst3_plugin->stats.get(plugin_stats_t::kFaults);
+        *k_fault = 0;
+        return OK;
     };
     int kontrol(CSOUND *csound) {
-        int result = OK;
-        parameter_id = static_cast<Steinberg::int32>(*k_parameter_id);
-        parameter_value = static_cast<double>(*k_parameter_value);
-        // Find the frame at the beginning of the kperiod, and compute the
-        // delta frames for "now."
-        if (parameter_id != prior_parameter_id || parameter_value != prior_parameter_value) {
-            int64_t block_start_frames = opds.insdshead->kcounter * frames_per_kperiod;
-            int64_t current_time_frames = csound->GetCurrentTimeSamples(csound);
-            Steinberg::int32 delta_frames = static_cast<Steinberg::int32>(current_time_frames - block_start_frames);
-            vst3_plugin->setParameter(parameter_id, parameter_value, delta_frames);
-#if PARAMETER_TRACING
-            log(csound, "vst3paramset::kontrol: id: %4d  value: %9.4f  delta_frames: %4d\n", parameter_id, parameter_value, delta_frames);
-#endif
-            prior_parameter_id = parameter_id;
-            prior_parameter_value = parameter_value;
-        }
-        return result;
+        auto faults = vst3_plugin->stats.get(plugin_stats_t::kFaults);
+        *k_fault = faults != prior_faults ? 1 : 0;
+        prior_faults = faults;
+        return OK;
     };
 };
 
-struct VST3PRESETLOAD : public csound::OpcodeBase<VST3PRESETLOAD> {
+/**
+ * If iflush is non-zero, which is the default, denormals are flushed to
+ * zero while the plugin processes, whatever Csound's own floating-point
+ * mode; if it is zero, the mode is left as it is.
+ */
+struct VST3DENORMALS : public csound::OpcodeBase<VST3DENORMALS> {
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *i_preset_filepath;
-    // State.
-    vst3_plugin_t *vst3_plugin;
+    MYFLT *i_flush;
     int init(CSOUND *csound) {
-        vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        std::string preset_filepath = ((STRINGDAT *)i_preset_filepath)->data;
-        vst3_plugin->load_preset(preset_filepath);
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        vst3_plugin->flush_denormals = *i_flush != 0;
         return OK;
     };
 };
 
-struct VST3PRESETSAVE : public csound::OpcodeBase<VST3PRESETSAVE> {
+/**
+ * Sets the number of blocks of silence that the plugin processes when it
+ * is set up, before performance, and if ikey is given, a key to play during
+ * them. The plugin's state is restored afterwards. If vst3audio has already
+ * set the plugin up, the warm-up is done at once.
+ */
+struct VST3WARMUP : public csound::OpcodeBase<VST3WARMUP> {
     // Inputs.
     MYFLT *i_vst3_handle;
-    MYFLT *i_preset_filepath;
-    // State.
-    vst3_plugin_t *vst3_plugin;
+    MYFLT *i_blocks;
+    MYFLT *i_key;
     int init(CSOUND *csound) {
-         vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
-        if (!vst3_plugin || !vst3_plugin->component) {
-            log(csound, "vst3presetsave::init: invalid plugin handle or null component.\n");
-            return NOTOK;
-        }
-        std::string preset_filepath = ((STRINGDAT *)i_preset_filepath)->data;
-        log(csound, "vst3presetsave: preset_filepath: %s\n", preset_filepath.c_str());
-        Steinberg::MemoryStream memory_stream;
-        bool ok = Steinberg::Vst::PresetFile::savePreset(
-            &memory_stream,
-            vst3_plugin->processor_class_id,
-            vst3_plugin->component,
-            vst3_plugin->controller
-        );
-        if (!ok) {
-            log(csound, "vst3presetsave::init: failed to serialize state.\n");
-            return NOTOK;
-        }
-        std::ofstream output(preset_filepath.c_str(), std::ios::binary | std::ios::trunc);
-        if (!output) {
-            log(csound, "vst3presetsave::init: could not open file for writing: %s\n", preset_filepath.c_str());
-            return NOTOK;
+        auto vst3_plugin = get_plugin(csound, static_cast<size_t>(*i_vst3_handle));
+        vst3_plugin->warmup_blocks = std::max(static_cast<Steinberg::int32>(*i_blocks), 0);
+        vst3_plugin->warmup_key = std::min(static_cast<Steinberg::int32>(*i_key), 127);
+        if (vst3_plugin->blockSize > 0) {
+            std::lock_guard<std::mutex> state_lock(vst3_plugin->state_mutex);
+            vst3_plugin->warm_up();
         }
-        output.write(memory_stream.getData(), memory_stream.getSize());
-        output.close();
-        log(csound, "vst3presetsave::init: saved preset to %s (%zu bytes).\n",
-            preset_filepath.c_str(), memory_stream.getSize());
         return OK;
     };
 };
@@ -1695,40 +7348,110 @@ struct VST3TEMPO : public csound::OpcodeBase<VST3TEMPO> {
 
 #if defined(CSOUND_VERSION_MAJOR) && (CSOUND_VERSION_MAJOR >= 7)
 static OENTRY localops[] = {
+    {"vst3activenotes",     sizeof(VST3ACTIVENOTES), 0, "k", "i", &VST3ACTIVENOTES::init_, &VST3ACTIVENOTES::kontrol_, 0},
     {"vst3audio",           sizeof(VST3AUDIO),      0, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_, &VST3AUDIO::audio_, 0},
+    {"vst3audio",           sizeof(VST3AUDIO),      0, "a[]", "ia[]", &VST3AUDIO::init_array_, &VST3AUDIO::audio_, 0},
+    {"vst3audiobus",        sizeof(VST3AUDIO),      0, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_all_busses_, &VST3AUDIO::audio_, 0},
+    {"vst3audiobus",        sizeof(VST3AUDIO),      0, "a[]", "ia[]", &VST3AUDIO::init_all_busses_array_, &VST3AUDIO::audio_, 0},
+    {"vst3audiomix",        sizeof(VST3AUDIO),      0, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_accumulate_, &VST3AUDIO::audio_, 0},
+    {"vst3autosuspend",     sizeof(VST3AUTOSUSPEND), 0, "", "ii", &VST3AUTOSUSPEND::init_, 0, 0},
+    {"vst3bankbuild",       sizeof(VST3BANKBUILD),  0, "i", "SS", &VST3BANKBUILD::init_, 0, 0},
+    {"vst3bankload",        sizeof(VST3BANKLOAD),   0, "i", "S", &VST3BANKLOAD::init_, 0, 0},
+    {"vst3bankrecall",      sizeof(VST3BANKRECALL), 0, "", "iiioo", &VST3BANKRECALL::init_index_, 0, 0},
+    {"vst3bankrecall",      sizeof(VST3BANKRECALL), 0, "", "iiSoo", &VST3BANKRECALL::init_name_, 0, 0},
+    {"vst3chain",           sizeof(VST3CHAIN),      0, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "i[]M", &VST3CHAIN::init_, &VST3CHAIN::audio_, &VST3CHAIN::noteoff_},
     {"vst3info",            sizeof(VST3INFO),       0, "", "i", &VST3INFO::init_, 0, 0},
     {"vst3init",            sizeof(VST3INIT),       0, "i", "TTo", &VST3INIT::init_, 0, 0},
     {"vst3initpreset",      sizeof(VST3INITPRESET), 0, "i", "TTTo", &VST3INITPRESET::init_, 0, 0},
 #if EDITOR_IMPLEMENTED
     {"vst3edit",            sizeof(VST3EDIT),       0, "", "i", &VST3EDIT::init_, 0, 0},
 #endif
+    {"vst3denormals",       sizeof(VST3DENORMALS),  0, "", "ii", &VST3DENORMALS::init_, 0, 0},
+    {"vst3eventroute",      sizeof(VST3EVENTROUTE), 0, "", "iip", &VST3EVENTROUTE::init_, 0, 0},
+    {"vst3guard",           sizeof(VST3GUARD),      0, "k", "io", &VST3GUARD::init_, &VST3GUARD::kontrol_, 0},
+    {"vst3latency",         sizeof(VST3LATENCY),    0, "k", "io", &VST3LATENCY::init_, &VST3LATENCY::kontrol_, 0},
+    {"vst3layers",          sizeof(VST3LAYERS),     0, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "i[]iM", &VST3LAYERS::init_, &VST3LAYERS::audio_, &VST3LAYERS::noteoff_},
+    {"vst3memory",          sizeof(VST3MEMORY),     0, "", "iooo", &VST3MEMORY::init_, 0, 0},
+    {"vst3midiin",          sizeof(VST3MIDIIN),     0, "kkkkkk", "i", &VST3MIDIIN::init_, &VST3MIDIIN::kontrol_, 0},
+    {"vst3midiin",          sizeof(VST3MIDIINARRAY), 0, "kk[]", "io", &VST3MIDIINARRAY::init_, &VST3MIDIINARRAY::kontrol_, 0},
     {"vst3midiout",         sizeof(VST3MIDIOUT),    0, "", "ikkkk", &VST3MIDIOUT::init_, &VST3MIDIOUT::kontrol_, 0},
     {"vst3channelmessage",  sizeof(VST3MIDIOUT),    0, "", "ikkkk", &VST3MIDIOUT::init_, &VST3MIDIOUT::kontrol_, 0},
+    {"vst3morph",           sizeof(VST3MORPH),      0, "", "iiiko", &VST3MORPH::init_k_, &VST3MORPH::kontrol_, &VST3MORPH::noteoff_},
+    {"vst3morph",           sizeof(VST3MORPH),      0, "", "iiiao", &VST3MORPH::init_a_, &VST3MORPH::kontrol_, &VST3MORPH::noteoff_},
     {"vst3note",            sizeof(VST3NOTE),       0, "i", "iiiii", &VST3NOTE::init_, &VST3NOTE::kontrol_, &VST3NOTE::noteoff_},
+    {"vst3recall",          sizeof(VST3RECALL),     0, "", "iioo", &VST3RECALL::init_, 0, 0},
+    {"vst3samplerate",      sizeof(VST3SAMPLERATE), 0, "", "ii", &VST3SAMPLERATE::init_, 0, 0},
+    {"vst3send",            sizeof(VST3SEND),       0, "", "iako", &VST3SEND::init_, &VST3SEND::audio_, 0},
+    {"vst3sessionload",     sizeof(VST3SESSIONLOAD), 0, "i", "So", &VST3SESSIONLOAD::init_, 0, 0},
+    {"vst3sessionsave",     sizeof(VST3SESSIONSAVE), 0, "", "S", &VST3SESSIONSAVE::init_, 0, 0},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, "", "ii", &VST3SEQUENCE::init_table_, &VST3SEQUENCE::kontrol_, &VST3SEQUENCE::noteoff_},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, "", "ii[]", &VST3SEQUENCE::init_array_, &VST3SEQUENCE::kontrol_, &VST3SEQUENCE::noteoff_},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, "", "iS", &VST3SEQUENCE::init_smf_, &VST3SEQUENCE::kontrol_, &VST3SEQUENCE::noteoff_},
+    {"vst3oversample",      sizeof(VST3OVERSAMPLE), 0, "", "ii", &VST3OVERSAMPLE::init_, 0, 0},
+    {"vst3panic",           sizeof(VST3PANIC),      0, "", "iO", &VST3PANIC::init_, &VST3PANIC::kontrol_, 0},
     {"vst3paramget",        sizeof(VST3PARAMGET),   0, "k", "ik", &VST3PARAMGET::init_, &VST3PARAMGET::kontrol_, 0},
     {"vst3paramset",        sizeof(VST3PARAMSET),   0, "", "ikk", &VST3PARAMSET::init_, &VST3PARAMSET::kontrol_, 0},
-    {"vst3presetload",      sizeof(VST3PRESETLOAD), 0, "", "iT", &VST3PRESETLOAD::init_, 0, 0},
+    {"vst3presetload",      sizeof(VST3PRESETLOAD), 0, "", "iToo", &VST3PRESETLOAD::init_, 0, 0},
     {"vst3presetsave",      sizeof(VST3PRESETSAVE), 0, "", "iT", &VST3PRESETSAVE::init_, 0, 0},
+    {"vst3presetsave",      sizeof(VST3PRESETSAVETRIGGER), 0, "k", "iSk", &VST3PRESETSAVETRIGGER::init_, &VST3PRESETSAVETRIGGER::kontrol_, 0},
+    {"vst3snapshot",        sizeof(VST3SNAPSHOT),   0, "", "ii", &VST3SNAPSHOT::init_, 0, 0},
+    {"vst3stats",           sizeof(VST3STATS),      0, "k", "iS", &VST3STATS::init_, &VST3STATS::kontrol_, 0},
     {"vst3tempo",           sizeof(VST3TEMPO),      0, "", "ki", 0, &VST3TEMPO::init_, 0 /*, &vstedit_deinit*/ },
+    {"vst3warmup",          sizeof(VST3WARMUP),     0, "", "iij", &VST3WARMUP::init_, 0, 0},
     {0, 0, 0, 0, 0,(SUBR)0,(SUBR)0,(SUBR)0}
 };
 #else
 static OENTRY localops[] = {
+    {"vst3activenotes",     sizeof(VST3ACTIVENOTES), 0, 3, "k", "i", &VST3ACTIVENOTES::init_, &VST3ACTIVENOTES::kontrol_, 0},
     {"vst3audio",           sizeof(VST3AUDIO),      0, 3, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_, &VST3AUDIO::audio_, 0},
+    {"vst3audio",           sizeof(VST3AUDIO),      0, 3, "a[]", "ia[]", &VST3AUDIO::init_array_, &VST3AUDIO::audio_, 0},
+    {"vst3audiobus",        sizeof(VST3AUDIO),      0, 3, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_all_busses_, &VST3AUDIO::audio_, 0},
+    {"vst3audiobus",        sizeof(VST3AUDIO),      0, 3, "a[]", "ia[]", &VST3AUDIO::init_all_busses_array_, &VST3AUDIO::audio_, 0},
+    {"vst3audiomix",        sizeof(VST3AUDIO),      0, 3, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "M", &VST3AUDIO::init_accumulate_, &VST3AUDIO::audio_, 0},
+    {"vst3autosuspend",     sizeof(VST3AUTOSUSPEND), 0, 1, "", "ii", &VST3AUTOSUSPEND::init_, 0, 0},
+    {"vst3bankbuild",       sizeof(VST3BANKBUILD),  0, 1, "i", "SS", &VST3BANKBUILD::init_, 0, 0},
+    {"vst3bankload",        sizeof(VST3BANKLOAD),   0, 1, "i", "S", &VST3BANKLOAD::init_, 0, 0},
+    {"vst3bankrecall",      sizeof(VST3BANKRECALL), 0, 1, "", "iiioo", &VST3BANKRECALL::init_index_, 0, 0},
+    {"vst3bankrecall",      sizeof(VST3BANKRECALL), 0, 1, "", "iiSoo", &VST3BANKRECALL::init_name_, 0, 0},
+    {"vst3chain",           sizeof(VST3CHAIN),      0, 3, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "i[]M", &VST3CHAIN::init_, &VST3CHAIN::audio_, 0},
     {"vst3info",            sizeof(VST3INFO),       0, 1, "", "i", &VST3INFO::init_, 0, 0},
     {"vst3init",            sizeof(VST3INIT),       0, 1, "i", "TTo", &VST3INIT::init_, 0, 0},
     {"vst3initpreset",      sizeof(VST3INITPRESET), 0, 1, "i", "TTTo", &VST3INITPRESET::init_, 0, 0},
 #if EDITOR_IMPLEMENTED
     {"vst3edit",            sizeof(VST3EDIT),       0, 1, "", "i", &VST3EDIT::init_, 0, 0},
 #endif
+    {"vst3denormals",       sizeof(VST3DENORMALS),  0, 1, "", "ii", &VST3DENORMALS::init_, 0, 0},
+    {"vst3eventroute",      sizeof(VST3EVENTROUTE), 0, 1, "", "iip", &VST3EVENTROUTE::init_, 0, 0},
+    {"vst3guard",           sizeof(VST3GUARD),      0, 3, "k", "io", &VST3GUARD::init_, &VST3GUARD::kontrol_, 0},
+    {"vst3latency",         sizeof(VST3LATENCY),    0, 3, "k", "io", &VST3LATENCY::init_, &VST3LATENCY::kontrol_, 0},
+    {"vst3layers",          sizeof(VST3LAYERS),     0, 3, "mmmmmmmmmmmmmmmmmmmmmmmmmmmmmmmm", "i[]iM", &VST3LAYERS::init_, &VST3LAYERS::audio_, 0},
+    {"vst3memory",          sizeof(VST3MEMORY),     0, 1, "", "iooo", &VST3MEMORY::init_, 0, 0},
+    {"vst3midiin",          sizeof(VST3MIDIIN),     0, 3, "kkkkkk", "i", &VST3MIDIIN::init_, &VST3MIDIIN::kontrol_, 0},
+    {"vst3midiin",          sizeof(VST3MIDIINARRAY), 0, 3, "kk[]", "io", &VST3MIDIINARRAY::init_, &VST3MIDIINARRAY::kontrol_, 0},
     {"vst3midiout",         sizeof(VST3MIDIOUT),    0, 3, "", "ikkkk", &VST3MIDIOUT::init_, &VST3MIDIOUT::kontrol_, 0},
     {"vst3channelmessage",  sizeof(VST3MIDIOUT),    0, 3, "", "ikkkk", &VST3MIDIOUT::init_, &VST3MIDIOUT::kontrol_, 0},
+    {"vst3morph",           sizeof(VST3MORPH),      0, 3, "", "iiiko", &VST3MORPH::init_k_, &VST3MORPH::kontrol_, 0},
+    {"vst3morph",           sizeof(VST3MORPH),      0, 3, "", "iiiao", &VST3MORPH::init_a_, &VST3MORPH::kontrol_, 0},
     {"vst3note",            sizeof(VST3NOTE),       0, 3, "i", "iiiii", &VST3NOTE::init_, &VST3NOTE::kontrol_, 0},
+    {"vst3recall",          sizeof(VST3RECALL),     0, 1, "", "iioo", &VST3RECALL::init_, 0, 0},
+    {"vst3samplerate",      sizeof(VST3SAMPLERATE), 0, 1, "", "ii", &VST3SAMPLERATE::init_, 0, 0},
+    {"vst3send",            sizeof(VST3SEND),       0, 3, "", "iako", &VST3SEND::init_, &VST3SEND::audio_, 0},
+    {"vst3sessionload",     sizeof(VST3SESSIONLOAD), 0, 1, "i", "So", &VST3SESSIONLOAD::init_, 0, 0},
+    {"vst3sessionsave",     sizeof(VST3SESSIONSAVE), 0, 1, "", "S", &VST3SESSIONSAVE::init_, 0, 0},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, 3, "", "ii", &VST3SEQUENCE::init_table_, &VST3SEQUENCE::kontrol_, 0},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, 3, "", "ii[]", &VST3SEQUENCE::init_array_, &VST3SEQUENCE::kontrol_, 0},
+    {"vst3sequence",        sizeof(VST3SEQUENCE),   0, 3, "", "iS", &VST3SEQUENCE::init_smf_, &VST3SEQUENCE::kontrol_, 0},
+    {"vst3oversample",      sizeof(VST3OVERSAMPLE), 0, 1, "", "ii", &VST3OVERSAMPLE::init_, 0, 0},
+    {"vst3panic",           sizeof(VST3PANIC),      0, 3, "", "iO", &VST3PANIC::init_, &VST3PANIC::kontrol_, 0},
     {"vst3paramget",        sizeof(VST3PARAMGET),   0, 3, "k", "ik", &VST3PARAMGET::init_, &VST3PARAMGET::kontrol_, 0},
     {"vst3paramset",        sizeof(VST3PARAMSET),   0, 3, "", "ikk", &VST3PARAMSET::init_, &VST3PARAMSET::kontrol_, 0},
-    {"vst3presetload",      sizeof(VST3PRESETLOAD), 0, 1, "", "iT", &VST3PRESETLOAD::init_, 0, 0},
+    {"vst3presetload",      sizeof(VST3PRESETLOAD), 0, 1, "", "iToo", &VST3PRESETLOAD::init_, 0, 0},
     {"vst3presetsave",      sizeof(VST3PRESETSAVE), 0, 1, "", "iT", &VST3PRESETSAVE::init_, 0, 0},
+    {"vst3presetsave",      sizeof(VST3PRESETSAVETRIGGER), 0, 3, "k", "iSk", &VST3PRESETSAVETRIGGER::init_, &VST3PRESETSAVETRIGGER::kontrol_, 0},
+    {"vst3snapshot",        sizeof(VST3SNAPSHOT),   0, 1, "", "ii", &VST3SNAPSHOT::init_, 0, 0},
+    {"vst3stats",           sizeof(VST3STATS),      0, 3, "k", "iS", &VST3STATS::init_, &VST3STATS::kontrol_, 0},
     {"vst3tempo",           sizeof(VST3TEMPO),      0, 2, "", "ki", 0, &VST3TEMPO::init_, 0 /*, &vstedit_deinit*/ },
+    {"vst3warmup",          sizeof(VST3WARMUP),     0, 1, "", "iij", &VST3WARMUP::init_, 0, 0},
     {0, 0, 0, 0, 0, 0,(SUBR)0,(SUBR)0,(SUBR)0}
 };
 #endif